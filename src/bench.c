@@ -0,0 +1,1338 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "globals.h"
+#include "list.h"
+#include "names.h"
+#include "server.h"
+#include "snapshot.h"
+#include "reactor.h"
+#include "gossip.h"
+#include "reliable.h"
+#include "bench.h"
+
+/** \brief Adds member i of a simulated family to a private list, as a REG would.
+ *
+ * \param list List* List the member is added to.
+ * \param i int Number of the member.
+ *
+ */
+static void simulateMember(List* list, int i)
+{
+    char name[NAME_LEN];
+    Contact* c = newContact();
+    sprintf(name, "member%d.bench", i);
+    setContactName(c, name);
+    c->ip.s_addr = htonl(0x0A000000 + i / 1000);    // 10.0.x.x
+    c->dnsPort = 30000 + i % 1000;
+    c->talkPort = c->dnsPort;
+    add(list, c);
+}
+
+/** \brief Fills a private list with a simulated family of n members, each with its own DNS address.
+ *
+ * \param list List* Empty list to be filled in.
+ * \param n int Number of members.
+ *
+ */
+static void simulateFamily(List* list, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+        simulateMember(list, i);
+}
+
+/** \brief Simulates the OK phase of a join into an n-member family.
+ *
+ * Every member is expected to send an OK, and the OKs arrive in reverse order.
+ * Each OK is matched with getByAddr(), as continueJoinOK() does, and also with
+ * a plain walk of the list, which is what getByAddr() used to do.
+ *
+ * \param n int Number of members of the simulated family.
+ *
+ */
+static void benchJoin(int n)
+{
+    List* family = newList();
+    simulateFamily(family, n);
+
+    Node* p;
+    struct sockaddr_in addr;
+    memset((void*) &addr, (int) '\0', sizeof(addr));
+    addr.sin_family = AF_INET;
+
+    // Indexed matching
+    int pending = 0;
+    for (p = family->next; p != NULL; p = p->next, pending++)
+        p->c->okExpected = 1;
+
+    long long start = nowNs();
+    for (p = family->next; p != NULL; p = p->next)
+    {
+        addr.sin_addr = p->c->ip;
+        addr.sin_port = htons(p->c->dnsPort);
+
+        Contact* c = getByAddr(family, &addr, sizeof(addr));
+        if (c != NULL && c->okExpected == 1)
+        {
+            c->okExpected = 0;
+            pending--;
+        }
+    }
+    long long indexed = nowNs() - start;
+
+    if (pending != 0)
+        printf("Indexed matching lost %d OKs!\n", pending);
+
+    // Linear matching, as before the address index
+    start = nowNs();
+    for (p = family->next; p != NULL; p = p->next)
+    {
+        addr.sin_addr = p->c->ip;
+        addr.sin_port = htons(p->c->dnsPort);
+
+        Node* q = family->next;
+        while (q != NULL && memcmp(&addr, &(q->c->dnsAddr), sizeof(addr)))
+            q = q->next;
+    }
+    long long linear = nowNs() - start;
+
+    printf("Join into %d-member family, %d OKs matched:\n", n, n);
+    printf("  address index: %10.3f ms  (%6.1f ns/OK)\n", indexed / 1e6, (double) indexed / n);
+    printf("  linear scan:   %10.3f ms  (%6.1f ns/OK)\n", linear / 1e6, (double) linear / n);
+
+    freeList(family);
+}
+
+/** \brief Reports how many bytes each contact takes in an n-member family.
+ *
+ * Compares the current layout (small contact plus interned names) with
+ * the layout where every contact embedded a NAME_LEN name buffer.
+ *
+ * \param n int Number of members of the simulated family.
+ *
+ */
+static void benchMemory(int n)
+{
+    size_t namesBefore = internedBytes;
+    int stringsBefore = internedStrings;
+
+    List* family = newList();
+    simulateFamily(family, n);
+
+    size_t hot = contactPool.objSize;
+    size_t names = internedBytes - namesBefore;
+
+    // Contact with a fixed name buffer: name, ip, talkPort, dnsPort, dnsAddr, okExpected
+    size_t fixed = NAME_LEN + sizeof(struct in_addr) + 2 * sizeof(int) + sizeof(struct sockaddr_in) + sizeof(int);
+
+    printf("Memory of a %d-member family (list nodes not included):\n", n);
+    printf("  fixed name buffer: %4d bytes/contact (%.2f contacts per 64-byte cache line)\n",
+           (int) fixed, 64.0 / fixed);
+    printf("  hot contact:       %4d bytes/contact (%.2f contacts per 64-byte cache line)\n",
+           (int) hot, 64.0 / hot);
+    printf("  interned strings:  %6.1f bytes/contact (%d names and wire lines, surname stored once)\n",
+           (double) names / n, internedStrings - stringsBefore);
+    printf("  total:             %6.1f bytes/contact\n", hot + (double) names / n);
+
+    freeList(family);
+}
+
+/** \brief Times queries for unknown names in an n-member family, with and without the name filter.
+ *
+ * \param n int Number of members of the simulated family. As many unknown names are queried.
+ *
+ */
+static void benchQuery(int n)
+{
+    List* family = newList();
+    simulateFamily(family, n);
+
+    char name[NAME_LEN];
+    int i, found = 0;
+
+    long long start = nowNs();
+    for (i = 0; i < n; i++)
+    {
+        sprintf(name, "stranger%d.bench", i);
+        found += (queryName(family, name) != NULL);
+    }
+    long long filtered = nowNs() - start;
+
+    start = nowNs();
+    for (i = 0; i < n; i++)
+    {
+        sprintf(name, "stranger%d.bench", i);
+        found += (get(family, name) != NULL);
+    }
+    long long unfiltered = nowNs() - start;
+
+    if (found != 0)
+        printf("Found %d unknown names!\n", found);
+
+    printf("%d queries for unknown names in a %d-member family:\n", n, n);
+    printf("  with filter:    %8.1f ns/query, %ld false positives (%.2f%%)\n",
+           (double) filtered / n, family->falsePositives, 100.0 * family->falsePositives / n);
+    printf("  without filter: %8.1f ns/query\n", (double) unfiltered / n);
+
+    freeList(family);
+}
+
+/** Number of QRYs in flight at once during the QPS benchmark. */
+#define QPS_WINDOW 256
+
+/** \brief Serves n QRYs to a local client with the current batch size, and returns the time it took.
+ *
+ * The client sends a window of QRYs (half for members, half for strangers),
+ * the server path handles them with parseServerCommand(), or with the callbacks
+ * registered in a reactor, and the client reads the replies.
+ * Both run on this thread, one after the other.
+ *
+ * \param r Reactor* Reactor the server socket is registered in, or NULL to call parseServerCommand().
+ * \param client int Client socket, connected to the server socket.
+ * \param n int Number of QRYs.
+ * \param members int Number of members of the simulated family.
+ * \return long long Nanoseconds taken.
+ *
+ */
+static long long serveQueries(Reactor* r, int client, int n, int members)
+{
+    static char msgs[QPS_WINDOW][128];
+    struct mmsghdr hdrs[QPS_WINDOW];
+    struct iovec iovs[QPS_WINDOW];
+    int sent = 0, i;
+
+    long long start = nowNs();
+
+    while (sent < n)
+    {
+        int window = (n - sent < QPS_WINDOW) ? n - sent : QPS_WINDOW;
+
+        // The client side uses sendmmsg()/recvmmsg() in both modes, so only the server path differs
+        memset((void*) hdrs, (int) '\0', sizeof(hdrs));
+        for (i = 0; i < window; i++)
+        {
+            if (i % 2 == 0)
+                iovs[i].iov_len = sprintf(msgs[i], "QRY member%d.bench", (sent + i) % members);
+            else
+                iovs[i].iov_len = sprintf(msgs[i], "QRY stranger%d.bench", sent + i);
+
+            iovs[i].iov_base = msgs[i];
+            hdrs[i].msg_hdr.msg_iov = &(iovs[i]);
+            hdrs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        sendmmsg(client, hdrs, window, 0);
+
+        // Serve the whole window
+        long target = batchStats.datagrams + window;
+        while (batchStats.datagrams < target)
+        {
+            if (r == NULL)
+                parseServerCommand();
+            else if (reactorRun(r, 1000) <= 0)
+                break;
+        }
+
+        for (i = 0; i < window; i++)
+            iovs[i].iov_len = sizeof(msgs[i]);
+
+        int received = 0;
+        while (received < window)
+        {
+            int ret = recvmmsg(client, hdrs + received, window - received, 0, NULL);
+            if (ret <= 0)
+                break;
+            received += ret;
+        }
+
+        sent += window;
+    }
+
+    return nowNs() - start;
+}
+
+/** \brief Measures QRYs served per second on the dnsSocket path, with batching on and off.
+ *
+ * Uses a simulated family and a temporary socket in place of dnsSocket, so it can only run while not joined.
+ *
+ * \param n int Number of QRYs served in each mode.
+ *
+ */
+static void benchQps(int n)
+{
+    if (dnsSocket != -1)
+    {
+        printf("Leave first: the benchmark uses its own DNS socket.\n");
+        return;
+    }
+
+    int members = 1000;
+    List* family = newList();
+    simulateFamily(family, members);
+
+    struct sockaddr_in addr;
+    socklen_t addrLen = sizeof(addr);
+    memset((void*) &addr, (int) '\0', sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+
+    int server = socket(AF_INET, SOCK_DGRAM, 0);
+    int client = socket(AF_INET, SOCK_DGRAM, 0);
+    int bufSize = 4 * 1024 * 1024;
+    setsockopt(server, SOL_SOCKET, SO_RCVBUF, &bufSize, sizeof(bufSize));
+    setsockopt(client, SOL_SOCKET, SO_RCVBUF, &bufSize, sizeof(bufSize));
+
+    if (bind(server, (struct sockaddr*) &addr, sizeof(addr)) == -1
+        || getsockname(server, (struct sockaddr*) &addr, &addrLen) == -1
+        || connect(client, (struct sockaddr*) &addr, sizeof(addr)) == -1)
+    {
+        perror("Could not prepare benchmark sockets");
+        close(server);
+        close(client);
+        freeList(family);
+        return;
+    }
+
+    // Serve the simulated family from the temporary socket
+    List* savedContacts = contacts;
+    int savedBatchSize = batchSize;
+    contacts = family;
+    dnsSocket = server;
+
+    batchSize = 1;
+    long long unbatched = serveQueries(NULL, client, n, members);
+    long sendsUnbatched = batchStats.sendCalls;
+
+    batchSize = (savedBatchSize > 1) ? savedBatchSize : 32;
+    long long batched = serveQueries(NULL, client, n, members);
+    long sendsBatched = batchStats.sendCalls - sendsUnbatched;
+
+    printf("%d QRYs served from a %d-member family, %d in flight:\n", n, members, QPS_WINDOW);
+    printf("  batch size 1:  %9.0f QRY/s\n", n / (unbatched / 1e9));
+    printf("  batch size %-2d: %9.0f QRY/s (%.1f replies per send)\n",
+           batchSize, n / (batched / 1e9), (double) n / (sendsBatched > 0 ? sendsBatched : 1));
+
+    dnsSocket = -1;
+    contacts = savedContacts;
+    batchSize = savedBatchSize;
+
+    close(server);
+    close(client);
+    freeList(family);
+}
+
+/** \brief Serves n QRYs through a reactor with the given backend, and prints how fast.
+ *
+ * \param backend ReactorBackend Backend to be measured.
+ * \param n int Number of QRYs.
+ * \param members int Number of members of the simulated family in contacts.
+ *
+ */
+static void ioRound(ReactorBackend backend, int n, int members)
+{
+    struct sockaddr_in addr;
+    socklen_t addrLen = sizeof(addr);
+    memset((void*) &addr, (int) '\0', sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+
+    Reactor* r = newReactor(backend);
+    if (r == NULL)
+        return;
+
+    if (reactorBackend(r) != backend)
+    {
+        freeReactor(r);
+        return;
+    }
+
+    int server = socket(AF_INET, SOCK_DGRAM, 0);
+    int client = socket(AF_INET, SOCK_DGRAM, 0);
+    int bufSize = 4 * 1024 * 1024;
+    setsockopt(server, SOL_SOCKET, SO_RCVBUF, &bufSize, sizeof(bufSize));
+    setsockopt(client, SOL_SOCKET, SO_RCVBUF, &bufSize, sizeof(bufSize));
+
+    if (bind(server, (struct sockaddr*) &addr, sizeof(addr)) == -1
+        || getsockname(server, (struct sockaddr*) &addr, &addrLen) == -1
+        || connect(client, (struct sockaddr*) &addr, sizeof(addr)) == -1)
+    {
+        perror("Could not prepare benchmark sockets");
+        close(server);
+        close(client);
+        freeReactor(r);
+        return;
+    }
+
+    // Replies are sent through the global reactor, so it is swapped for this one
+    Reactor* savedReactor = reactor;
+    reactor = r;
+    dnsSocket = server;
+
+    if (reactorAddDatagrams(r, server, dnsDatagram, dnsBatchEnd, NULL) == -1)
+        reactorAdd(r, server, REACTOR_EDGE, dnsReadable, NULL);
+
+    long wakeupsBefore = batchStats.wakeups;
+    long sendsBefore = batchStats.sendCalls;
+    long served = batchStats.datagrams;
+
+    long long ns = serveQueries(r, client, n, members);
+    served = batchStats.datagrams - served;
+
+    printf("  %-9s %9.0f QRY/s, %5.1f QRYs per wakeup, %5.1f replies per send\n",
+           reactorName(r), served / (ns / 1e9),
+           (double) served / (batchStats.wakeups - wakeupsBefore > 0 ? batchStats.wakeups - wakeupsBefore : 1),
+           (double) served / (batchStats.sendCalls - sendsBefore > 0 ? batchStats.sendCalls - sendsBefore : 1));
+
+    reactorRemove(r, server);
+    dnsSocket = -1;
+    reactor = savedReactor;
+
+    close(server);
+    close(client);
+    freeReactor(r);
+}
+
+/** \brief Compares the epoll and io_uring backends of the reactor, serving QRYs on the dnsSocket path.
+ *
+ * Uses a simulated family and temporary sockets in place of dnsSocket, so it can only run while not joined.
+ *
+ * \param n int Number of QRYs served with each backend.
+ *
+ */
+static void benchIo(int n)
+{
+    if (dnsSocket != -1)
+    {
+        printf("Leave first: the benchmark uses its own DNS socket.\n");
+        return;
+    }
+
+    int members = 1000;
+    List* family = newList();
+    simulateFamily(family, members);
+
+    List* savedContacts = contacts;
+    int savedBatchSize = batchSize;
+    contacts = family;
+    batchSize = (savedBatchSize > 1) ? savedBatchSize : 32;
+
+    printf("%d QRYs served from a %d-member family, %d in flight, batch size %d:\n", n, members, QPS_WINDOW, batchSize);
+
+    ioRound(ReactorEpoll, n, members);
+    ioRound(ReactorUring, n, members);
+
+    contacts = savedContacts;
+    batchSize = savedBatchSize;
+    freeList(family);
+}
+
+/** Sample messages of every type, as received on the dnsSocket. */
+static const char* parseSamples[] =
+{
+    "QRY member17.bench",
+    "REG member17.bench;10.0.0.17;30017;30017",
+    "UNR member17.bench",
+    "LST\nmember0.bench;10.0.0.0;30000;30000\nmember1.bench;10.0.0.1;30001;30001\n"
+        "member2.bench;10.0.0.2;30002;30002\nmember3.bench;10.0.0.3;30003;30003\n\n",
+    "DNS member0.bench;10.0.0.0;30000",
+    "OK",
+    "FW member17.bench;10.0.0.0;30000",
+    "RPL member17.bench;10.0.0.17;30017",
+    "NOK - That was not my name"
+};
+
+/** Written by both parsers, so that their work is not optimized away. */
+static volatile int parseSink;
+
+/** \brief Parses a message the way handleServerMessage() and its handlers used to: sscanf() and strcmp().
+ *
+ * \param buffer char* Message to parse. May be overwritten.
+ *
+ */
+static void parseLegacy(char* buffer)
+{
+    char cmd[16], name[128], ip[128], info[112];
+    int a = 0, b = 0;
+
+    sscanf(buffer, "%15s", cmd);
+
+    if (strcmp("QRY", cmd) == 0 || strcmp("UNR", cmd) == 0)
+    {
+        sscanf(buffer, "%*s %127s", name);
+    }
+    else if (strcmp("REG", cmd) == 0)
+    {
+        sscanf(buffer, "%*s %127s", buffer);
+        sscanf(buffer, "%127[^;];%31[^;];%d;%d", name, ip, &a, &b);
+    }
+    else if (strcmp("LST", cmd) == 0)
+    {
+        char* caret = strchr(buffer, '\n') + 1;
+        while (*caret != '\n' && *caret != '\0')
+        {
+            sscanf(caret, "%127[^;];%31[^;];%d;%d", name, ip, &a, &b);
+            caret = strchr(caret + 1, '\n') + 1;
+        }
+    }
+    else if (strcmp("DNS", cmd) == 0)
+    {
+        sscanf(buffer, "DNS %127[^;];%127[^;];%d", name, ip, &a);
+    }
+    else if (strcmp("OK", cmd) == 0)
+    {
+    }
+    else if (strcmp("FW", cmd) == 0)
+    {
+        sscanf(buffer, "%15s %111s", cmd, info);
+        strtok(info, ";");
+        strtok(NULL, ";");
+        a = atoi(strtok(NULL, ";"));
+    }
+    else if (strcmp("RPL", cmd) == 0)
+    {
+        sscanf(buffer, "%15s %111s", cmd, info);
+        sscanf(buffer, "RPL %[^;];%[^;];%d", name, ip, &a);
+    }
+
+    parseSink = a + b;
+}
+
+/** \brief Parses a message with parseMessage(), splitting LST lines and converting ports as the handlers do.
+ *
+ * \param buffer char* Message to parse. Will be overwritten.
+ *
+ */
+static void parseTable(char* buffer)
+{
+    Message msg;
+    int i, a = 0;
+
+    parseMessage(buffer, &msg);
+
+    if (msg.opcode == OpLST)
+    {
+        char* caret = msg.rest;
+        while (*caret != '\n' && *caret != '\0')
+        {
+            Field fields[MAX_FIELDS];
+            char* line = caret;
+            caret = strchr(line, '\n');
+            *caret++ = '\0';
+
+            if (splitFields(line, fields, MAX_FIELDS) == 4)
+                a += strtol(fields[2].str, NULL, 10) + strtol(fields[3].str, NULL, 10);
+        }
+    }
+
+    // Numeric fields are the ports, after the name and IP
+    for (i = 2; i < msg.nFields; i++)
+        a += strtol(msg.fields[i].str, NULL, 10);
+
+    parseSink = a;
+}
+
+/** \brief Times the parse of every message type, with the opcode table and with the old sscanf() chain.
+ *
+ * \param n int Number of times each message is parsed.
+ *
+ */
+static void benchParse(int n)
+{
+    int i, j;
+    char buffer[2048];
+    int nSamples = sizeof(parseSamples) / sizeof(parseSamples[0]);
+
+    printf("Parse cost per message, %d runs each:\n", n);
+    printf("  type    sscanf    table\n");
+
+    for (j = 0; j < nSamples; j++)
+    {
+        const char* sample = parseSamples[j];
+        size_t len = strlen(sample) + 1;
+
+        // Both parsers overwrite the buffer, so both pay for the copy
+        long long start = nowNs();
+        for (i = 0; i < n; i++)
+        {
+            memcpy(buffer, sample, len);
+            parseLegacy(buffer);
+        }
+        long long legacy = nowNs() - start;
+
+        start = nowNs();
+        for (i = 0; i < n; i++)
+        {
+            memcpy(buffer, sample, len);
+            parseTable(buffer);
+        }
+        long long table = nowNs() - start;
+
+        printf("  %-4.*s %7.0fns %7.0fns\n", (int) strcspn(sample, " \n"), sample,
+               (double) legacy / n, (double) table / n);
+    }
+}
+
+/** Reader threads of the snapshot benchmark. */
+#define RCU_READERS 3
+
+/** Latency samples kept per reader. The most recent ones are kept. */
+#define RCU_SAMPLES (1 << 19)
+
+/** REG/UNR pairs per second made by the writer during the snapshot benchmark. */
+#define RCU_CHANGE_RATE 20000
+
+/** Changes between snapshots, as if they arrived in one batch of datagrams. */
+#define RCU_BATCH 32
+
+/** \brief A thread querying a list during the snapshot benchmark.
+ */
+typedef struct RcuReader
+{
+    pthread_t thread;
+    List* list;
+    int members;
+    int stop;
+
+    /** Seed for the names queried. */
+    unsigned int seed;
+
+    /** Reader slot for snapshotQuery(). -1 to query the list itself under rcuLock instead. */
+    int reader;
+
+    long long* samples;
+    long reads;
+} RcuReader;
+
+/** Lock the snapshot benchmark uses in place of snapshots, to compare with them. */
+static pthread_rwlock_t rcuLock;
+
+/** \brief Queries random names, half of them unknown, and records how long each query took.
+ *
+ * \param arg void* The RcuReader.
+ * \return void* NULL.
+ *
+ */
+static void* rcuReaderLoop(void* arg)
+{
+    RcuReader* r = (RcuReader*) arg;
+    char name[NAME_LEN];
+    char reply[256];
+
+    while (!__atomic_load_n(&(r->stop), __ATOMIC_ACQUIRE))
+    {
+        int i = rand_r(&(r->seed)) % (2 * r->members);
+        if (i < r->members)
+            sprintf(name, "member%d.bench", i);
+        else
+            sprintf(name, "stranger%d.bench", i);
+
+        long long start = nowNs();
+
+        if (r->reader == -1)
+        {
+            pthread_rwlock_rdlock(&rcuLock);
+            Contact* c = queryName(r->list, name);
+            if (c != NULL)
+                memcpy(reply, c->wire, c->rplLen);
+            pthread_rwlock_unlock(&rcuLock);
+        }
+        else
+            snapshotQuery(r->list, r->reader, name, reply, sizeof(reply));
+
+        r->samples[r->reads % RCU_SAMPLES] = nowNs() - start;
+        r->reads++;
+    }
+
+    return NULL;
+}
+
+/** \brief Compares two latencies, for qsort().
+ */
+static int compareLatency(const void* a, const void* b)
+{
+    long long x = *(const long long*) a;
+    long long y = *(const long long*) b;
+
+    return (x > y) - (x < y);
+}
+
+/** \brief Runs readers against a list for a second, while this thread removes and re-adds members.
+ *
+ * \param n int Number of members of the simulated family.
+ * \param useSnapshots int 1 to have readers use snapshots, 0 to have them share a rwlock with the writer.
+ *
+ */
+static void rcuRound(int n, int useSnapshots)
+{
+    RcuReader readers[RCU_READERS];
+    int i, nReaders = 0;
+    long changes = 0;
+
+    List* family = newList();
+    simulateFamily(family, n);
+    if (useSnapshots)
+        publishSnapshot(family);
+
+    for (i = 0; i < RCU_READERS; i++)
+    {
+        RcuReader* r = &(readers[nReaders]);
+        memset((void*) r, (int) '\0', sizeof(*r));
+        r->list = family;
+        r->members = n;
+        r->seed = i + 1;
+        r->reader = useSnapshots ? snapshotReader() : -1;
+        r->samples = malloc(RCU_SAMPLES * sizeof(long long));
+
+        if (r->samples == NULL || (useSnapshots && r->reader == -1)
+            || pthread_create(&(r->thread), NULL, rcuReaderLoop, r) != 0)
+        {
+            printf("Could not start reader %d.\n", i);
+            releaseReader(r->reader);
+            free(r->samples);
+            continue;
+        }
+        nReaders++;
+    }
+
+    char name[NAME_LEN];
+    unsigned int seed = 42;
+    long long start = nowNs();
+    long long now = start;
+
+    while (now - start < 1000000000LL)
+    {
+        // Keep to the change rate, so that the readers get the CPU they would get on a DNS
+        if (changes * 1000000000LL / RCU_CHANGE_RATE > now - start)
+        {
+            now = nowNs();
+            continue;
+        }
+
+        int member = rand_r(&seed) % n;
+        sprintf(name, "member%d.bench", member);
+
+        if (useSnapshots)
+        {
+            removeFrom(family, name);
+            simulateMember(family, member);
+
+            if (++changes % RCU_BATCH == 0)
+                publishSnapshot(family);
+        }
+        else
+        {
+            pthread_rwlock_wrlock(&rcuLock);
+            removeFrom(family, name);
+            simulateMember(family, member);
+            pthread_rwlock_unlock(&rcuLock);
+
+            changes++;
+        }
+
+        now = nowNs();
+    }
+
+    long reads = 0, kept = 0;
+    for (i = 0; i < nReaders; i++)
+    {
+        __atomic_store_n(&(readers[i].stop), 1, __ATOMIC_RELEASE);
+        pthread_join(readers[i].thread, NULL);
+        releaseReader(readers[i].reader);
+        reads += readers[i].reads;
+        kept += readers[i].reads < RCU_SAMPLES ? readers[i].reads : RCU_SAMPLES;
+    }
+
+    // Percentiles are taken over the samples of every reader together
+    long long* all = malloc((kept > 0 ? kept : 1) * sizeof(long long));
+    long k = 0;
+    for (i = 0; i < nReaders; i++)
+    {
+        long m = readers[i].reads < RCU_SAMPLES ? readers[i].reads : RCU_SAMPLES;
+        memcpy(all + k, readers[i].samples, m * sizeof(long long));
+        k += m;
+        free(readers[i].samples);
+    }
+
+    if (all != NULL && kept > 0)
+    {
+        qsort(all, kept, sizeof(long long), compareLatency);
+        printf("  %-9s %9.0f %7lldns %7lldns %7lldns %8lldns\n", useSnapshots ? "snapshot" : "rwlock",
+               (double) reads * 1000000000.0 / (now - start),
+               all[kept / 2], all[kept * 99 / 100], all[kept * 999 / 1000], all[kept - 1]);
+    }
+    free(all);
+
+    freeList(family);
+    reclaimSnapshots();
+}
+
+/** \brief Measures reader tail latency under REG/UNR churn, with snapshots and with a rwlock.
+ *
+ * \param n int Number of members of the simulated family.
+ *
+ */
+static void benchRcu(int n)
+{
+    pthread_rwlockattr_t attr;
+
+    // Writers first, as a DNS must not starve REGs under a flood of QRYs
+    pthread_rwlockattr_init(&attr);
+    pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+    pthread_rwlock_init(&rcuLock, &attr);
+    pthread_rwlockattr_destroy(&attr);
+
+    printf("Reader latency, %d readers, %d members, %d REG/UNR pairs per second:\n", RCU_READERS, n, RCU_CHANGE_RATE);
+    printf("  %-9s %9s %9s %9s %9s %10s\n", "readers", "reads/s", "p50", "p99", "p99.9", "max");
+
+    rcuRound(n, 0);
+    rcuRound(n, 1);
+
+    printSnapshotStats();
+    pthread_rwlock_destroy(&rcuLock);
+}
+
+/** Times each join is measured, keeping the fastest. */
+#define FANOUT_ROUNDS 3
+
+/** How long a join waits for the next OK before it gives up on the ones still missing, in milliseconds. */
+#define FANOUT_OK_WAIT_MS 1000
+
+/** Receive buffer of the benchmark sockets, so that a 10000-member fan-out is not dropped. Capped by the kernel. */
+#define FANOUT_SOCKET_BUFFER (16 * 1024 * 1024)
+
+/** \brief A socket that stands for every member of a simulated family, and answers their REGs.
+ */
+typedef struct RegSink
+{
+    int fd;
+    volatile int stop;
+} RegSink;
+
+/** \brief Thread of the sink: answers every REG with an OK until told to stop.
+ *
+ * The OK echoes the id of the REG, as a member does, and is sent from the address the REG was sent to,
+ * so that the joiner matches it with that member.
+ *
+ */
+static void* answerRegs(void* arg)
+{
+    RegSink* sink = (RegSink*) arg;
+    char buffer[512];
+    char reply[32];
+    char control[CMSG_SPACE(sizeof(struct in_pktinfo))];
+    struct sockaddr_in from;
+    struct iovec iov;
+    struct msghdr hdr;
+
+    while (!sink->stop)
+    {
+        memset((void*) &hdr, (int) '\0', sizeof(hdr));
+        iov.iov_base = buffer;
+        iov.iov_len = sizeof(buffer) - 1;
+        hdr.msg_name = &from;
+        hdr.msg_namelen = sizeof(from);
+        hdr.msg_iov = &iov;
+        hdr.msg_iovlen = 1;
+        hdr.msg_control = control;
+        hdr.msg_controllen = sizeof(control);
+
+        // Times out now and then, to see if it should stop
+        int len = recvmsg(sink->fd, &hdr, 0);
+        if (len <= 0)
+            continue;
+        buffer[len] = '\0';
+
+        struct cmsghdr* cm = CMSG_FIRSTHDR(&hdr);
+        if (cm == NULL || cm->cmsg_level != IPPROTO_IP || cm->cmsg_type != IP_PKTINFO)
+            continue;
+
+        // Answer from the member address the REG went to
+        struct in_pktinfo* info = (struct in_pktinfo*) CMSG_DATA(cm);
+        info->ipi_spec_dst = info->ipi_addr;
+        info->ipi_ifindex = 0;
+
+        // The id line is the last one
+        char* id = strstr(buffer, "\nID ");
+        iov.iov_base = reply;
+        iov.iov_len = sprintf(reply, "OK%.20s", (id != NULL) ? id : "");
+
+        sendmsg(sink->fd, &hdr, 0);
+    }
+
+    return NULL;
+}
+
+/** \brief Joins the family in contacts as registerWith() does, and returns the time from the first REG to the last OK.
+ *
+ * Every REG is sent, one sendReliable() each or with sendReliableMany(), and then the OKs are
+ * handled as the DNS socket would, down to continueJoinOK(). The LST from the DNS is not part of it.
+ * The pending requests are dropped afterwards, so nothing is sent again.
+ *
+ * \param batched int 1 to use sendReliableMany(), 0 to call sendReliable() for each member.
+ * \param out_calls long* Where the number of system calls made to send the REGs is written.
+ * \param out_lost int* Where the number of OKs that never came is written.
+ * \return long long Nanoseconds taken, until the last OK that came.
+ *
+ */
+static long long joinRound(int batched, long* out_calls, int* out_lost)
+{
+    const char* reg = "REG joiner.bench;127.0.0.1;30000;30001";
+    struct sockaddr_in addrs[FANOUT_BATCH];
+    int sent[FANOUT_BATCH];
+    Contact* batch[FANOUT_BATCH];
+    long calls = reliableStats.sendCalls;
+    int n = 0, i;
+    Node* p;
+
+    // While the LST is still coming, as far as stopExpectingOK() knows, so that it does not say we joined
+    oksExpected = 0;
+    joinStatus = WaitForLST;
+
+    long long start = nowNs();
+    long long last = start;
+
+    for (p = contacts->next; p != NULL; p = p->next)
+    {
+        if (!batched)
+        {
+            if (sendReliable(reg, &(p->c->dnsAddr)) != -1)
+            {
+                p->c->okExpected = 1;
+                oksExpected++;
+            }
+            continue;
+        }
+
+        batch[n] = p->c;
+        addrs[n++] = p->c->dnsAddr;
+        if (n < FANOUT_BATCH && p->next != NULL)
+            continue;
+
+        sendReliableMany(reg, addrs, n, sent);
+        for (i = 0; i < n; i++)
+        {
+            if (sent[i])
+            {
+                batch[i]->okExpected = 1;
+                oksExpected++;
+            }
+        }
+        n = 0;
+    }
+
+    *out_calls = reliableStats.sendCalls - calls;
+
+    struct pollfd pfd;
+    pfd.fd = dnsSocket;
+    pfd.events = POLLIN;
+
+    while (oksExpected > 0 && poll(&pfd, 1, FANOUT_OK_WAIT_MS) > 0)
+    {
+        char buffer[512];
+        struct sockaddr_in addr;
+        socklen_t addrLen = sizeof(addr);
+
+        int len = recvfrom(dnsSocket, buffer, sizeof(buffer) - 1, 0, (struct sockaddr*) &addr, &addrLen);
+        if (len <= 0)
+            continue;
+        buffer[len] = '\0';
+
+        handleServerMessage(buffer, &addr, addrLen);
+        last = nowNs();
+    }
+
+    *out_lost = oksExpected;
+
+    for (p = contacts->next; p != NULL; p = p->next)
+        p->c->okExpected = 0;
+    oksExpected = 0;
+    joinStatus = NotJoined;
+    resetReliable();
+
+    return last - start;
+}
+
+/** \brief Measures the wall time of a join into a big family, from the first REG to the last OK, with and without sendmmsg().
+ *
+ * Every member has an address of its own in 127.0.0.0/8, all of them received by one socket,
+ * whose thread answers each REG with an OK. So the members' turnaround is that of one thread.
+ * The joiner's socket is used in place of dnsSocket, so it can only run while not joined.
+ *
+ * \param n int Number of members. 0 for families of 1000 and 10000.
+ *
+ */
+static void benchFanout(int n)
+{
+    int sizes[2] = { 1000, 10000 };
+    int nSizes = 2, s, i, round;
+
+    if (dnsSocket != -1)
+    {
+        printf("Leave first: the benchmark uses its own DNS socket.\n");
+        return;
+    }
+
+    if (n > 0)
+    {
+        sizes[0] = n;
+        nSizes = 1;
+    }
+
+    struct sockaddr_in sinkAddr;
+    socklen_t addrLen = sizeof(sinkAddr);
+    memset((void*) &sinkAddr, (int) '\0', sizeof(sinkAddr));
+    sinkAddr.sin_family = AF_INET;
+    sinkAddr.sin_addr.s_addr = htonl(INADDR_ANY);
+    sinkAddr.sin_port = 0;
+
+    RegSink sink;
+    pthread_t sinkThread;
+    int sender = socket(AF_INET, SOCK_DGRAM, 0);
+    int bufSize = FANOUT_SOCKET_BUFFER;
+    int on = 1;
+    struct timeval wake = { 0, 100000 };
+
+    sink.fd = socket(AF_INET, SOCK_DGRAM, 0);
+    sink.stop = 0;
+    setsockopt(sink.fd, SOL_SOCKET, SO_RCVBUF, &bufSize, sizeof(bufSize));
+    setsockopt(sender, SOL_SOCKET, SO_RCVBUF, &bufSize, sizeof(bufSize));
+
+    if (setsockopt(sink.fd, IPPROTO_IP, IP_PKTINFO, &on, sizeof(on)) == -1
+        || setsockopt(sink.fd, SOL_SOCKET, SO_RCVTIMEO, &wake, sizeof(wake)) == -1
+        || bind(sink.fd, (struct sockaddr*) &sinkAddr, sizeof(sinkAddr)) == -1
+        || getsockname(sink.fd, (struct sockaddr*) &sinkAddr, &addrLen) == -1)
+    {
+        perror("Could not prepare benchmark sockets");
+        close(sink.fd);
+        close(sender);
+        return;
+    }
+
+    if (pthread_create(&sinkThread, NULL, answerRegs, &sink) != 0)
+    {
+        printf("Could not start the thread that answers the REGs.\n");
+        close(sink.fd);
+        close(sender);
+        return;
+    }
+
+    List* savedContacts = contacts;
+    dnsSocket = sender;
+
+    printf("Join wall time, first REG to last OK, %s backend, fastest of %d:\n", reactorName(reactor), FANOUT_ROUNDS);
+    printf("  %8s %22s %22s %9s\n", "members", "one sendto() each", "sendReliableMany()", "speed-up");
+
+    for (s = 0; s < nSizes; s++)
+    {
+        int members = sizes[s];
+        long long best[2] = { 0, 0 };
+        long calls[2] = { 0, 0 };
+        int lost[2] = { 0, 0 };
+        List* family = newList();
+
+        // 127.1.x.y, any of them reaches the sink
+        for (i = 0; i < members; i++)
+        {
+            char name[NAME_LEN];
+            Contact* c = newContact();
+            sprintf(name, "member%d.bench", i);
+            setContactName(c, name);
+            c->ip.s_addr = htonl(0x7F010000 + ((i / 250) << 8) + (i % 250) + 1);
+            c->dnsPort = ntohs(sinkAddr.sin_port);
+            c->talkPort = c->dnsPort;
+            add(family, c);
+        }
+
+        contacts = family;
+
+        for (round = 0; round < FANOUT_ROUNDS; round++)
+        {
+            int batched;
+            for (batched = 0; batched < 2; batched++)
+            {
+                int missing;
+                long long t = joinRound(batched, &(calls[batched]), &missing);
+
+                // A round that lost OKs did not finish, and does not count
+                if (missing > 0)
+                {
+                    lost[batched] += missing;
+                    continue;
+                }
+                if (best[batched] == 0 || t < best[batched])
+                    best[batched] = t;
+            }
+        }
+
+        contacts = savedContacts;
+        freeList(family);
+
+        if (best[0] == 0 || best[1] == 0)
+        {
+            printf("  %8d every round lost OKs: %d and %d. Try a larger net.core.rmem_max.\n", members, lost[0], lost[1]);
+            continue;
+        }
+
+        printf("  %8d %9.3f ms %6ld calls %9.3f ms %6ld calls %8.1fx\n", members,
+               best[0] / 1e6, calls[0], best[1] / 1e6, calls[1], (double) best[0] / best[1]);
+        if (lost[0] > 0 || lost[1] > 0)
+            printf("  %8s %d and %d OKs lost in rounds left out\n", "", lost[0], lost[1]);
+    }
+
+    sink.stop = 1;
+    pthread_join(sinkThread, NULL);
+
+    dnsSocket = -1;
+    close(sink.fd);
+    close(sender);
+}
+
+/** Joins simulated for each row of the gossip benchmark. */
+#define GOSSIP_TRIALS 20
+
+/** \brief Outcome of the simulated joins of one row of the gossip benchmark, summed over the trials.
+ */
+typedef struct GossipRun
+{
+    long joinerDatagrams;
+    long datagrams;
+    long rounds;
+    long maxRounds;
+    long missed;
+} GossipRun;
+
+/** \brief Sends a request until both it and its reply get through, as sendReliable() does.
+ *
+ * \return int Datagrams sent, requests and replies. Counts the attempts in *attempts.
+ *
+ */
+static int simulateRequest(unsigned int* seed, int lossPct, int* attempts)
+{
+    int sent = 0;
+
+    *attempts = 0;
+    for (;;)
+    {
+        (*attempts)++;
+        sent++;
+        if (rand_r(seed) % 100 < lossPct)
+            continue;
+
+        sent++;
+        if (rand_r(seed) % 100 >= lossPct)
+            return sent;
+    }
+}
+
+/** \brief Simulates a join into an n-member family, over rounds of GOSSIP_PERIOD_MS.
+ *
+ * With fanout 0, the joiner sends REG to every member, and every member knows once its REG got through.
+ * Otherwise, it sends REG to the DNS (member 0) and fanout others, and every member that learns of the join
+ * passes it on to fanout members picked at random, for rumorTransmits() rounds, as gossipRound() does.
+ *
+ * \param n int Members of the family, besides the joiner.
+ * \param fanout int Fan-out, 0 for no gossip.
+ * \param lossPct int Chance of each datagram being lost, in percent.
+ * \param seed unsigned int* Seed of the simulation.
+ * \param run GossipRun* Where the outcome is added.
+ *
+ */
+static void simulateGossip(int n, int fanout, int lossPct, unsigned int* seed, GossipRun* run)
+{
+    int* learnedRound = (int*) malloc(n * sizeof(int));
+    int* transmits = (int*) malloc(n * sizeof(int));
+    int i, j, attempts, round, lastRound = 0, active = 0;
+    int rounds = rumorTransmits(n + 1, fanout);
+
+    for (i = 0; i < n; i++)
+    {
+        learnedRound[i] = -1;
+        transmits[i] = 0;
+    }
+
+    // The joiner tells the DNS and fanout members picked at random, or everyone, and waits for their OKs
+    int told = (fanout == 0 || fanout >= n - 1) ? n : fanout + 1;
+
+    for (i = 0; i < told; i++)
+    {
+        int m = i;
+        while (told < n && i > 0 && (m == i || learnedRound[m] != -1))
+            m = 1 + rand_r(seed) % (n - 1);
+
+        int sent = simulateRequest(seed, lossPct, &attempts);
+        run->joinerDatagrams += sent;
+        run->datagrams += sent;
+
+        learnedRound[m] = attempts - 1;
+        if (attempts - 1 > lastRound)
+            lastRound = attempts - 1;
+        if (fanout > 0)
+        {
+            transmits[m] = rounds;
+            active++;
+        }
+    }
+
+    // Gossip rounds, until everyone is done passing it on
+    for (round = 1; active > 0; round++)
+    {
+        for (i = 0; i < n; i++)
+        {
+            if (transmits[i] == 0 || learnedRound[i] >= round)
+                continue;
+
+            for (j = 0; j < fanout; j++)
+            {
+                // Anyone else, the joiner among them
+                int m = rand_r(seed) % n;
+                if (m == i)
+                    continue;
+
+                run->datagrams++;
+                if (rand_r(seed) % 100 < lossPct || learnedRound[m] != -1)
+                    continue;
+
+                learnedRound[m] = round;
+                lastRound = round;
+                transmits[m] = rounds;
+                active++;
+            }
+
+            if (--transmits[i] == 0)
+                active--;
+        }
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        if (learnedRound[i] == -1)
+            run->missed++;
+    }
+
+    run->rounds += lastRound;
+    if (lastRound > run->maxRounds)
+        run->maxRounds = lastRound;
+
+    free(learnedRound);
+    free(transmits);
+}
+
+/** \brief Compares joins told to every member with joins gossiped with bounded fan-out, in a simulated family.
+ *
+ * Reports the datagrams the joiner sends and receives, those the whole family does,
+ * how many rounds it takes for every member to know, and how many never do.
+ *
+ * \param n int Number of members of the simulated family.
+ *
+ */
+static void benchGossip(int n)
+{
+    static const int fanouts[] = { 0, 2, 3, 4 };
+    static const int losses[] = { 0, 10 };
+    unsigned int seed = 42;
+    int f, l, t;
+
+    if (n < 2)
+        n = 2;
+
+    printf("Join into %d-member family, %d trials each, rounds of %d ms:\n", n, GOSSIP_TRIALS, GOSSIP_PERIOD_MS);
+    printf("  %-10s %5s %8s %14s %14s %10s %10s %10s\n", "fan-out", "loss", "sends", "joiner dgrams", "total dgrams", "rounds", "max", "missed");
+
+    for (l = 0; l < (int) (sizeof(losses) / sizeof(losses[0])); l++)
+    {
+        for (f = 0; f < (int) (sizeof(fanouts) / sizeof(fanouts[0])); f++)
+        {
+            GossipRun run;
+            memset((void*) &run, (int) '\0', sizeof(run));
+
+            for (t = 0; t < GOSSIP_TRIALS; t++)
+                simulateGossip(n, fanouts[f], losses[l], &seed, &run);
+
+            char label[16];
+            if (fanouts[f] == 0)
+                strcpy(label, "all (REG)");
+            else
+                sprintf(label, "%d", fanouts[f]);
+
+            printf("  %-10s %4d%% %8d %14.1f %14.1f %10.1f %10ld %10.2f\n", label, losses[l],
+                   (fanouts[f] > 0 ? rumorTransmits(n + 1, fanouts[f]) : 1),
+                   (double) run.joinerDatagrams / GOSSIP_TRIALS, (double) run.datagrams / GOSSIP_TRIALS,
+                   (double) run.rounds / GOSSIP_TRIALS, run.maxRounds, (double) run.missed / GOSSIP_TRIALS);
+        }
+    }
+}
+
+/** \brief Runs a benchmark. Debug command.
+ *
+ * Format: bench join|memory|query|qps|io|parse|rcu|fanout|gossip [n]
+ *
+ * \param line char* Line typed by the user, including the 'bench' word.
+ *
+ */
+void benchmark(char* line)
+{
+    char which[32];
+    int n = 0;
+
+    int ret = sscanf(line, "%*s %31s %d", which, &n);
+    if (ret < 1)
+    {
+        printf("Usage: bench join|memory|query|qps|io|parse|rcu|fanout|gossip [n]\n");
+        return;
+    }
+
+    if (strcmp(which, "join") == 0)
+    {
+        benchJoin(n > 0 ? n : 10000);
+    }
+    else if (strcmp(which, "memory") == 0)
+    {
+        benchMemory(n > 0 ? n : 100000);
+    }
+    else if (strcmp(which, "query") == 0)
+    {
+        benchQuery(n > 0 ? n : 10000);
+    }
+    else if (strcmp(which, "qps") == 0)
+    {
+        benchQps(n > 0 ? n : 200000);
+    }
+    else if (strcmp(which, "io") == 0)
+    {
+        benchIo(n > 0 ? n : 200000);
+    }
+    else if (strcmp(which, "parse") == 0)
+    {
+        benchParse(n > 0 ? n : 100000);
+    }
+    else if (strcmp(which, "rcu") == 0)
+    {
+        benchRcu(n > 0 ? n : 10000);
+    }
+    else if (strcmp(which, "fanout") == 0)
+    {
+        benchFanout(n);
+    }
+    else if (strcmp(which, "gossip") == 0)
+    {
+        benchGossip(n > 0 ? n : 1000);
+    }
+    else
+    {
+        printf("Unknown benchmark '%s'.\n", which);
+    }
+}
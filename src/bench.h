@@ -0,0 +1,6 @@
+#ifndef BENCH_H_INCLUDED
+#define BENCH_H_INCLUDED
+
+void benchmark(char* line);
+
+#endif // BENCH_H_INCLUDED
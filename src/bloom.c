@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bloom.h"
+
+/** Counters stop counting at this value, and are never decremented afterwards. */
+#define BLOOM_SATURATED 255
+
+/** \brief Gets the i-th counter position of a hash, using double hashing.
+ */
+static unsigned int position(Bloom* bloom, unsigned int hash, int i)
+{
+    unsigned int step = (((hash >> 16) | (hash << 16)) * 0x9E3779B1u) | 1;
+
+    return (hash + i * step) & (bloom->size - 1);
+}
+
+/** \brief Prepares an empty filter.
+ *
+ * \param bloom Bloom* Filter to be initialized.
+ * \param size unsigned int Number of counters. Must be a power of 2.
+ * \param hashes int Number of counters touched by each name.
+ *
+ */
+void bloomInit(Bloom* bloom, unsigned int size, int hashes)
+{
+    bloom->counters = calloc(size, sizeof(unsigned char));
+    if (bloom->counters == NULL)
+    {
+        printf("Error: out of memory.\n");
+        exit(-1);
+    }
+
+    bloom->size = size;
+    bloom->hashes = hashes;
+    bloom->count = 0;
+}
+
+/** \brief Adds a name to the filter.
+ *
+ * \param bloom Bloom* Filter.
+ * \param hash unsigned int Hash of the name.
+ *
+ */
+void bloomAdd(Bloom* bloom, unsigned int hash)
+{
+    int i;
+
+    for (i = 0; i < bloom->hashes; i++)
+    {
+        unsigned char* counter = &(bloom->counters[position(bloom, hash, i)]);
+
+        if (*counter < BLOOM_SATURATED)
+            (*counter)++;
+    }
+
+    bloom->count++;
+}
+
+/** \brief Removes a name from the filter. The name must have been added before.
+ *
+ * \param bloom Bloom* Filter.
+ * \param hash unsigned int Hash of the name.
+ *
+ */
+void bloomRemove(Bloom* bloom, unsigned int hash)
+{
+    int i;
+
+    for (i = 0; i < bloom->hashes; i++)
+    {
+        unsigned char* counter = &(bloom->counters[position(bloom, hash, i)]);
+
+        // A saturated counter lost track of how many names use it, so it stays set
+        if (*counter > 0 && *counter < BLOOM_SATURATED)
+            (*counter)--;
+    }
+
+    bloom->count--;
+}
+
+/** \brief Checks if a name may be in the filter.
+ *
+ * \param bloom Bloom* Filter.
+ * \param hash unsigned int Hash of the name.
+ * \return int 0 if the name is definitely not in the filter. 1 if it may be.
+ *
+ */
+int bloomMayContain(Bloom* bloom, unsigned int hash)
+{
+    int i;
+
+    for (i = 0; i < bloom->hashes; i++)
+    {
+        if (bloom->counters[position(bloom, hash, i)] == 0)
+            return 0;
+    }
+
+    return 1;
+}
+
+/** \brief Frees the counters of a filter.
+ *
+ * \param bloom Bloom* Filter to be freed. Must be initialized again before being used.
+ *
+ */
+void bloomFree(Bloom* bloom)
+{
+    free(bloom->counters);
+    bloom->counters = NULL;
+    bloom->size = 0;
+    bloom->count = 0;
+}
@@ -0,0 +1,29 @@
+#ifndef BLOOM_H_INCLUDED
+#define BLOOM_H_INCLUDED
+
+/** \brief Counting Bloom filter over name hashes.
+ *
+ * Answers "definitely not present" or "maybe present". Each position holds
+ * a counter instead of a bit, so names can be removed as well as added.
+ */
+typedef struct Bloom
+{
+    unsigned char* counters;
+
+    /** Number of counters. Always a power of 2. */
+    unsigned int size;
+
+    /** Number of counters touched by each name. */
+    int hashes;
+
+    /** Number of names currently in the filter. */
+    int count;
+} Bloom;
+
+void bloomInit(Bloom* bloom, unsigned int size, int hashes);
+void bloomAdd(Bloom* bloom, unsigned int hash);
+void bloomRemove(Bloom* bloom, unsigned int hash);
+int bloomMayContain(Bloom* bloom, unsigned int hash);
+void bloomFree(Bloom* bloom);
+
+#endif // BLOOM_H_INCLUDED
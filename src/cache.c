@@ -0,0 +1,378 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "contact.h"
+#include "names.h"
+#include "timers.h"
+#include "cache.h"
+
+/** Buckets of the hash table of each cache. Must be a power of 2. */
+#define CACHE_BUCKETS 512
+
+/** \brief A name and the address it maps to, until it expires.
+ */
+typedef struct CacheEntry
+{
+    /** Next entry in the same bucket. */
+    struct CacheEntry* next;
+
+    /** Neighbours in the recency list, most recently used first. */
+    struct CacheEntry* newer;
+    struct CacheEntry* older;
+
+    char key[NAME_LEN];
+    unsigned int hash;
+
+    /** Monotonic time after which the entry is not to be used, in milliseconds. */
+    long long expiresMs;
+
+    /** 1 if the name is known not to exist. addr is unused then. */
+    int negative;
+
+    struct sockaddr_in addr;
+
+    /** Other members of the family, for the DNS cache. QRYs may be hedged to them. */
+    struct sockaddr_in alternates[MAX_ALTERNATES];
+    int nAlternates;
+} CacheEntry;
+
+/** \brief A bounded map of names to addresses, with expiry and least recently used eviction.
+ */
+typedef struct Cache
+{
+    CacheEntry entries[CACHE_ENTRIES];
+    CacheEntry* buckets[CACHE_BUCKETS];
+
+    /** Entries never used, or dropped. */
+    CacheEntry* freeList;
+    int initialized;
+
+    /** Recency list. The oldest one is evicted when there is no room. */
+    CacheEntry* newest;
+    CacheEntry* oldest;
+
+    CacheStats* stats;
+} Cache;
+
+CacheStats dnsCacheStats;
+CacheStats peerCacheStats;
+
+/** Surname (from the '.') to the address of the DNS of that family. Zeroed, so in .bss, until initCaches(). */
+static Cache dnsCache;
+
+/** Full name of a stranger to its IP and talk port. */
+static Cache peerCache;
+
+/** \brief Puts every entry of a cache in its free list, and ties the cache to its counters.
+ */
+static void initCache(Cache* cache, CacheStats* stats)
+{
+    int i;
+
+    for (i = 0; i < CACHE_ENTRIES; i++)
+    {
+        cache->entries[i].next = cache->freeList;
+        cache->freeList = &(cache->entries[i]);
+    }
+
+    cache->stats = stats;
+    cache->initialized = 1;
+}
+
+/** \brief Sets both caches up, the first time either is used.
+ */
+static void initCaches()
+{
+    initCache(&dnsCache, &dnsCacheStats);
+    initCache(&peerCache, &peerCacheStats);
+}
+
+/** \brief Takes an entry out of the recency list.
+ */
+static void unlinkRecent(Cache* cache, CacheEntry* e)
+{
+    if (e->newer != NULL)
+        e->newer->older = e->older;
+    else
+        cache->newest = e->older;
+
+    if (e->older != NULL)
+        e->older->newer = e->newer;
+    else
+        cache->oldest = e->newer;
+
+    e->newer = NULL;
+    e->older = NULL;
+}
+
+/** \brief Puts an entry at the front of the recency list.
+ */
+static void linkNewest(Cache* cache, CacheEntry* e)
+{
+    e->newer = NULL;
+    e->older = cache->newest;
+
+    if (cache->newest != NULL)
+        cache->newest->newer = e;
+    else
+        cache->oldest = e;
+
+    cache->newest = e;
+}
+
+/** \brief Drops an entry from its bucket and the recency list, and gives it back to the free list.
+ */
+static void dropEntry(Cache* cache, CacheEntry* e)
+{
+    CacheEntry** link = &(cache->buckets[e->hash & (CACHE_BUCKETS - 1)]);
+
+    while (*link != e)
+        link = &((*link)->next);
+    *link = e->next;
+
+    unlinkRecent(cache, e);
+
+    e->next = cache->freeList;
+    cache->freeList = e;
+}
+
+/** \brief Finds the entry of a name, dropping it if it has expired.
+ */
+static CacheEntry* findEntry(Cache* cache, const char* key, unsigned int hash)
+{
+    CacheEntry* e;
+
+    for (e = cache->buckets[hash & (CACHE_BUCKETS - 1)]; e != NULL; e = e->next)
+    {
+        if (e->hash != hash || strcmp(e->key, key) != 0)
+            continue;
+
+        if (e->expiresMs <= nowMs())
+        {
+            cache->stats->expired++;
+            dropEntry(cache, e);
+            return NULL;
+        }
+
+        return e;
+    }
+
+    return NULL;
+}
+
+/** \brief Looks a name up, and marks it as the most recently used.
+ *
+ * \param out_entry CacheEntry** Where the entry is written, on a hit. May be NULL.
+ *
+ */
+static CacheResult lookup(Cache* cache, const char* key, struct sockaddr_in* out_addr, CacheEntry** out_entry)
+{
+    if (!cache->initialized)
+        initCaches();
+
+    CacheEntry* e = findEntry(cache, key, hashName(key));
+
+    if (e == NULL)
+    {
+        cache->stats->misses++;
+        return CacheMiss;
+    }
+
+    unlinkRecent(cache, e);
+    linkNewest(cache, e);
+
+    if (e->negative)
+    {
+        cache->stats->negativeHits++;
+        return CacheNegative;
+    }
+
+    cache->stats->hits++;
+    *out_addr = e->addr;
+    if (out_entry != NULL)
+        *out_entry = e;
+    return CacheHit;
+}
+
+/** \brief Adds or replaces the entry of a name. Evicts the least recently used entry if there is no room.
+ *
+ * \param addr struct sockaddr_in* Address of the name, or NULL if the name is known not to exist.
+ *
+ */
+static void store(Cache* cache, const char* key, struct sockaddr_in* addr, int ttlMs)
+{
+    unsigned int hash = hashName(key);
+    CacheEntry* e;
+
+    if (strlen(key) >= NAME_LEN)
+        return;
+
+    if (!cache->initialized)
+        initCaches();
+
+    e = findEntry(cache, key, hash);
+    if (e != NULL)
+    {
+        unlinkRecent(cache, e);
+    }
+    else
+    {
+        if (cache->freeList == NULL)
+        {
+            cache->stats->evicted++;
+            dropEntry(cache, cache->oldest);
+        }
+
+        e = cache->freeList;
+        cache->freeList = e->next;
+
+        strcpy(e->key, key);
+        e->hash = hash;
+        e->nAlternates = 0;
+        e->next = cache->buckets[hash & (CACHE_BUCKETS - 1)];
+        cache->buckets[hash & (CACHE_BUCKETS - 1)] = e;
+    }
+
+    e->negative = (addr == NULL);
+    if (addr != NULL)
+        e->addr = *addr;
+    e->expiresMs = nowMs() + ttlMs;
+
+    linkNewest(cache, e);
+}
+
+/** \brief Drops the entry of a name, if there is one, because it proved wrong.
+ */
+static void invalidate(Cache* cache, const char* key)
+{
+    CacheEntry* e = findEntry(cache, key, hashName(key));
+
+    if (e == NULL)
+        return;
+
+    cache->stats->invalidated++;
+    dropEntry(cache, e);
+}
+
+/** \brief Gets the DNS of a family from the cache, sparing a round trip to the SS, and the other members known.
+ *
+ * \param surname const char* Surname, starting at the '.'.
+ * \param out_addrs struct sockaddr_in* Where the address of the DNS is written, followed by those of the other members.
+ * \param max int Room in out_addrs. At least 1.
+ * \return int Number of addresses written. 0 on a miss.
+ *
+ */
+int cachedDns(const char* surname, struct sockaddr_in* out_addrs, int max)
+{
+    CacheEntry* e;
+    int i, n = 1;
+
+    if (lookup(&dnsCache, surname, &(out_addrs[0]), &e) != CacheHit)
+        return 0;
+
+    for (i = 0; i < e->nAlternates && n < max; i++)
+        out_addrs[n++] = e->alternates[i];
+
+    return n;
+}
+
+/** \brief Remembers the DNS of a family, as the SS said in a FW.
+ *
+ * \param surname const char* Surname, starting at the '.'.
+ * \param addr struct sockaddr_in* Address of its DNS.
+ *
+ */
+void cacheDns(const char* surname, struct sockaddr_in* addr)
+{
+    store(&dnsCache, surname, addr, DNS_TTL_MS);
+}
+
+/** \brief Remembers other members of a family, as a member listed them in a RPL.
+ *
+ * Does nothing if the DNS of the family is not cached. The DNS itself is not kept twice.
+ *
+ * \param surname const char* Surname, starting at the '.'.
+ * \param addrs struct sockaddr_in* Their DNS addresses.
+ * \param n int Number of addresses.
+ *
+ */
+void cacheAlternates(const char* surname, struct sockaddr_in* addrs, int n)
+{
+    CacheEntry* e = findEntry(&dnsCache, surname, hashName(surname));
+    int i;
+
+    if (e == NULL)
+        return;
+
+    e->nAlternates = 0;
+    for (i = 0; i < n && e->nAlternates < MAX_ALTERNATES; i++)
+    {
+        if (addrs[i].sin_addr.s_addr == e->addr.sin_addr.s_addr && addrs[i].sin_port == e->addr.sin_port)
+            continue;
+
+        e->alternates[e->nAlternates++] = addrs[i];
+    }
+}
+
+/** \brief Forgets the DNS of a family, after it failed to answer.
+ *
+ * \param surname const char* Surname, starting at the '.'.
+ *
+ */
+void uncacheDns(const char* surname)
+{
+    invalidate(&dnsCache, surname);
+}
+
+/** \brief Gets the address of a stranger from the cache, sparing both round trips of a find.
+ *
+ * \param name const char* Full name of the stranger.
+ * \param out_addr struct sockaddr_in* Where the IP and talk port are written, on a hit.
+ * \return CacheResult CacheHit, CacheMiss, or CacheNegative if the stranger was not found recently.
+ *
+ */
+CacheResult cachedPeer(const char* name, struct sockaddr_in* out_addr)
+{
+    return lookup(&peerCache, name, out_addr, NULL);
+}
+
+/** \brief Remembers the address of a stranger, as its DNS said in a RPL.
+ *
+ * \param name const char* Full name of the stranger.
+ * \param addr struct sockaddr_in* Its IP and talk port, or NULL if its DNS did not know it.
+ *
+ */
+void cachePeer(const char* name, struct sockaddr_in* addr)
+{
+    store(&peerCache, name, addr, (addr != NULL ? PEER_TTL_MS : PEER_NEGATIVE_TTL_MS));
+}
+
+/** \brief Forgets the address of a stranger, after a call to it failed.
+ *
+ * \param name const char* Full name of the stranger.
+ *
+ */
+void uncachePeer(const char* name)
+{
+    invalidate(&peerCache, name);
+}
+
+/** \brief Prints the counters of one cache.
+ */
+static void printCache(const char* title, CacheStats* s)
+{
+    long lookups = s->hits + s->negativeHits + s->misses;
+
+    printf("%-14s%ld hits, %ld negative hits, %ld misses (%.2f%% hit rate); %ld expired, %ld evicted, %ld invalidated\n",
+           title, s->hits, s->negativeHits, s->misses,
+           (lookups > 0 ? 100.0 * (s->hits + s->negativeHits) / lookups : 0.0),
+           s->expired, s->evicted, s->invalidated);
+}
+
+/** \brief Prints the counters of the caches of finds.
+ */
+void printCacheStats()
+{
+    printCache("DNS cache:", &dnsCacheStats);
+    printCache("Peer cache:", &peerCacheStats);
+}
@@ -0,0 +1,59 @@
+#ifndef CACHE_H_INCLUDED
+#define CACHE_H_INCLUDED
+
+#include <arpa/inet.h>
+
+#include "globals.h"
+
+/** How long the DNS of another surname is trusted, in milliseconds. */
+#define DNS_TTL_MS 60000
+
+/** How long the address of a stranger is trusted, in milliseconds. */
+#define PEER_TTL_MS 30000
+
+/** How long a stranger a DNS said does not exist is believed not to, in milliseconds. */
+#define PEER_NEGATIVE_TTL_MS 5000
+
+/** Most entries in each cache. The least recently used one makes room for a new one. */
+#define CACHE_ENTRIES 256
+
+/** \brief Result of a look up in a cache.
+ */
+typedef enum
+{
+    CacheMiss,
+    CacheHit,
+
+    /** The name is known not to exist. */
+    CacheNegative
+} CacheResult;
+
+/** \brief Counters of a cache.
+ */
+typedef struct CacheStats
+{
+    long hits;
+    long negativeHits;
+    long misses;
+
+    /** Entries dropped because they were too old, to make room, or because they proved wrong. */
+    long expired;
+    long evicted;
+    long invalidated;
+} CacheStats;
+
+extern CacheStats dnsCacheStats;
+extern CacheStats peerCacheStats;
+
+int cachedDns(const char* surname, struct sockaddr_in* out_addrs, int max);
+void cacheDns(const char* surname, struct sockaddr_in* addr);
+void cacheAlternates(const char* surname, struct sockaddr_in* addrs, int n);
+void uncacheDns(const char* surname);
+
+CacheResult cachedPeer(const char* name, struct sockaddr_in* out_addr);
+void cachePeer(const char* name, struct sockaddr_in* addr);
+void uncachePeer(const char* name);
+
+void printCacheStats();
+
+#endif // CACHE_H_INCLUDED
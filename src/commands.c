@@ -13,6 +13,16 @@ extern int errno;
 #include "server.h"
 #include "debug.h"
 #include "list.h"
+#include "bench.h"
+#include "workers.h"
+#include "reactor.h"
+#include "reliable.h"
+#include "finds.h"
+#include "cache.h"
+#include "gossip.h"
+#include "handover.h"
+#include "standby.h"
+#include "liveness.h"
 
 /** \brief Parses a command from the keyboard (STDIN) and handles it.
  *
@@ -39,8 +49,14 @@ void parseCommand(char* line, int* isRunning)
     }
     else if (strcmp(command, "find") == 0)
     {
-        sscanf(line, "%*s %s", argument);
-        find(argument, FindForFind);
+        // Any number of names. The finds of strangers all run at the same time
+        strtok(line, " \t\r\n");
+        char* name = strtok(NULL, " \t\r\n");
+        if (name == NULL)
+            printf("Find who?\n");
+
+        for (; name != NULL; name = strtok(NULL, " \t\r\n"))
+            find(name, FindForFind);
     }
     else if (strcmp(command, "connect") == 0)
     {
@@ -67,6 +83,10 @@ void parseCommand(char* line, int* isRunning)
     {
         leave();
     }
+    else if (strcmp(command, "sync") == 0)
+    {
+        syncRoster();
+    }
     else if (strcmp(command, "exit") == 0)
     {
         // Simulate leave command before actually exiting
@@ -97,6 +117,49 @@ void parseCommand(char* line, int* isRunning)
     {
         printState();
     }
+    else if (strcmp(command, "batch") == 0)
+    {
+        sscanf(line, "%*s %d", &batchSize);
+        printf("Up to %d datagrams will be handled per wakeup.\n", batchSize);
+    }
+    else if (strcmp(command, "hedge") == 0)
+    {
+        char arg[16] = "";
+        sscanf(line, "%*s %15s", arg);
+
+        if (strcmp(arg, "off") == 0)
+            hedgeDelayMs = -1;
+        else if (strcmp(arg, "all") == 0)
+            hedgeDelayMs = 0;
+        else if (sscanf(arg, "%d", &hedgeDelayMs) != 1 || hedgeDelayMs < 0)
+            hedgeDelayMs = -1;
+
+        if (hedgeDelayMs < 0)
+            printf("QRYs of finds go to the DNS of the family only.\n");
+        else if (hedgeDelayMs == 0)
+            printf("QRYs of finds go to up to %d members of the family at once.\n", MAX_ALTERNATES + 1);
+        else
+            printf("QRYs of finds go to one more member of the family every %d ms.\n", hedgeDelayMs);
+    }
+    else if (strcmp(command, "gossip") == 0)
+    {
+        int fanout;
+        if (sscanf(line, "%*s %d", &fanout) == 1 && fanout >= 0 && fanout <= GOSSIP_MAX_FANOUT)
+            gossipFanout = fanout;
+
+        if (gossipFanout == 0)
+            printf("Joins and leaves are told to every member of the family.\n");
+        else
+            printf("Joins and leaves are told to the DNS and %d members, and gossiped to the rest.\n", gossipFanout);
+    }
+    else if (strcmp(command, "stats") == 0)
+    {
+        printStats();
+    }
+    else if (strcmp(command, "bench") == 0)
+    {
+        benchmark(line);
+    }
     else
     {
         printf("Unrecognized command. Type 'help' for a list of valid commands.\n");
@@ -114,7 +177,7 @@ void join()
     if (joinStatus != NotJoined)
     {
         printf("Cannot join again, already joined. DNS is %s.\n",
-               (nameServer != NULL) ? nameServer->name : "being contacted");
+               (nameServer != NULL) ? contactName(nameServer) : "being contacted");
         return;
     }
 
@@ -140,6 +203,14 @@ void join()
     dnsAddr.sin_addr.s_addr = htonl(INADDR_ANY);
     dnsAddr.sin_port = htons(myDnsPort);
 
+    // Query workers bind their own sockets to the same port
+    if (queryWorkers > 0)
+    {
+        int one = 1;
+        if (setsockopt(dnsSocket, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) == -1)
+            perror("Could not share DNS socket with query workers");
+    }
+
     n = bind(dnsSocket, (struct sockaddr*)&dnsAddr, sizeof(dnsAddr));
     if (n == -1)
     {
@@ -149,6 +220,13 @@ void join()
         return;
     }
 
+    // io_uring receives the datagrams itself, into its own buffers. With epoll, dnsReadable() receives them.
+    if (reactorAddDatagrams(reactor, dnsSocket, dnsDatagram, dnsBatchEnd, NULL) == -1)
+        reactorAdd(reactor, dnsSocket, REACTOR_EDGE, dnsReadable, NULL);
+
+    if (queryWorkers > 0 && startWorkers(queryWorkers) == 0)
+        printf("Query workers not started. QRYs will be answered by the main thread.\n");
+
     // Prepare registration message and send it
     char buffer[128];
     n = getRegMessage((char*) buffer);
@@ -163,7 +241,11 @@ void join()
     // Debug and logging
     logm(1, "%s", buffer);
 
+    // Our REGs to the family tell this join from any earlier one of ours
+    myIncarnation = newIncarnation();
+
     joinStatus = WaitForDNS;
+    timerStart(&joinTimer, JOIN_TIMEOUT_MS);
     return;
 
 
@@ -192,10 +274,14 @@ int getRegMessage(char* buffer)
 /** \brief Starts a 'find' sequence.
  *
  * Only works if the used is fully Joined.
- * Changes the global variable findMode to the parameter 'mode'.
  * If 'mode' is FindForFind, the user's address will be printed to screen.
  * If 'mode' is FindForConnect, a chat call will be established once the target address is known.
  *
+ * Family members are answered right away, from the local database, and so are strangers found recently.
+ * Other strangers get an entry in the table of finds, so any number of them can be looked for at the same time.
+ * A stranger with the same surname as one already being looked for waits for the same FW,
+ * and the SS is not asked at all if the DNS of the surname is cached.
+ *
  * \param name char* Name of the target.
  * \param mode FindMode FindForFind or FindForConnect
  * \return void
@@ -203,8 +289,6 @@ int getRegMessage(char* buffer)
  */
 void find(char* name, FindMode mode)
 {
-    int ret;
-    char buffer[128];
     char targetName[128];
 
     if (joinStatus != Joined)
@@ -213,16 +297,7 @@ void find(char* name, FindMode mode)
         return;
     }
 
-    if (findStatus != NotFinding)
-    {
-        printf("Already trying to find %s. Try again later.\n", nameToFind);
-        return;
-    }
-
-    // Set the global variable so server.c can access it later
-    findMode = mode;
-
-    if (talkSocket != -1 && findMode == FindForConnect)
+    if (talkSocket != -1 && mode == FindForConnect)
     {
         printf("Already connected to someone. Only one chat session supported.\n");
         return;
@@ -232,10 +307,10 @@ void find(char* name, FindMode mode)
     int targetIsFamily = 0;
 
     // Prepare QRY message, with our surname by default if none is written
-    if (strstr(name, ".") != NULL)
+    char* targetSurname = strstr(name, ".");
+    if (targetSurname != NULL)
     {
-        sprintf(targetName, "%s", name);
-        char* targetSurname = strstr(name, ".");
+        snprintf(targetName, sizeof(targetName), "%s", name);
         char* mySurname = strstr(myName, ".");
 
         if (strcmp(targetSurname, mySurname) == 0)
@@ -243,7 +318,7 @@ void find(char* name, FindMode mode)
     }
     else
     {
-        sprintf(targetName, "%s%s", name, strstr(myName, "."));
+        snprintf(targetName, sizeof(targetName), "%s%s", name, strstr(myName, "."));
         targetIsFamily = 1;
     }
 
@@ -251,19 +326,44 @@ void find(char* name, FindMode mode)
     {
         // Target is a stranger. Gotta ask the SS
 
-        sprintf(buffer, "QRY %s", targetName);
+        if (getFind(targetName) != NULL)
+        {
+            printf("Already trying to find %s.\n", targetName);
+            return;
+        }
 
-        // Debug and logging
-        logm(1, "%s", buffer);
+        // A recent answer spares both round trips
+        struct sockaddr_in peerAddr;
+        CacheResult known = cachedPeer(targetName, &peerAddr);
 
-        ret = sendto(dnsSocket, buffer, strlen(buffer), 0, (struct sockaddr*) &saAddr, sizeof(saAddr));
-        if (ret == -1)
+        if (known == CacheNegative)
+        {
+            printf("User %s not found.\n", targetName);
+            return;
+        }
+        else if (known == CacheHit)
         {
-            perror("Could not send QRY to SS");
-            exit(-1);
+            if (mode == FindForConnect)
+                startChatCall(targetName, peerAddr);
+            else
+                printf("User %s is at %s:%d.\n", targetName, inet_ntoa(peerAddr.sin_addr), ntohs(peerAddr.sin_port));
+            return;
+        }
+
+        Find* f = startFind(targetName, mode);
+        if (f == NULL)
+        {
+            printf("Too many finds in progress (%d). Try %s again later.\n", MAX_FINDS, targetName);
+            return;
         }
 
-        findStatus = WaitForFW;
+        // A recent FW for the surname spares the SS
+        struct sockaddr_in dnsAddrs[MAX_ALTERNATES + 1];
+        int n = cachedDns(targetSurname, dnsAddrs, MAX_ALTERNATES + 1);
+        if (n > 0)
+            askDns(f, dnsAddrs, n, 1);
+        else
+            askSurnameServer(f);
     }
     else
     {
@@ -277,7 +377,7 @@ void find(char* name, FindMode mode)
         }
 
         // Connect to user directly
-        if (findMode == FindForConnect)
+        if (mode == FindForConnect)
         {
             struct sockaddr_in peerAddr;
             memset((void*) &peerAddr, (int) '\0', sizeof(peerAddr));
@@ -290,11 +390,9 @@ void find(char* name, FindMode mode)
         // Print found information
         else
         {
-            printf("User %s is at %s:%d.\n", c->name, inet_ntoa(c->ip), c->talkPort);
+            printf("User %s is at %s:%d.\n", contactName(c), inet_ntoa(c->ip), c->talkPort);
         }
 
-        findStatus = NotFinding;
-
         // Deprecated code. Sent a QRY to the family's DNS, which is unneeded and wasteful, but worked.
 //        // Ensures we know who the DNS is, even after a leave
 //        getNameServer();
@@ -320,9 +418,69 @@ void find(char* name, FindMode mode)
 //
 //        findStatus = WaitForRPL;
     }
+}
 
+/** \brief Sends the SYN once the SS has said who the DNS is.
+ *
+ * \param dns Contact* The DNS, or NULL if it could not be found.
+ *
+ */
+static void resumeSync(Contact* dns)
+{
+    if (dns == NULL)
+    {
+        printf("DNS not known. Cannot sync.\n");
+        return;
+    }
 
-    strcpy(nameToFind, targetName);
+    syncRoster();
+}
+
+/** \brief Asks the DNS for the changes to the roster since our last sync.
+ *
+ * Sends 'SYN epoch;version' to the DNS. The DNS replies with only the changes since then,
+ * or with the whole roster if it does not remember them (or if we never synced).
+ * Useful after missing some REGs or UNRs, without having to leave and join again.
+ *
+ */
+void syncRoster()
+{
+    int ret;
+    char buffer[64];
+
+    if (joinStatus != Joined)
+    {
+        printf("Not joined yet!\n");
+        return;
+    }
+
+    // Confirm who is the DNS right now. The SYN is sent when the SS answers
+    if (getNameServer() == NULL)
+    {
+        lookupNameServer(resumeSync);
+        return;
+    }
+
+    if (isServer())
+    {
+        printf("We are the DNS. Our roster is always up to date.\n");
+        return;
+    }
+
+    sprintf(buffer, "SYN %u;%u", syncEpoch, syncVersion);
+
+    // Debug and logging
+    logm(1, "%s\n", buffer);
+
+    setDnsAddr(nameServer);
+    ret = sendto(dnsSocket, buffer, strlen(buffer), 0, (struct sockaddr*) &(nameServer->dnsAddr), sizeof(nameServer->dnsAddr));
+    if (ret == -1)
+    {
+        perror("Could not send SYN to DNS");
+        return;
+    }
+
+    syncing = 1;
 }
 
 /** \brief Sends a message through the chat call.
@@ -348,7 +506,7 @@ void sendMessage(char* message)
     // Ensure 'len' bytes are sent
     while (sentbytes < len)
     {
-        sentbytes = send(talkSocket, buffer, len - sentbytes, 0);
+        sentbytes = reactorSend(reactor, talkSocket, buffer, len - sentbytes);
 
         if (sentbytes == -1)
         {
@@ -379,7 +537,7 @@ void sendRawMessage(char* message)
     // Ensure 'len' bytes are sent
     while (sentbytes < len)
     {
-        sentbytes = send(talkSocket, message, len - sentbytes, 0);
+        sentbytes = reactorSend(reactor, talkSocket, message, len - sentbytes);
 
         if (sentbytes == -1)
         {
@@ -407,6 +565,7 @@ void disconnect()
 
     int ret;
 
+    reactorRemove(reactor, talkSocket);
     ret = close(talkSocket);
     if (ret == -1)
     {
@@ -417,6 +576,146 @@ void disconnect()
     talkSocket = -1;
 }
 
+/** \brief Sends UNR to members of the family, with as few system calls as possible, and expects their OKs.
+ *
+ * \param members Contact** The members.
+ * \param n int Number of members, FANOUT_BATCH at most.
+ * \param buffer const char* The UNR message.
+ *
+ */
+static void unregisterFrom(Contact** members, int n, const char* buffer)
+{
+    struct sockaddr_in addrs[FANOUT_BATCH];
+    int sent[FANOUT_BATCH];
+    int i;
+
+    for (i = 0; i < n; i++)
+    {
+        setDnsAddr(members[i]);
+        addrs[i] = members[i]->dnsAddr;
+    }
+
+    // Debug and logging
+    logm(1, "%s", buffer);
+
+    sendReliableMany(buffer, addrs, n, sent);
+
+    for (i = 0; i < n; i++)
+    {
+        if (!sent[i])
+        {
+            printf("Could not send UNR to contact %s.\n", contactName(members[i]));
+            continue;
+        }
+
+        logm(1, "Sent UNR to %s.\n", contactName(members[i]));
+
+        // Only expect OKs in the same number as UNRs sent.
+        members[i]->okExpected = 1;
+        oksExpected++;
+    }
+}
+
+/** \brief Sends UNR to the DNS, and then to every other family member. Puts the program in the LeavingUsers state.
+ *
+ * With gossip on, the UNR goes to the DNS and gossipFanout other members only, and they spread the leave.
+ */
+static void leaveFamily()
+{
+    int ret;
+    char buffer[NAME_LEN + 24];
+
+    // The member that takes over as DNS, if we are the DNS, tells the others itself, once it did
+    sprintf(buffer, "UNR %s\nINC %u\n", myName, myIncarnation);
+
+    struct sockaddr_in sendAddr;
+    memset((void*)&sendAddr, (int)'\0', sizeof(sendAddr));
+
+    // Debug and logging
+    logm(1, "%s\n", buffer);
+
+    // If we are not the DNS, unregister ourselves from the DNS
+    // If it is still not known, it gets its UNR along with everyone else
+    if (nameServer != NULL && !isServer())
+    {
+        sendAddr.sin_family = AF_INET;
+        sendAddr.sin_addr = nameServer->ip;
+        sendAddr.sin_port = htons(nameServer->dnsPort);
+
+        setDnsAddr(nameServer);
+
+        ret = sendReliable(buffer, &sendAddr);
+        if (ret == -1)
+        {
+            perror("Could not send UNR to DNS");
+            return;
+        }
+
+        nameServer->okExpected = 1;
+        oksExpected++;
+    }
+
+    joinStatus = LeavingUsers;
+    timerStart(&leaveTimer, LEAVE_TIMEOUT_MS);
+
+    // As the DNS, offer it to other members while the UNRs go out
+    if (isServer())
+        startHandover();
+
+    if (gossipFanout > 0)
+    {
+        Contact* picked[GOSSIP_MAX_FANOUT];
+        int n = pickMembers(picked, (gossipFanout < GOSSIP_MAX_FANOUT ? gossipFanout : GOSSIP_MAX_FANOUT), 0);
+
+        unregisterFrom(picked, n, buffer);
+        return;
+    }
+
+    Node* p;
+    Contact* members[FANOUT_BATCH];
+    int n = 0;
+
+    for (p = contacts->next; p != NULL; p = p->next)
+    {
+        // Don't send UNR to ourselves or the DNS
+        if (contactNameIs(p->c, myName) || p->c == nameServer)
+            continue;
+
+        members[n++] = p->c;
+        if (n == FANOUT_BATCH)
+        {
+            unregisterFrom(members, n, buffer);
+            n = 0;
+        }
+    }
+
+    if (n > 0)
+        unregisterFrom(members, n, buffer);
+}
+
+/** \brief Carries on with a leave once the SS has said who the DNS is.
+ *
+ * \param dns Contact* The DNS, or NULL if it could not be found.
+ *
+ */
+static void resumeLeave(Contact* dns)
+{
+    if (joinStatus != Joined)
+        return;
+
+    // Everyone else left while we waited. We are the last one, and the SS must be told
+    if (hasOneElement(contacts))
+    {
+        leave();
+        return;
+    }
+
+    if (dns == NULL)
+        logm(1, "DNS still not known. Sending UNR to every member, the DNS among them.\n");
+
+    leaveFamily();
+}
+
 /** \brief Disconnects the user. Starts the 'leave' sequence.
  *
  * Puts the program in the LeavingDNS or LeavingUsers states.
@@ -426,6 +725,7 @@ void disconnect()
  *     Sends UNR to SS.
  *
  * Else
+ *     If the DNS is not known, asks the SS first, and carries on when it answers.
  *     If we are not the DNS:
  *         Sends UNR to DNS, and then to every other member.
  *     If we are the DNS:
@@ -464,76 +764,18 @@ void leave()
         oksExpected++;
 
         joinStatus = LeavingDNS;
+        timerStart(&leaveTimer, LEAVE_TIMEOUT_MS);
     }
     else
     {
-        // We must contact the DNS, and then every single family member
-
-        struct sockaddr_in sendAddr;
-        memset((void*)&sendAddr, (int)'\0', sizeof(sendAddr));
-
-        // Confirm who is the DNS right now
-        getNameServer();
-
-        sendAddr.sin_family = AF_INET;
-        sendAddr.sin_addr = nameServer->ip;
-        sendAddr.sin_port = htons(nameServer->dnsPort);
-
-        // Debug and logging
-        logm(1, "%s\n", buffer);
-
-        // If we are not the DNS, unregister ourselves from the DNS
-        if (!isServer())
+        // Confirm who is the DNS right now. The leave carries on when the SS answers
+        if (getNameServer() == NULL)
         {
-            setDnsAddr(nameServer);
-
-            ret = sendto(dnsSocket, buffer, strlen(buffer), 0, (struct sockaddr*) &sendAddr, sizeof(sendAddr));
-            if (ret == -1)
-            {
-                perror("Could not send UNR to SS");
-                return;
-            }
-
-            nameServer->okExpected = 1;
-            oksExpected++;
+            lookupNameServer(resumeLeave);
+            return;
         }
 
-        joinStatus = LeavingUsers;
-
-        Node* p = contacts->next;
-        int i;
-        Contact* contact;
-
-        for (i = 0; p != NULL; i++, p = p->next)
-        {
-            contact = p->c;
-
-            // Don't send UNR to ourselves or the DNS
-            if (strcmp(contact->name, myName) == 0 || strcmp(contact->name, nameServer->name) == 0)
-                continue;
-
-            sendAddr.sin_family = AF_INET;
-            sendAddr.sin_addr = contact->ip;
-            sendAddr.sin_port = htons(contact->dnsPort);
-
-            setDnsAddr(contact);
-
-            // Debug and logging
-            logm(1, "%s", buffer);
-
-            ret = sendto(dnsSocket, buffer, strlen(buffer), 0, (struct sockaddr*) &sendAddr, sizeof(sendAddr));
-            if (ret == -1)
-            {
-                printf("Could not send UNR to contact %s (%d):", contact->name, i); perror("");
-                continue;
-            }
-
-            logm(1, "Sent UNR to %s (%d).\n", contact->name, i);
-
-            // Only expect OKs in the same number as UNRs sent.
-            contact->okExpected = 1;
-            oksExpected++;
-        }
+        leaveFamily();
     }
 }
 
@@ -546,7 +788,7 @@ void leave()
  */
 int isServer()
 {
-    return (nameServer != NULL && strcmp(nameServer->name, myName) == 0);
+    return (nameServer != NULL && contactNameIs(nameServer, myName));
 }
 
 /** \brief Prints a list of commands to the user.
@@ -558,7 +800,8 @@ void help()
 Command list:\n\
               join                    register at the Surname Server\n\
               leave                   unregister from the Surname Server\n\
-              find name.surname       find a user's IP and port\n\
+              sync                    get the roster changes we missed from the DNS\n\
+              find name.surname ...   find the IP and port of one or more users\n\
               connect name.surname    initiate a call\n\
               disconnect              terminate a call\n\
               message string          send message through call\n\
@@ -568,13 +811,28 @@ Command list:\n\
               m string                same as message  \n\
               verbose level           0=normal, 1=more info\n\
               list                    print local database of contacts\n\
-              rickroll                try it during a call... :)\n");
+              rickroll                try it during a call... :)\n\
+              stats                   print memory and performance counters\n\
+              batch n                 handle up to n datagrams per wakeup (1=off)\n\
+              hedge off|all|ms        also send QRYs of finds to other members of the family\n\
+              gossip n                tell n members of joins and leaves, and let them gossip (0=off)\n\
+              bench join [n]          time OK matching for an n-member join\n\
+              bench memory [n]        bytes per contact in an n-member family\n\
+              bench query [n]         time QRYs for unknown names\n\
+              bench qps [n]           QRYs per second, batching off and on\n\
+              bench io [n]            QRYs per second, epoll and io_uring\n\
+              bench parse [n]         parse cost per message type\n\
+              bench rcu [n]           QRY tail latency under REG/UNR churn\n\
+              bench fanout [n]        join wall time to the last OK, sendto and sendmmsg\n\
+              bench gossip [n]        simulated join cost and convergence, with gossip\n");
 }
 
 /** \brief Prints the global state variables to the screen. For debug purposes.
  */
 void printState()
 {
+    int i;
+
     printf("Join status: ");
     switch (joinStatus)
     {
@@ -586,24 +844,62 @@ void printState()
         case LeavingDNS: printf("LeavingDNS"); break;
         case LeavingUsers: printf("LeavingUsers"); break;
         case SearchingNewDns: printf("SearchingNewDns"); break;
+        case UpdatingSS: printf("UpdatingSS"); break;
         case LeavingForGood: printf("LeavingForGood"); break;
     }
     printf("\n");
 
-    printf("Find status: ");
-    switch (findStatus)
+    printf("Finds in progress: %d\n", nFinds);
+    for (i = 0; i < MAX_FINDS; i++)
     {
-        case NotFinding: printf("NotFinding"); break;
-        case WaitForFW: printf("WaitForFW"); break;
-        case WaitForRPL: printf("WaitForRPL"); break;
+        Find* f = findAt(i);
+        if (f == NULL)
+            continue;
+
+        printf("  %s: %s\n", f->name, (f->status == WaitForFW ? "WaitForFW" : "WaitForRPL"));
     }
-    printf("\n");
 
     printf("OKs expected (may be invalid): %d\n", oksExpected);
 
     printf("Connect status: %s\n", (talkSocket == -1 ? "Disconnected" : "Connected"));
 }
 
+/** \brief Prints memory and performance counters to the screen. For debug purposes.
+ */
+void printStats()
+{
+    printf("Contact pool: %d live, %d high-water, %d slabs of %d x %d bytes\n",
+           contactPool.live, contactPool.highWater, contactPool.nSlabs, contactPool.perSlab, (int) contactPool.objSize);
+    printf("Node pool:    %d live, %d high-water, %d slabs of %d x %d bytes\n",
+           nodePool.live, nodePool.highWater, nodePool.nSlabs, nodePool.perSlab, (int) nodePool.objSize);
+    printf("Names:        %d interned strings, %d bytes\n", internedStrings, (int) internedBytes);
+
+    // Query workers update the counters concurrently
+    long queries = __atomic_load_n(&(contacts->queries), __ATOMIC_RELAXED);
+    long filtered = __atomic_load_n(&(contacts->filtered), __ATOMIC_RELAXED);
+    long falsePositives = __atomic_load_n(&(contacts->falsePositives), __ATOMIC_RELAXED);
+
+    // False positive rate: unknown names let through by the filter, out of all unknown names queried
+    long misses = filtered + falsePositives;
+    printf("QRY filter:   %ld queries, %ld answered by the filter, %ld false positives (%.2f%%), %u counters\n",
+           queries, filtered, falsePositives,
+           (misses > 0) ? 100.0 * falsePositives / misses : 0.0, contacts->filter.size);
+
+    printf("DNS socket:   %ld datagrams in %ld wakeups (%.2f per wakeup), %ld replies in %ld sends, batch size %d\n",
+           batchStats.datagrams, batchStats.wakeups,
+           (batchStats.wakeups > 0) ? (double) batchStats.datagrams / batchStats.wakeups : 0.0,
+           batchStats.replies, batchStats.sendCalls, batchSize);
+
+    printReliableStats();
+    printCacheStats();
+    printFindStats();
+    printGossipStats();
+    printHandoverStats();
+    printStandbyStats();
+    printLivenessStats();
+    printWorkerStats();
+}
+
 /** \brief Rickrolls the chat peer.
  *
  * Automatically sends the chorus of Rick Astley's 'Never Gonna Give You Up'
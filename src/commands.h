@@ -6,6 +6,7 @@ void parseCommand(char* command, int* isRunning);
 void join();
 void registerAtDns(Contact* gns);
 void leave();
+void syncRoster();
 
 void find(char* name, FindMode mode);
 
@@ -15,6 +16,7 @@ void disconnect();
 
 void help();
 void printState();
+void printStats();
 
 int getRegMessage(char* buffer);
 int isServer();
@@ -5,27 +5,48 @@
 
 #define NAME_LEN 128
 
+/** Length of 'RPL ', which starts every wire line but is not part of the LST line. */
+#define WIRE_LST_OFFSET 4
+
 /** \brief Information about a Contact. Contains its name, IP and ports.
+ *
+ * Only the fields used on every packet are stored here, so that contacts are small
+ * and many fit in a cache line. The name is kept in the interned string pool (see names.h).
  */
 typedef struct Contact
 {
-    /** Full name of the contact, in the format 'name.surname'. */
-	char name[NAME_LEN];
+    /** Socket address of the DNS server of the contact. */
+	struct sockaddr_in dnsAddr;
 
     /** IP address of the contact, in network endianess. */
 	struct in_addr ip;
 
     /** TCP talk server port of the contact, in host endianess. */
-	int talkPort;
+	unsigned short talkPort;
 
     /** UDP DNS server port of the contact, in host endianess. */
-	int dnsPort;
-
-    /** Socket address of the DNS server of the contact. */
-	struct sockaddr_in dnsAddr;
+	unsigned short dnsPort;
 
     /** Boolean. 1 if we are expecting to receive an OK from this contact. 0 otherwise. */
-	int okExpected;
+	unsigned char okExpected;
+
+    /** Boolean. Set during a full roster sync on the contacts the DNS still has. */
+	unsigned char synced;
+
+    /** Lengths of the wire line, and of its RPL part. */
+	unsigned short wireLen;
+	unsigned short rplLen;
+
+    /** Incarnation of the membership it joined with, from the 'INC n' line of its REG. 0 if it sent none. */
+	unsigned int incarnation;
+
+    /** Given name and surname, in the interned string pool. Use contactName() to get 'name.surname'. */
+	const char* givenName;
+	const char* surname;
+
+    /** Pre-rendered 'RPL name.surname;ip;talkPort;dnsPort\n', set while the contact is in a list.
+     * The first rplLen bytes are the RPL reply, and the bytes after 'RPL ' are its LST line. */
+	const char* wire;
 } Contact;
 
 #endif
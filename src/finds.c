@@ -0,0 +1,371 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "debug.h"
+#include "globals.h"
+#include "finds.h"
+#include "cache.h"
+
+/** Table of the finds in progress. Small enough that a linear scan is cheaper than anything smarter. */
+static Find finds[MAX_FINDS];
+
+int nFinds = 0;
+
+FindStats findStats;
+
+/** Sequence number of the next find started. */
+static unsigned long nextSeq = 1;
+
+/** \brief Moves a find on to its next step, and gives that step a deadline of its own.
+ */
+static void stepFind(Find* f, FindStatus status, int timeoutMs)
+{
+    f->status = status;
+    timerStart(&(f->timer), timeoutMs);
+}
+
+/** \brief Timer callback for the deadline of a step of a find. Cancels that find only.
+ *
+ * A DNS that does not answer may have left, so it is not trusted for its surname anymore.
+ * If it came from the cache, the SS is asked who the DNS is now, instead of giving up.
+ */
+static void findTimedOut(void* arg)
+{
+    Find* f = (Find*) arg;
+
+    if (f->status == WaitForRPL)
+    {
+        uncacheDns(strchr(f->name, '.'));
+
+        if (f->dnsCached)
+        {
+            logm(1, "Cached DNS of %s did not answer. Asking the SS.\n", f->name);
+            askSurnameServer(f);
+            return;
+        }
+    }
+
+    printf("Find of %s timed out. Find cancelled.\n", f->name);
+    endFind(f);
+}
+
+/** \brief Sends the QRY of a find to the next of its targets that has not been sent it.
+ *
+ * \return int 0 on success. -1 if the QRY could not be sent.
+ *
+ */
+static int sendQuery(Find* f)
+{
+    char buffer[NAME_LEN + 16];
+    struct sockaddr_in* target = &(f->targets[f->nAsked]);
+
+    // Hedged QRYs ask for the name back, as RPLs from several members may cross.
+    // A lone target is asked for the other members, to hedge to them next time.
+    sprintf(buffer, "QRY %s%s%s", f->name, (hedgeDelayMs >= 0 ? "\nECHO" : ""), (f->nTargets == 1 ? "\nALT" : ""));
+
+    // Debug and logging
+    logm(1, "Message:  QRY %s Destination: %s : %d\n", f->name, inet_ntoa(target->sin_addr), ntohs(target->sin_port));
+
+    if (sendto(dnsSocket, buffer, strlen(buffer), 0, (struct sockaddr*) target, sizeof(*target)) == -1)
+        return -1;
+
+    if (f->nAsked == 0)
+        findStats.queries++;
+    else
+        findStats.hedges++;
+
+    f->nAsked++;
+    return 0;
+}
+
+/** \brief Timer callback for the hedge delay of a find. Sends its QRY to one more member of the family.
+ */
+static void hedgeTimedOut(void* arg)
+{
+    Find* f = (Find*) arg;
+
+    if (f->status != WaitForRPL || f->nAsked >= f->nTargets)
+        return;
+
+    if (sendQuery(f) == -1)
+        perror("Could not hedge QRY");
+
+    if (f->nAsked < f->nTargets)
+        timerStart(&(f->hedgeTimer), hedgeDelayMs);
+}
+
+/** \brief Adds a find to the table. Its first step is up to the caller: askSurnameServer() or askDns().
+ *
+ * \param name const char* Full name of the target, name.surname.
+ * \param mode FindMode FindForFind or FindForConnect.
+ * \return Find* The new find. NULL if the table is full.
+ *
+ */
+Find* startFind(const char* name, FindMode mode)
+{
+    int i;
+
+    for (i = 0; i < MAX_FINDS; i++)
+    {
+        Find* f = &(finds[i]);
+
+        if (f->status != NotFinding)
+            continue;
+
+        strncpy(f->name, name, NAME_LEN - 1);
+        f->name[NAME_LEN - 1] = '\0';
+        f->mode = mode;
+        f->seq = nextSeq++;
+        f->nTargets = 0;
+        f->nAsked = 0;
+        f->denied = 0;
+        f->dnsCached = 0;
+
+        timerInit(&(f->timer), findTimedOut, f);
+        timerInit(&(f->hedgeTimer), hedgeTimedOut, f);
+        stepFind(f, WaitForFW, FIND_TIMEOUT_MS);
+
+        nFinds++;
+        return f;
+    }
+
+    return NULL;
+}
+
+/** \brief Sends a QRY with the target of a find to the SS, to learn the DNS of its surname. Puts the find in WaitForFW.
+ *
+ * The FW names only the DNS of the surname, so if another find of the same surname is waiting for one already,
+ * no QRY is sent: that FW will do for both.
+ *
+ * \param f Find* The find.
+ * \return int 0 on success. -1 if the QRY could not be sent. The find is ended then.
+ *
+ */
+int askSurnameServer(Find* f)
+{
+    char buffer[NAME_LEN + 8];
+    Find* other = oldestFind(WaitForFW, strchr(f->name, '.'), NULL);
+
+    timerStop(&(f->hedgeTimer));
+    f->nTargets = 0;
+    f->nAsked = 0;
+    f->denied = 0;
+    f->dnsCached = 0;
+    stepFind(f, WaitForFW, FIND_TIMEOUT_MS);
+
+    if (other != NULL && other != f)
+    {
+        logm(1, "Waiting for the FW of the find of %s, for %s.\n", other->name, f->name);
+        return 0;
+    }
+
+    sprintf(buffer, "QRY %s", f->name);
+
+    // Debug and logging
+    logm(1, "%s\n", buffer);
+
+    if (sendto(dnsSocket, buffer, strlen(buffer), 0, (struct sockaddr*) &saAddr, sizeof(saAddr)) == -1)
+    {
+        perror("Could not send QRY to SS");
+        printf("User %s could not be found.\n", f->name);
+        endFind(f);
+        return -1;
+    }
+
+    return 0;
+}
+
+/** \brief Sends a QRY with the target of a find to the DNS of its surname. Puts the find in WaitForRPL.
+ *
+ * Any member of the family can answer it, so with hedging on (see hedgeDelayMs) the QRY is also sent to
+ * the other members known, all at once or one more each time the hedge delay passes. The first RPL wins.
+ *
+ * \param f Find* The find.
+ * \param addrs struct sockaddr_in* Address of the DNS, followed by those of other members of the family.
+ * \param n int Number of addresses. Only the first one is used with hedging off.
+ * \param cached int 1 if the addresses came from the cache. Their answer is waited for a shorter time then.
+ * \return int 0 on success. -1 if the QRY could not be sent. The find is ended then.
+ *
+ */
+int askDns(Find* f, struct sockaddr_in* addrs, int n, int cached)
+{
+    if (n > MAX_ALTERNATES + 1)
+        n = MAX_ALTERNATES + 1;
+    if (hedgeDelayMs < 0)
+        n = 1;
+
+    memcpy(f->targets, addrs, n * sizeof(*addrs));
+    f->nTargets = n;
+    f->nAsked = 0;
+    f->denied = 0;
+
+    if (sendQuery(f) == -1)
+    {
+        perror("Could not send QRY to DNS");
+        printf("User %s could not be found.\n", f->name);
+        endFind(f);
+        return -1;
+    }
+
+    if (hedgeDelayMs == 0)
+    {
+        while (f->nAsked < f->nTargets)
+        {
+            if (sendQuery(f) == -1)
+            {
+                perror("Could not hedge QRY");
+                break;
+            }
+        }
+    }
+    else if (f->nAsked < f->nTargets)
+    {
+        timerStart(&(f->hedgeTimer), hedgeDelayMs);
+    }
+
+    f->dnsCached = cached;
+    stepFind(f, WaitForRPL, (cached ? CACHED_DNS_TIMEOUT_MS : FIND_TIMEOUT_MS));
+    return 0;
+}
+
+/** \brief Takes a find out of the table, whatever its outcome.
+ *
+ * \param f Find* The find.
+ *
+ */
+void endFind(Find* f)
+{
+    if (f->status == NotFinding)
+        return;
+
+    timerStop(&(f->timer));
+    timerStop(&(f->hedgeTimer));
+    f->status = NotFinding;
+    f->name[0] = '\0';
+    nFinds--;
+}
+
+/** \brief Gets the find in progress for a target.
+ *
+ * \param name const char* Full name of the target.
+ * \return Find* The find, or NULL if that target is not being looked for.
+ *
+ */
+Find* getFind(const char* name)
+{
+    int i;
+
+    for (i = 0; i < MAX_FINDS && nFinds > 0; i++)
+    {
+        if (finds[i].status != NotFinding && strcmp(finds[i].name, name) == 0)
+            return &(finds[i]);
+    }
+
+    return NULL;
+}
+
+/** \brief Gets the index of an address among the targets a find has sent its QRY to.
+ *
+ * \return int The index, 0 for the DNS. -1 if the QRY was not sent there.
+ *
+ */
+int findTarget(Find* f, struct sockaddr_in* addr)
+{
+    int i;
+
+    for (i = 0; i < f->nAsked; i++)
+    {
+        if (f->targets[i].sin_addr.s_addr == addr->sin_addr.s_addr && f->targets[i].sin_port == addr->sin_port)
+            return i;
+    }
+
+    return -1;
+}
+
+/** \brief Takes note of an empty RPL to a find, and tells whether it means the target does not exist.
+ *
+ * A member other than the DNS may not have heard of a join yet, so its word alone is not enough.
+ * It takes the DNS, or else every other member of the targets, once all of them were asked.
+ *
+ * \param f Find* The find.
+ * \param target int Index of the member that sent the RPL, as from findTarget(). -1 if not one of the targets.
+ * \return int 1 if the find is over, and the target not found. 0 if the other targets are still waited for.
+ *
+ */
+int findDenied(Find* f, int target)
+{
+    if (target == 0)
+        return 1;
+
+    if (target > 0)
+    {
+        f->denied |= 1u << target;
+
+        // Every bit but the DNS's
+        if (f->nAsked == f->nTargets && f->denied == (1u << f->nTargets) - 2)
+            return 1;
+    }
+
+    findStats.hedgeDenials++;
+    return 0;
+}
+
+/** \brief Gets the oldest find in a step, optionally narrowed down by surname or by the DNS it is waiting for.
+ *
+ * \param status FindStatus WaitForFW or WaitForRPL.
+ * \param surname const char* Surname of the target, starting at the '.'. NULL for any.
+ * \param dnsAddr struct sockaddr_in* Member of the family the QRY was sent to. NULL for any.
+ * \return Find* The oldest matching find, or NULL if there is none.
+ *
+ */
+Find* oldestFind(FindStatus status, const char* surname, struct sockaddr_in* dnsAddr)
+{
+    int i;
+    Find* oldest = NULL;
+
+    for (i = 0; i < MAX_FINDS && nFinds > 0; i++)
+    {
+        Find* f = &(finds[i]);
+
+        if (f->status != status)
+            continue;
+
+        if (surname != NULL)
+        {
+            char* s = strchr(f->name, '.');
+            if (s == NULL || strcmp(s, surname) != 0)
+                continue;
+        }
+
+        if (dnsAddr != NULL && findTarget(f, dnsAddr) == -1)
+            continue;
+
+        if (oldest == NULL || f->seq < oldest->seq)
+            oldest = f;
+    }
+
+    return oldest;
+}
+
+/** \brief Gets an entry of the table, to walk over the finds in progress.
+ *
+ * \param i int Index of the entry, from 0 to MAX_FINDS - 1.
+ * \return Find* The find, or NULL if the entry is free.
+ *
+ */
+Find* findAt(int i)
+{
+    if (i < 0 || i >= MAX_FINDS || finds[i].status == NotFinding)
+        return NULL;
+
+    return &(finds[i]);
+}
+
+/** \brief Prints the counters of the finds.
+ */
+void printFindStats()
+{
+    printf("%-14s%ld QRYs to DNSs, %ld hedged to other members, %ld won by a hedge, %ld empty RPLs of members waited past\n",
+           "Finds:", findStats.queries, findStats.hedges, findStats.hedgeWins, findStats.hedgeDenials);
+}
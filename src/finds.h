@@ -0,0 +1,83 @@
+#ifndef FINDS_H_INCLUDED
+#define FINDS_H_INCLUDED
+
+#include <arpa/inet.h>
+
+#include "contact.h"
+#include "globals.h"
+#include "timers.h"
+
+/** Most finds that may be in progress at once. */
+#define MAX_FINDS 64
+
+/** Longest a DNS taken from the cache may take to answer, in milliseconds, before the SS is asked instead. */
+#define CACHED_DNS_TIMEOUT_MS 1000
+
+/** \brief A find in progress: a stranger whose address we asked the SS, and then its DNS, for.
+ */
+typedef struct Find
+{
+    /** Full name of the target, name.surname. Empty while this entry of the table is free. */
+    char name[NAME_LEN];
+
+    FindMode mode;
+
+    /** WaitForFW or WaitForRPL. NotFinding while the entry is free. */
+    FindStatus status;
+
+    /** Members of the target's family the QRY goes to, the DNS first. Set on WaitForRPL. */
+    struct sockaddr_in targets[MAX_ALTERNATES + 1];
+    int nTargets;
+
+    /** Number of targets sent the QRY so far. The rest are sent it as hedgeTimer expires. */
+    int nAsked;
+    Timer hedgeTimer;
+
+    /** Targets that answered with an empty RPL, one bit for each, by index. */
+    unsigned int denied;
+
+    /** 1 if the targets came from the cache, rather than from a FW of the SS. */
+    int dnsCached;
+
+    /** Order in which the finds were started. Replies without a name go to the oldest find they may be for. */
+    unsigned long seq;
+
+    /** Deadline of the current step. */
+    Timer timer;
+} Find;
+
+/** \brief Counters of the finds of strangers.
+ */
+typedef struct FindStats
+{
+    /** QRYs sent to the DNS of the target's family, and to other members of it. */
+    long queries;
+    long hedges;
+
+    /** Finds answered first by a member other than the one asked first. */
+    long hedgeWins;
+
+    /** Empty RPLs from members other than the DNS, waited past for the answer of the others. */
+    long hedgeDenials;
+} FindStats;
+
+extern FindStats findStats;
+
+/** Number of finds in progress. */
+extern int nFinds;
+
+Find* startFind(const char* name, FindMode mode);
+void endFind(Find* f);
+
+int askSurnameServer(Find* f);
+int askDns(Find* f, struct sockaddr_in* addrs, int n, int cached);
+
+Find* getFind(const char* name);
+int findTarget(Find* f, struct sockaddr_in* addr);
+int findDenied(Find* f, int target);
+Find* oldestFind(FindStatus status, const char* surname, struct sockaddr_in* dnsAddr);
+Find* findAt(int i);
+
+void printFindStats();
+
+#endif // FINDS_H_INCLUDED
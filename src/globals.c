@@ -8,6 +8,14 @@
 #include "debug.h"
 #include "globals.h"
 #include "list.h"
+#include "reactor.h"
+#include "server.h"
+#include "timers.h"
+#include "reliable.h"
+#include "gossip.h"
+#include "handover.h"
+#include "standby.h"
+#include "liveness.h"
 
 /** Definitions of global variables. */
 
@@ -20,57 +28,127 @@ struct sockaddr_in saAddr;
 
 int dnsSocket = -1;
 int myDnsPort;
+int batchSize = 32;
+int queryWorkers = 0;
+int hedgeDelayMs = -1;
+int gossipFanout = 0;
+unsigned int myIncarnation = 0;
+Reactor* reactor = NULL;
+ReactorBackend ioBackend = ReactorEpoll;
 
 int talkSocket = -1;
 int talkServerSocket = -1;
 int myTalkPort;
 
 
-Node* contacts;
+List* contacts;
 Contact* nameServer = NULL;
 
-/** \brief Ensures the nameServer global variable is up to date.
+/** Callbacks waiting for the lookup of the DNS in progress. Empty when there is none. */
+static NameServerCallback nameServerWaiters[NAMESERVER_WAITERS];
+static int nNameServerWaiters = 0;
+
+/** \brief Gets the DNS of our family, if we know who it is.
  *
  * Immediately after the DNS leaves, the other users do not know who is the new DNS.
- * Calling this ensures the new DNS is known, by asking the Surname Server again.
+ * This never blocks: use lookupNameServer() to ask the Surname Server again.
  *
- * \return Contact* The nameServer global variable.
+ * \return Contact* The nameServer global variable. NULL if the DNS is not known.
  *
  */
 Contact* getNameServer()
 {
-    if (nameServer == NULL && joinStatus >= Joined)
+    return nameServer;
+}
+
+/** \brief Calls a function once the DNS is known, asking the Surname Server first if needed.
+ *
+ * If the DNS is known, the callback is called right away. Otherwise a QRY with our name is sent to the SS,
+ * and the callback is called when its FW arrives, or with NULL when it does not arrive in time.
+ * The event loop keeps running in the meantime. Callers that arrive while a lookup is in progress join it.
+ *
+ * \param callback NameServerCallback Called with the DNS, or with NULL if it could not be found.
+ *
+ */
+void lookupNameServer(NameServerCallback callback)
+{
+    int i;
+
+    if (nameServer != NULL || joinStatus < Joined)
     {
-        logm(1, "DNS not known. Getting DNS again...");
+        callback(nameServer);
+        return;
+    }
 
-        int ret;
+    for (i = 0; i < nNameServerWaiters; i++)
+    {
+        if (nameServerWaiters[i] == callback)
+            return;
+    }
 
-        char buffer[128];
-        sprintf(buffer, "QRY %s", myName);
+    if (nNameServerWaiters == NAMESERVER_WAITERS)
+    {
+        callback(NULL);
+        return;
+    }
 
-        ret = sendto(dnsSocket, buffer, strlen(buffer), 0, (struct sockaddr*) &saAddr, sizeof(saAddr));
-        if (ret == -1)
-        {
-            perror("Could not get DNS from SS");
-        }
+    nameServerWaiters[nNameServerWaiters++] = callback;
 
-        ret = recvfrom(dnsSocket, buffer, 127, 0, NULL, NULL);
-        if (ret == -1)
-        {
-            perror("Could not receive DNS from SS");
-        }
+    // Someone else asked already. Their FW will do
+    if (nNameServerWaiters > 1)
+        return;
+
+    logm(1, "DNS not known. Asking the SS...\n");
+
+    char buffer[128];
+    sprintf(buffer, "QRY %s", myName);
+
+    if (sendto(dnsSocket, buffer, strlen(buffer), 0, (struct sockaddr*) &saAddr, sizeof(saAddr)) == -1)
+    {
+        perror("Could not get DNS from SS");
+        nameServerLookedUp(NULL);
+        return;
+    }
+
+    timerStart(&nameServerTimer, NAMESERVER_TIMEOUT_MS);
+}
+
+/** \brief Checks if a lookup of the DNS is in progress.
+ *
+ * \return int True (not 0) while waiting for the SS to say who the DNS is.
+ *
+ */
+int lookingUpNameServer()
+{
+    return (nNameServerWaiters > 0);
+}
 
-        char dnsName[128];
-        sscanf(buffer, "FW %[^;]", dnsName);
+/** \brief Ends the lookup of the DNS in progress, and calls everyone waiting for it.
+ *
+ * \param dnsName const char* Name of the DNS, from the FW of the SS. NULL if the lookup failed.
+ *
+ */
+void nameServerLookedUp(const char* dnsName)
+{
+    NameServerCallback waiters[NAMESERVER_WAITERS];
+    int i, n = nNameServerWaiters;
+
+    timerStop(&nameServerTimer);
+
+    if (dnsName != NULL && nameServer == NULL)
+    {
         nameServer = get(contacts, dnsName);
 
         if (nameServer == NULL)
-        {
-            logm(1, "Could not find DNS: SS indicated %s.", dnsName);
-        }
+            logm(1, "Could not find DNS: SS indicated %s.\n", dnsName);
     }
 
-    return nameServer;
+    // Callbacks may start another lookup
+    memcpy(waiters, nameServerWaiters, n * sizeof(NameServerCallback));
+    nNameServerWaiters = 0;
+
+    for (i = 0; i < n; i++)
+        waiters[i](nameServer);
 }
 
 /** \brief Aborts Join and leaves program in a completely unjoined state.
@@ -85,25 +163,83 @@ void abortJoin()
         // If we are the DNS, make a last attempt to leave the Surname Server consistent
         if (joinStatus >= WaitForDNS
             && nameServer != NULL
-            && strcmp(nameServer->name, myName) == 0)
+            && contactNameIs(nameServer, myName))
         {
             char buf[128];
             sprintf(buf, "UNR %s", myName);
             sendto(dnsSocket, buf, strlen(buf), 0, (struct sockaddr*) &saAddr, sizeof(saAddr));
         }
 
+        reactorRemove(reactor, dnsSocket);
         close(dnsSocket);
         dnsSocket = -1;
     }
     emptyList(contacts);
     joinStatus = NotJoined;
+
+    timerStop(&joinTimer);
+    timerStop(&leaveTimer);
+    timerStop(&handoverTimer);
+    timerStop(&nameServerTimer);
+    nNameServerWaiters = 0;
+    resetReliable();
+    resetGossip();
+    resetHandover();
+    resetStandby();
+    resetLiveness();
+}
+
+/** \brief Timer callback for the deadline of a join. Aborts it.
+ */
+static void joinTimedOut(void* arg)
+{
+    if (joinStatus == NotJoined || joinStatus == Joined)
+        return;
+
+    printf("Join timed out. Aborted join. Please try again.\n");
+    abortJoin();
+}
+
+/** \brief Timer callback for the deadline of a leave. Forces it.
+ */
+static void leaveTimedOut(void* arg)
+{
+    if (joinStatus <= Joined)
+        return;
+
+    printf("Leave timed out. Forced leave.\n");
+    logm(1, "Other members' state may be inconsistent. Sent UNR to Surname Server just in case.\n");
+    abortJoin();
+}
+
+/** \brief Timer callback for the lookup of the DNS. Gives up on the FW of the SS.
+ */
+static void nameServerTimedOut(void* arg)
+{
+    logm(1, "SS did not say who the DNS is in time.\n");
+    nameServerLookedUp(NULL);
+}
+
+/** \brief Sets up the deadlines of the join and leave sequences, and of the lookup of the DNS. Called once, at start up.
+ */
+void initTimers()
+{
+    timerInit(&joinTimer, joinTimedOut, NULL);
+    timerInit(&leaveTimer, leaveTimedOut, NULL);
+    timerInit(&handoverTimer, handoverTimedOut, NULL);
+    timerInit(&nameServerTimer, nameServerTimedOut, NULL);
 }
 
 JoinStatus joinStatus = NotJoined;
-FindStatus findStatus = NotFinding;
-FindMode findMode = FindForFind;
 int oksExpected;
 
-char nameToFind[128];
+Timer joinTimer;
+Timer leaveTimer;
+Timer handoverTimer;
+Timer nameServerTimer;
+
+unsigned int syncEpoch = 0;
+unsigned int syncVersion = 0;
+int syncing = 0;
 
 int verbose = 0;
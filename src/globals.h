@@ -5,6 +5,8 @@
 
 #include "contact.h"
 #include "list.h"
+#include "reactor.h"
+#include "timers.h"
 
 extern char* myName;
 extern struct in_addr myIP;
@@ -19,6 +21,33 @@ extern int dnsSocket;
 /** UDP port for the DNS server. dnsSocket binds to this port. */
 extern int myDnsPort;
 
+/** Maximum number of datagrams received from dnsSocket per wakeup. 1 disables batching. */
+extern int batchSize;
+
+/** Number of threads answering QRYs, each on its own socket bound to myDnsPort. 0 answers them on the main thread. */
+extern int queryWorkers;
+
+/** Milliseconds before the QRY of a find is also sent to the next known member of the target's family.
+ * 0 sends it to every known member at once, -1 only to the DNS. */
+extern int hedgeDelayMs;
+
+/** Members a join or leave is told to besides the DNS, and each gossip round is sent to.
+ * They spread it to the rest of the family in GSPs. 0 tells every member directly, with a REG or UNR each. */
+extern int gossipFanout;
+
+/** Incarnation of our membership of the family, new at every join. Sent as an 'INC n' line with our REGs and UNRs,
+ * so that the members tell our later joins and leaves from older ones spread by gossip. */
+extern unsigned int myIncarnation;
+
+/** Most other members of its family a DNS lists in a RPL, for the QRYs of later finds to be hedged to. */
+#define MAX_ALTERNATES 3
+
+/** Event loop of the main thread. Every socket the main thread reads is registered in it. */
+extern Reactor* reactor;
+
+/** Backend the reactor is created with. Falls back to epoll if io_uring is not available. */
+extern ReactorBackend ioBackend;
+
 
 
 /** TCP socket used to initiate a chat session. -1 when not in use. */
@@ -31,12 +60,23 @@ extern int talkServerSocket;
 extern int myTalkPort;
 
 
-/** Linked list of all contacts with the same surname as ours. */
-extern Node* contacts;
+/** List of all contacts with the same surname as ours, indexed by name. */
+extern List* contacts;
 
 /** Contact who is the authorized Given Name Server (DNS) for our family. */
 extern Contact* nameServer;
+
+/** \brief Called when a lookup of the DNS ends, with the DNS, or with NULL if it could not be found.
+ */
+typedef void (*NameServerCallback)(Contact* dns);
+
+/** Most callers that may wait for the same lookup of the DNS. */
+#define NAMESERVER_WAITERS 4
+
 Contact* getNameServer();
+void lookupNameServer(NameServerCallback callback);
+int lookingUpNameServer();
+void nameServerLookedUp(const char* dnsName);
 
 void abortJoin();
 
@@ -50,6 +90,7 @@ typedef enum
     LeavingDNS,
     LeavingUsers,
     SearchingNewDns,
+    UpdatingSS,
     LeavingForGood
 } JoinStatus;
 
@@ -69,10 +110,39 @@ typedef enum
 /* State variables that store the state between select() cycles. */
 
 extern JoinStatus joinStatus;
-extern FindStatus findStatus;
-extern FindMode findMode;
 extern int oksExpected;
-extern char nameToFind[NAME_LEN];
+
+/** Longest a join may take, in milliseconds, before it is aborted. */
+#define JOIN_TIMEOUT_MS 10000
+
+/** Longest a leave may take, in milliseconds, before it is forced. */
+#define LEAVE_TIMEOUT_MS 10000
+
+/** Longest each step of a find (waiting for the FW, then for the RPL) may take, in milliseconds. */
+#define FIND_TIMEOUT_MS 5000
+
+/** Longest the members offered to be the new DNS may take to answer, in milliseconds, before more are offered it.
+ * Also how long the SS is given to acknowledge the new DNS, before leaving without its answer. */
+#define HANDOVER_TIMEOUT_MS 2000
+
+/** Longest the SS may take to say who our DNS is, in milliseconds. */
+#define NAMESERVER_TIMEOUT_MS 2000
+
+/** Deadlines of the join and leave in progress, of the peer asked to take over as DNS,
+ * and of the lookup of the DNS. Each find has its own. */
+extern Timer joinTimer;
+extern Timer leaveTimer;
+extern Timer handoverTimer;
+extern Timer nameServerTimer;
+
+void initTimers();
+
+/** Epoch and version of the DNS's roster, as of our last sync with it. 0 if we never synced. */
+extern unsigned int syncEpoch;
+extern unsigned int syncVersion;
+
+/** Boolean. 1 while waiting for the reply to a SYN. */
+extern int syncing;
 
 /** Indicates verbose mode. 0 prints nothing debug-related. Higher values print more info. */
 extern int verbose;
@@ -0,0 +1,344 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "globals.h"
+#include "debug.h"
+#include "list.h"
+#include "gossip.h"
+
+/** \brief A join or leave of a member, being spread to the rest of the family.
+ */
+typedef struct Rumor
+{
+    /** Full name of the member. Empty while this entry of the table is free. */
+    char name[NAME_LEN];
+
+    /** 1 for a leave, 0 for a join. */
+    int removed;
+
+    /** Where the member was. */
+    struct in_addr ip;
+    int talkPort;
+    int dnsPort;
+
+    /** Incarnation of the membership that joined or left. Of two changes of a member, the later incarnation wins. */
+    unsigned int incarnation;
+
+    /** Gossip rounds it is still to be sent in. 0 once it is only remembered. */
+    int transmitsLeft;
+
+    /** Monotonic time after which it is forgotten, in milliseconds. */
+    long long forgetMs;
+} Rumor;
+
+GossipStats gossipStats;
+
+/** Changes being spread or remembered. Small enough for a linear scan. */
+static Rumor rumors[GOSSIP_RUMORS];
+
+/** Runs a gossip round every GOSSIP_PERIOD_MS while there is something to spread. */
+static Timer gossipTimer;
+static int timerReady = 0;
+
+/** Seed of the random choice of members. */
+static unsigned int seed = 0;
+
+/** \brief Tells whether an incarnation is later than another.
+ *
+ * They are compared as serial numbers, so that one that wrapped around is still later.
+ *
+ * \param a unsigned int An incarnation.
+ * \param b unsigned int Another one.
+ * \return int 1 if a is later than b.
+ *
+ */
+int incarnationNewer(unsigned int a, unsigned int b)
+{
+    return (int) (a - b) > 0;
+}
+
+/** \brief Gets an incarnation for a new membership of ours, later than the last one.
+ *
+ * It is the wall clock time in milliseconds, so that it is still later after a restart.
+ *
+ * \return unsigned int The incarnation. Never 0, which is kept for members that send none.
+ *
+ */
+unsigned int newIncarnation()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    unsigned int inc = (unsigned int) ((long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+
+    if (!incarnationNewer(inc, myIncarnation))
+        inc = myIncarnation + 1;
+    if (inc == 0)
+        inc = 1;
+
+    return inc;
+}
+
+/** \brief Number of rounds a member sends a change in, for it to reach the whole family.
+ *
+ * With each member passing it on to fanout others, the members that know grow about fanout + 1 times
+ * every round, so a change reaches everyone in about log(members) / log(fanout + 1) rounds.
+ * GOSSIP_EXTRA_ROUNDS more make up for lost datagrams and for members picked twice.
+ *
+ * \param members int Size of the family.
+ * \param fanout int Members each one sends to in a round.
+ * \return int Rounds, at least 1.
+ *
+ */
+int rumorTransmits(int members, int fanout)
+{
+    int rounds = 0;
+    long reached = 1;
+
+    while (reached < members && rounds < 30)
+    {
+        reached *= (fanout + 1);
+        rounds++;
+    }
+
+    return rounds + GOSSIP_EXTRA_ROUNDS;
+}
+
+/** \brief Picks members of the family at random, without repetition. Never ourselves.
+ *
+ * \param out_members Contact** Where the members are written.
+ * \param max int Most members to pick.
+ * \param withDns int 1 if the DNS may be picked.
+ * \return int Number of members picked.
+ *
+ */
+int pickMembers(Contact** out_members, int max, int withDns)
+{
+    Node* p;
+    int seen = 0, n = 0;
+
+    if (seed == 0)
+        seed = (unsigned int) time(NULL) ^ ((unsigned int) getpid() << 16);
+
+    // Reservoir sampling: every member ends up picked with the same chance
+    for (p = contacts->next; p != NULL; p = p->next)
+    {
+        if (contactNameIs(p->c, myName) || (!withDns && p->c == nameServer))
+            continue;
+
+        seen++;
+        if (n < max)
+        {
+            out_members[n++] = p->c;
+        }
+        else
+        {
+            int j = rand_r(&seed) % seen;
+            if (j < max)
+                out_members[j] = p->c;
+        }
+    }
+
+    return n;
+}
+
+/** \brief Gets the entry of a member's name, dropping it if it is too old.
+ */
+static Rumor* findRumor(const char* name)
+{
+    int i;
+    long long now = nowMs();
+
+    for (i = 0; i < GOSSIP_RUMORS; i++)
+    {
+        Rumor* r = &(rumors[i]);
+
+        if (r->name[0] == '\0')
+            continue;
+
+        if (r->transmitsLeft == 0 && r->forgetMs <= now)
+        {
+            r->name[0] = '\0';
+            continue;
+        }
+
+        if (strcmp(r->name, name) == 0)
+            return r;
+    }
+
+    return NULL;
+}
+
+/** \brief Tells whether a change heard in a GSP is news to us.
+ *
+ * It is if it comes from a later incarnation of the member than the last change heard. Of a join
+ * and a leave of the same incarnation, the leave wins. Anything else we heard already, or is stale.
+ *
+ * \param c Contact* The member, as in the GSP.
+ * \param removed int 1 for a leave, 0 for a join.
+ * \return int 1 if it is news.
+ *
+ */
+int rumorIsNews(Contact* c, int removed)
+{
+    Rumor* r = findRumor(contactName(c));
+
+    if (r == NULL)
+        return 1;
+
+    if (incarnationNewer(c->incarnation, r->incarnation))
+        return 1;
+
+    if (c->incarnation == r->incarnation && removed && !r->removed)
+        return 1;
+
+    if (c->incarnation == r->incarnation && removed == r->removed)
+        gossipStats.known++;
+    else
+        gossipStats.stale++;
+
+    return 0;
+}
+
+/** \brief Timer callback. Sends the changes being spread to a few members picked at random.
+ */
+static void gossipRound(void* arg)
+{
+    char buffer[GOSSIP_DATAGRAM_MAX + 1];
+    int len, i, n, live = 0;
+    Contact* targets[GOSSIP_MAX_FANOUT];
+
+    if (joinStatus != Joined || gossipFanout <= 0)
+        return;
+
+    n = pickMembers(targets, (gossipFanout < GOSSIP_MAX_FANOUT ? gossipFanout : GOSSIP_MAX_FANOUT), 1);
+    if (n == 0)
+        return;
+
+    // Format: 'GSP' followed by a '+name.surname;ip;talkPort;dnsPort;incarnation' line for every join, and a '-' one for every leave
+    len = sprintf(buffer, "GSP\n");
+
+    for (i = 0; i < GOSSIP_RUMORS; i++)
+    {
+        Rumor* r = &(rumors[i]);
+        char line[NAME_LEN + 48];
+
+        if (r->name[0] == '\0' || r->transmitsLeft == 0)
+            continue;
+
+        int lineLen = snprintf(line, sizeof(line), "%c%s;%s;%d;%d;%u\n", (r->removed ? '-' : '+'), r->name,
+                               inet_ntoa(r->ip), r->talkPort, r->dnsPort, r->incarnation);
+
+        // Cut short: it would be taken for another member. Never spread
+        if (lineLen < 0 || lineLen >= (int) sizeof(line))
+        {
+            logm(1, "Change of %s does not fit in a GSP line. Not spreading it.\n", r->name);
+            r->transmitsLeft = 0;
+            continue;
+        }
+
+        // Does not fit: next round
+        if (len + lineLen > GOSSIP_DATAGRAM_MAX)
+        {
+            live++;
+            continue;
+        }
+
+        memcpy(buffer + len, line, lineLen);
+        len += lineLen;
+
+        if (--(r->transmitsLeft) > 0)
+            live++;
+    }
+
+    gossipStats.rounds++;
+
+    for (i = 0; i < n; i++)
+    {
+        if (sendto(dnsSocket, buffer, len, 0, (struct sockaddr*) &(targets[i]->dnsAddr), sizeof(targets[i]->dnsAddr)) == -1)
+            perror("Could not send GSP");
+        else
+            gossipStats.datagrams++;
+    }
+
+    logm(2, "Gossiped to %d members:\n%s", n, buffer);
+
+    if (live > 0)
+        timerStart(&gossipTimer, GOSSIP_PERIOD_MS);
+}
+
+/** \brief Starts spreading a join or leave to the rest of the family, in the next gossip rounds.
+ *
+ * Replaces whatever was heard of that member before.
+ *
+ * \param c Contact* The member. Only its name, addresses and incarnation are kept.
+ * \param removed int 1 for a leave, 0 for a join.
+ *
+ */
+void spreadRumor(Contact* c, int removed)
+{
+    int i;
+    Rumor* r = findRumor(contactName(c));
+    Rumor* oldest = NULL;
+
+    // A free entry, or else the one that is done spreading and is the oldest
+    for (i = 0; r == NULL && i < GOSSIP_RUMORS; i++)
+    {
+        if (rumors[i].name[0] == '\0')
+            r = &(rumors[i]);
+        else if (rumors[i].transmitsLeft == 0 && (oldest == NULL || rumors[i].forgetMs < oldest->forgetMs))
+            oldest = &(rumors[i]);
+    }
+    if (r == NULL)
+        r = oldest;
+    if (r == NULL)
+    {
+        logm(1, "Too many changes being gossiped. Not spreading the one of %s.\n", contactName(c));
+        return;
+    }
+
+    strncpy(r->name, contactName(c), NAME_LEN - 1);
+    r->name[NAME_LEN - 1] = '\0';
+    r->removed = removed;
+    r->ip = c->ip;
+    r->talkPort = c->talkPort;
+    r->dnsPort = c->dnsPort;
+    r->incarnation = c->incarnation;
+    r->transmitsLeft = rumorTransmits(contacts->length, gossipFanout);
+    r->forgetMs = nowMs() + GOSSIP_MEMORY_MS;
+
+    if (!timerReady)
+    {
+        timerInit(&gossipTimer, gossipRound, NULL);
+        timerReady = 1;
+    }
+
+    if (!timerPending(&gossipTimer))
+        timerStart(&gossipTimer, GOSSIP_PERIOD_MS);
+}
+
+/** \brief Forgets every change heard. Called when leaving the family.
+ */
+void resetGossip()
+{
+    int i;
+
+    for (i = 0; i < GOSSIP_RUMORS; i++)
+        rumors[i].name[0] = '\0';
+
+    if (timerReady)
+        timerStop(&gossipTimer);
+}
+
+/** \brief Prints the counters of the gossip.
+ */
+void printGossipStats()
+{
+    printf("Gossip:       fan-out %d; %ld changes started, %ld learned, %ld old news, %ld stale; %ld GSPs in %ld rounds\n",
+           gossipFanout, gossipStats.started, gossipStats.learned, gossipStats.known, gossipStats.stale,
+           gossipStats.datagrams, gossipStats.rounds);
+}
@@ -0,0 +1,55 @@
+#ifndef GOSSIP_H_INCLUDED
+#define GOSSIP_H_INCLUDED
+
+#include "contact.h"
+
+/** Interval between gossip rounds, in milliseconds. */
+#define GOSSIP_PERIOD_MS 100
+
+/** Most membership changes being spread, or remembered, at once. */
+#define GOSSIP_RUMORS 64
+
+/** How long a change is remembered after it was heard, in milliseconds. Older changes of the member heard in this time are ignored. */
+#define GOSSIP_MEMORY_MS 10000
+
+/** Rounds a member sends a change in, beyond the ones it takes to reach everyone in theory. */
+#define GOSSIP_EXTRA_ROUNDS 2
+
+/** Largest fan-out accepted for the gossip rounds. */
+#define GOSSIP_MAX_FANOUT 16
+
+/** Largest GSP datagram. Changes that do not fit wait for the next round. */
+#define GOSSIP_DATAGRAM_MAX 1400
+
+/** \brief Counters of the gossip of membership changes.
+ */
+typedef struct GossipStats
+{
+    /** Changes we started spreading: joins and leaves told to us directly with a REG or UNR. */
+    long started;
+
+    /** Changes learned from a GSP, changes in a GSP that were old news, and changes we did not believe. */
+    long learned;
+    long known;
+    long stale;
+
+    /** Gossip rounds run, and GSP datagrams sent in them. */
+    long rounds;
+    long datagrams;
+} GossipStats;
+
+extern GossipStats gossipStats;
+
+int rumorTransmits(int members, int fanout);
+int pickMembers(Contact** out_members, int max, int withDns);
+
+int incarnationNewer(unsigned int a, unsigned int b);
+unsigned int newIncarnation();
+
+int rumorIsNews(Contact* c, int removed);
+void spreadRumor(Contact* c, int removed);
+void resetGossip();
+
+void printGossipStats();
+
+#endif // GOSSIP_H_INCLUDED
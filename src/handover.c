@@ -0,0 +1,459 @@
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/socket.h>
+
+#include "globals.h"
+#include "debug.h"
+#include "list.h"
+#include "reliable.h"
+#include "standby.h"
+#include "handover.h"
+
+/** \brief What a member offered to be the DNS said.
+ */
+typedef enum
+{
+    CandidateAsked,
+    CandidateWilling,
+    CandidateRefused
+} CandidateAnswer;
+
+/** \brief A member offered to take over as DNS.
+ *
+ * Its name and addresses are copied, as it may leave, and its Contact be freed, while we wait.
+ */
+typedef struct Candidate
+{
+    char name[NAME_LEN];
+    struct in_addr ip;
+    int dnsPort;
+    struct sockaddr_in dnsAddr;
+
+    CandidateAnswer answer;
+} Candidate;
+
+HandoverStats handoverStats;
+
+static HandoverPhase phase = HandoverOff;
+
+/** Members offered to be the DNS so far, wave after wave. */
+static Candidate candidates[HANDOVER_MAX_CANDIDATES];
+static int nCandidates = 0;
+
+/** Member told to be the DNS, during HandoverCommitting and after. */
+static Candidate* chosen = NULL;
+
+/** When the handover started, in microseconds. */
+static long long startUs = 0;
+
+/** \brief Gets the candidate an answer came from, if any.
+ */
+static Candidate* candidateAt(struct sockaddr_in* addr)
+{
+    int i;
+
+    for (i = 0; i < nCandidates; i++)
+        if (candidates[i].dnsAddr.sin_addr.s_addr == addr->sin_addr.s_addr
+            && candidates[i].dnsAddr.sin_port == addr->sin_port)
+            return &(candidates[i]);
+
+    return NULL;
+}
+
+/** \brief Gets the candidate of a name, if the member was offered to be the DNS.
+ */
+static Candidate* candidateNamed(const char* name)
+{
+    int i;
+
+    for (i = 0; i < nCandidates; i++)
+        if (strcmp(candidates[i].name, name) == 0)
+            return &(candidates[i]);
+
+    return NULL;
+}
+
+/** \brief Writes the DNS request naming a candidate, 'DNS name.surname;ip;dnsPort' and a tag, if any.
+ */
+static void dnsRequest(char* out_buffer, Candidate* k, const char* tag)
+{
+    sprintf(out_buffer, "DNS %s;%s;%d%s", k->name, inet_ntoa(k->ip), k->dnsPort, tag);
+}
+
+/** \brief Ends the handover.
+ *
+ * \param found int 1 if a member took over as DNS.
+ *
+ */
+static void finish(int found)
+{
+    phase = HandoverDone;
+    timerStop(&handoverTimer);
+
+    handoverStats.lastUs = nowUs() - startUs;
+    if (!found)
+    {
+        handoverStats.failed++;
+        logm(1, "No peer took over as DNS. Leaving anyway.\n");
+    }
+}
+
+static void offerWave();
+
+/** \brief Adds a member to the candidates, not asked yet.
+ */
+static Candidate* addCandidate(Contact* c)
+{
+    Candidate* k = &(candidates[nCandidates++]);
+
+    strncpy(k->name, contactName(c), NAME_LEN - 1);
+    k->name[NAME_LEN - 1] = '\0';
+    k->ip = c->ip;
+    k->dnsPort = c->dnsPort;
+    k->dnsAddr = c->dnsAddr;
+    k->answer = CandidateAsked;
+
+    return k;
+}
+
+/** \brief Tells the first member that said it was willing to be the DNS that it is.
+ *
+ * Offers still unanswered are not sent again. They reserve nothing, so the members need not be told.
+ * Asks more members if none was willing.
+ *
+ */
+static void nextCandidate()
+{
+    int i, waiting = 0;
+
+    chosen = NULL;
+
+    for (i = 0; i < nCandidates && chosen == NULL; i++)
+    {
+        if (candidates[i].answer == CandidateWilling)
+            chosen = &(candidates[i]);
+        else if (candidates[i].answer == CandidateAsked)
+            waiting++;
+    }
+
+    if (chosen == NULL)
+    {
+        // Back to the offers not answered yet, with a deadline of their own if the member told to take over failed
+        if (waiting > 0)
+        {
+            if (phase != HandoverProbing)
+                timerStart(&handoverTimer, HANDOVER_TIMEOUT_MS);
+            phase = HandoverProbing;
+        }
+        else
+            offerWave();
+        return;
+    }
+
+    char buffer[NAME_LEN + 64];
+    dnsRequest(buffer, chosen, "");
+
+    logm(1, "Peer %s is willing to be the new DNS. Telling it to take over.\n", chosen->name);
+
+    if (sendReliable(buffer, &(chosen->dnsAddr)) == -1)
+    {
+        perror("Could not send DNS request to peer");
+        chosen->answer = CandidateRefused;
+        nextCandidate();
+        return;
+    }
+
+    for (i = 0; i < nCandidates; i++)
+    {
+        if (candidates[i].answer == CandidateAsked)
+            cancelReliableRequests(&(candidates[i].dnsAddr), "DNS ");
+    }
+
+    phase = HandoverCommitting;
+    timerStart(&handoverTimer, HANDOVER_TIMEOUT_MS);
+}
+
+/** \brief Offers to be the DNS to the HANDOVER_PROBES members not asked yet with the lowest RTT measured.
+ *
+ * Members whose RTT was never measured come after, in the order of the contact list.
+ * Ends the handover if there is no one left to ask.
+ *
+ */
+static void offerWave()
+{
+    Contact* picked[HANDOVER_PROBES];
+    long rtts[HANDOVER_PROBES];
+    int max = HANDOVER_MAX_CANDIDATES - nCandidates;
+    int n = 0, i, j, sent = 0;
+    Node* p;
+
+    if (max > HANDOVER_PROBES)
+        max = HANDOVER_PROBES;
+
+    for (p = contacts->next; p != NULL && max > 0; p = p->next)
+    {
+        if (contactNameIs(p->c, myName) || candidateNamed(contactName(p->c)) != NULL)
+            continue;
+
+        long rtt = measuredRtt(&(p->c->dnsAddr));
+        if (rtt < 0)
+            rtt = LONG_MAX;
+
+        // Keep the best ones so far, lowest RTT first
+        if (n == max && rtt >= rtts[n - 1])
+            continue;
+
+        j = (n < max) ? n++ : n - 1;
+        while (j > 0 && rtts[j - 1] > rtt)
+        {
+            picked[j] = picked[j - 1];
+            rtts[j] = rtts[j - 1];
+            j--;
+        }
+        picked[j] = p->c;
+        rtts[j] = rtt;
+    }
+
+    if (n == 0)
+    {
+        finish(0);
+        return;
+    }
+
+    handoverStats.waves++;
+
+    // Format: 'DNS name.surname;ip;dnsPort;OFFER'. The member answers 'OK OFFER' if willing, without taking over yet
+    for (i = 0; i < n; i++)
+    {
+        Candidate* k = addCandidate(picked[i]);
+        char buffer[NAME_LEN + 64];
+
+        dnsRequest(buffer, k, ";OFFER");
+
+        logm(1, "Offering %s to be the new DNS.\n", k->name);
+
+        if (sendReliable(buffer, &(k->dnsAddr)) == -1)
+        {
+            perror("Could not send DNS request to peer");
+            k->answer = CandidateRefused;
+            continue;
+        }
+
+        handoverStats.offers++;
+        sent++;
+    }
+
+    if (sent == 0)
+    {
+        offerWave();
+        return;
+    }
+
+    phase = HandoverProbing;
+    timerStart(&handoverTimer, HANDOVER_TIMEOUT_MS);
+}
+
+/** \brief Takes a candidate off the running, and asks someone else if it was the one we were waiting for.
+ */
+static void refuse(Candidate* k)
+{
+    if (k->answer == CandidateRefused)
+        return;
+
+    k->answer = CandidateRefused;
+
+    if ((phase == HandoverCommitting && k == chosen) || phase == HandoverProbing)
+        nextCandidate();
+}
+
+/** \brief Tells the SS who the new DNS is. Waits for its answer, but leaves without it if it does not come.
+ */
+static void updateSurnameServer()
+{
+    char buffer[NAME_LEN + 64];
+    dnsRequest(buffer, chosen, "");
+
+    logm(1, "Peer %s is the new DNS. Telling the SS.\n", chosen->name);
+
+    if (sendto(dnsSocket, buffer, strlen(buffer), 0, (struct sockaddr*) &saAddr, sizeof(saAddr)) == -1)
+    {
+        perror("Could not send new DNS to Surname Server for leaving. Leaving anyway");
+        finish(1);
+        return;
+    }
+
+    phase = HandoverUpdatingSS;
+    timerStart(&handoverTimer, HANDOVER_TIMEOUT_MS);
+}
+
+/** \brief Gets the step the handover of the DNS is at.
+ */
+HandoverPhase handoverPhase()
+{
+    return phase;
+}
+
+/** \brief Starts handing over the DNS to another member, as we leave. Called along with the UNRs.
+ *
+ * The standby, if there is one, already agreed, and is told to take over right away.
+ * Otherwise, a few members, the ones that answer us fastest, are offered it at once. The first one to say
+ * it is willing is told to take over, and the SS is told about it. If no one is willing,
+ * more members are offered it, up to HANDOVER_MAX_CANDIDATES.
+ *
+ */
+void startHandover()
+{
+    Contact* standby = getStandby();
+
+    resetHandover();
+
+    handoverStats.started++;
+    startUs = nowUs();
+
+    if (standby != NULL)
+    {
+        addCandidate(standby)->answer = CandidateWilling;
+        nextCandidate();
+        return;
+    }
+
+    offerWave();
+}
+
+/** \brief Handles an answer that may be to the handover, during leave.
+ *
+ * 'OK OFFER' says a member is willing to be the DNS, 'OK DNS' that it took over, and anything
+ * other than an OK that it refused. Plain OKs are the answers to our UNRs, and are left alone.
+ *
+ * \param msg Message* Message received.
+ * \param addr struct sockaddr_in* Sender.
+ * \return int 1 if the message was about the handover.
+ *
+ */
+int continueHandover(Message* msg, struct sockaddr_in* addr)
+{
+    if (phase == HandoverOff || phase == HandoverDone)
+        return 0;
+
+    if (phase == HandoverUpdatingSS
+        && addr->sin_addr.s_addr == saAddr.sin_addr.s_addr && addr->sin_port == saAddr.sin_port)
+    {
+        logm(1, "SS acknowledged the new DNS.\n");
+        finish(1);
+        return 1;
+    }
+
+    Candidate* k = candidateAt(addr);
+    if (k == NULL)
+        return 0;
+
+    const char* tag = (msg->nFields > 0) ? msg->fields[0].str : "";
+
+    if (msg->opcode == OpOK && strcmp(tag, "OFFER") == 0)
+    {
+        if (k->answer == CandidateAsked)
+            k->answer = CandidateWilling;
+
+        if (phase == HandoverProbing)
+            nextCandidate();
+        return 1;
+    }
+
+    if (msg->opcode == OpOK && strcmp(tag, "DNS") == 0)
+    {
+        if (phase == HandoverCommitting && k == chosen)
+        {
+            // Not the DNS anymore. A forced leave must not unregister the family at the SS
+            nameServer = NULL;
+            updateSurnameServer();
+        }
+        return 1;
+    }
+
+    if (msg->opcode == OpOK)
+        return 0;
+
+    logm(1, "Peer %s refused to be the new DNS.\n", k->name);
+    handoverStats.refused++;
+    refuse(k);
+    return 1;
+}
+
+/** \brief Called when handoverTimer expires. Takes the silence of the members as a refusal,
+ * and the silence of the SS as an acknowledgement.
+ *
+ * The member told to take over is waited for as long as the request is being sent again:
+ * it may have taken over already, and unlike an offer a commit cannot be dropped.
+ *
+ */
+void handoverStepTimedOut()
+{
+    int i;
+
+    if (phase == HandoverUpdatingSS)
+    {
+        logm(1, "SS did not acknowledge the new DNS. Leaving anyway.\n");
+        finish(1);
+        return;
+    }
+
+    if (phase == HandoverCommitting && chosen != NULL && reliablePending(&(chosen->dnsAddr), "DNS "))
+    {
+        logm(1, "Peer %s did not confirm it took over yet. Still waiting.\n", chosen->name);
+        timerStart(&handoverTimer, HANDOVER_TIMEOUT_MS);
+        return;
+    }
+
+    if (phase != HandoverProbing && phase != HandoverCommitting)
+        return;
+
+    for (i = 0; i < nCandidates; i++)
+    {
+        Candidate* k = &(candidates[i]);
+
+        if (k->answer == CandidateAsked || (phase == HandoverCommitting && k == chosen))
+        {
+            logm(1, "Peer %s did not answer the DNS request.\n", k->name);
+            handoverStats.silent++;
+            cancelReliableRequests(&(k->dnsAddr), "DNS ");
+            k->answer = CandidateRefused;
+        }
+    }
+
+    nextCandidate();
+}
+
+/** \brief Takes a member that left as a refusal, if it was offered to be the DNS.
+ *
+ * \param name const char* Full name of the member.
+ *
+ */
+void handoverMemberLeft(const char* name)
+{
+    if (phase != HandoverProbing && phase != HandoverCommitting)
+        return;
+
+    Candidate* k = candidateNamed(name);
+    if (k != NULL)
+        refuse(k);
+}
+
+/** \brief Forgets the handover in progress, if any.
+ */
+void resetHandover()
+{
+    phase = HandoverOff;
+    nCandidates = 0;
+    chosen = NULL;
+    timerStop(&handoverTimer);
+}
+
+/** \brief Prints the counters of the handovers of the DNS.
+ */
+void printHandoverStats()
+{
+    printf("Handover:     %ld started, %ld without a new DNS, last took %.1f ms; %ld offers in %ld waves, %ld refused, %ld silent\n",
+           handoverStats.started, handoverStats.failed, handoverStats.lastUs / 1000.0,
+           handoverStats.offers, handoverStats.waves, handoverStats.refused, handoverStats.silent);
+}
@@ -0,0 +1,62 @@
+#ifndef HANDOVER_H_INCLUDED
+#define HANDOVER_H_INCLUDED
+
+#include "server.h"
+
+/** Members offered to take over as DNS at once. The first one willing gets it. */
+#define HANDOVER_PROBES 4
+
+/** Most members offered to take over as DNS in one leave. Then we leave without a new DNS. */
+#define HANDOVER_MAX_CANDIDATES 32
+
+/** \brief Step of the handover of the DNS to another member, while we leave.
+ */
+typedef enum
+{
+    /** We are not the DNS, or not leaving. */
+    HandoverOff,
+
+    /** Waiting for the members offered to be the DNS to say if they are willing. */
+    HandoverProbing,
+
+    /** Waiting for the member that was willing to confirm it is the DNS now. */
+    HandoverCommitting,
+
+    /** Waiting for the SS to acknowledge the new DNS. */
+    HandoverUpdatingSS,
+
+    /** Done, with or without a new DNS. */
+    HandoverDone
+} HandoverPhase;
+
+/** \brief Counters of the handovers of the DNS.
+ */
+typedef struct HandoverStats
+{
+    /** Handovers started, and those that ended without a new DNS. */
+    long started;
+    long failed;
+
+    /** Offers sent, in how many waves, and offers refused or not answered in time. */
+    long offers;
+    long waves;
+    long refused;
+    long silent;
+
+    /** Time the last handover took, in microseconds. */
+    long long lastUs;
+} HandoverStats;
+
+extern HandoverStats handoverStats;
+
+HandoverPhase handoverPhase();
+
+void startHandover();
+int continueHandover(Message* msg, struct sockaddr_in* addr);
+void handoverStepTimedOut();
+void handoverMemberLeft(const char* name);
+void resetHandover();
+
+void printHandoverStats();
+
+#endif // HANDOVER_H_INCLUDED
@@ -1,6 +1,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -9,75 +11,522 @@
 #include "globals.h"
 #include "contact.h"
 #include "list.h"
+#include "pool.h"
+#include "names.h"
+#include "bloom.h"
+
+/** Number of contacts (and nodes) allocated at once when their pool runs out. */
+#define CONTACTS_PER_SLAB 256
+
+Pool contactPool;
+Pool nodePool;
+
+/** Number of counters of the name filter of a fresh list. Must be a power of 2. */
+#define FILTER_INITIAL_SIZE 1024
+
+/** Number of filter counters touched by each name. */
+#define FILTER_HASHES 4
+
+/** The filter is rebuilt twice as big when it has less than this many counters per name.
+ * With 4 hashes, 10 counters per name give about 1% false positives. */
+#define FILTER_COUNTERS_PER_NAME 10
+
+/** Initial size of the cached LST message of a list. */
+#define LST_INITIAL_CAPACITY 2048
+
+/** Number of buckets of a fresh index. Must be a power of 2. */
+#define INDEX_INITIAL_SIZE 16
+
+/** Number of old buckets moved to the new table on each index operation, while rehashing. */
+#define INDEX_REHASH_STEPS 4
+
+static Node** nameLink(Node* n)
+{
+    return &(n->nameNext);
+}
+
+static unsigned int hashNodeName(Node* n)
+{
+    return hashContactName(n->c);
+}
+
+static int matchName(Node* n, const void* name)
+{
+    return contactNameIs(n->c, (const char*) name);
+}
+
+/** \brief Hashes a DNS address, given the IP in network endianess and the port in host endianess.
+ */
+static unsigned int hashAddr(struct in_addr ip, int port)
+{
+    unsigned int h = ((unsigned int) ip.s_addr ^ ((unsigned int) port << 16)) * 2654435761u;
+    return h ^ (h >> 15);
+}
+
+static Node** addrLink(Node* n)
+{
+    return &(n->addrNext);
+}
+
+static unsigned int hashNodeAddr(Node* n)
+{
+    return hashAddr(n->c->ip, n->c->dnsPort);
+}
+
+static int matchAddr(Node* n, const void* addr)
+{
+    const struct sockaddr_in* a = (const struct sockaddr_in*) addr;
+
+    return n->c->ip.s_addr == a->sin_addr.s_addr && n->c->dnsPort == ntohs(a->sin_port);
+}
+
+/** \brief Prepares an empty index. No memory is allocated until the first insertion.
+ *
+ * \param index Index* Index to be initialized.
+ * \param link Returns the chain link used by this index inside a node.
+ * \param hashNode Hashes the key of a node.
+ *
+ */
+static void indexInit(Index* index, Node** (*link)(Node*), unsigned int (*hashNode)(Node*))
+{
+    index->table[0] = NULL;
+    index->table[1] = NULL;
+    index->size[0] = 0;
+    index->size[1] = 0;
+    index->used = 0;
+    index->rehashPos = -1;
+    index->link = link;
+    index->hashNode = hashNode;
+}
+
+/** \brief Moves a few buckets from the old table to the new one, if the index is being resized.
+ *
+ * Spreads the cost of growing the table over many operations,
+ * so that no single insertion has to rehash every node.
+ *
+ * \param index Index* Index being resized.
+ *
+ */
+static void indexRehashStep(Index* index)
+{
+    int steps;
+
+    for (steps = 0; steps < INDEX_REHASH_STEPS && index->rehashPos != -1; steps++)
+    {
+        Node* n = index->table[0][index->rehashPos];
+
+        while (n != NULL)
+        {
+            Node* next = *index->link(n);
+            unsigned int b = index->hashNode(n) & (index->size[1] - 1);
+
+            *index->link(n) = index->table[1][b];
+            index->table[1][b] = n;
+            n = next;
+        }
+
+        index->table[0][index->rehashPos] = NULL;
+        index->rehashPos++;
+
+        // Every bucket was moved, the new table takes the place of the old one
+        if (index->rehashPos == (int) index->size[0])
+        {
+            free(index->table[0]);
+            index->table[0] = index->table[1];
+            index->size[0] = index->size[1];
+            index->table[1] = NULL;
+            index->size[1] = 0;
+            index->rehashPos = -1;
+        }
+    }
+}
+
+/** \brief Inserts a node in an index. Starts growing the index when it gets full.
+ *
+ * \param index Index* Index to be updated.
+ * \param n Node* Node to be inserted. Must not be in the index already.
+ *
+ */
+static void indexInsert(Index* index, Node* n)
+{
+    if (index->table[0] == NULL)
+    {
+        index->table[0] = calloc(INDEX_INITIAL_SIZE, sizeof(Node*));
+        index->size[0] = INDEX_INITIAL_SIZE;
+    }
+
+    indexRehashStep(index);
+
+    // Load factor reached 1, start moving to a table twice as big
+    if (index->rehashPos == -1 && index->used >= index->size[0])
+    {
+        index->size[1] = index->size[0] * 2;
+        index->table[1] = calloc(index->size[1], sizeof(Node*));
+        index->rehashPos = 0;
+    }
+
+    // While rehashing, new nodes always go to the new table
+    int t = (index->rehashPos == -1) ? 0 : 1;
+    unsigned int b = index->hashNode(n) & (index->size[t] - 1);
+
+    *index->link(n) = index->table[t][b];
+    index->table[t][b] = n;
+    index->used++;
+}
+
+/** \brief Removes a node from an index.
+ *
+ * \param index Index* Index to be updated.
+ * \param n Node* Node to be removed.
+ *
+ */
+static void indexRemove(Index* index, Node* n)
+{
+    int t;
+    unsigned int hash = index->hashNode(n);
+
+    indexRehashStep(index);
+
+    for (t = 0; t < 2 && index->table[t] != NULL; t++)
+    {
+        Node** pp = &(index->table[t][hash & (index->size[t] - 1)]);
+
+        while (*pp != NULL && *pp != n)
+            pp = index->link(*pp);
+
+        if (*pp != NULL)
+        {
+            *pp = *index->link(n);
+            index->used--;
+            return;
+        }
+    }
+}
+
+/** \brief Finds a node in an index.
+ *
+ * \param index Index* Index to be searched.
+ * \param hash unsigned int Hash of the key, as hashNode would compute it.
+ * \param match Returns true if the node has the desired key.
+ * \param key const void* Key to be found, passed on to match.
+ * \return Node* The node found, or NULL if no node matches the key.
+ *
+ */
+static Node* indexFind(Index* index, unsigned int hash, int (*match)(Node*, const void*), const void* key)
+{
+    int t;
+
+    // Finds never move buckets, so that other threads can search while holding only a read lock.
+    // Insertions and removals keep the rehash going.
+    for (t = 0; t < 2 && index->table[t] != NULL; t++)
+    {
+        Node* n = index->table[t][hash & (index->size[t] - 1)];
+
+        while (n != NULL && !match(n, key))
+            n = *index->link(n);
+
+        if (n != NULL)
+            return n;
+    }
+
+    return NULL;
+}
+
+/** \brief Frees the tables of an index, leaving it empty. Does not touch the nodes.
+ *
+ * \param index Index* Index to be cleared.
+ *
+ */
+static void indexClear(Index* index)
+{
+    free(index->table[0]);
+    free(index->table[1]);
+    indexInit(index, index->link, index->hashNode);
+}
+
+/** \brief Allocates a new contact from the contact pool.
+ *
+ * Contacts that will be added to a list must be allocated with this function.
+ *
+ * \return Contact* New contact, with every field zeroed.
+ *
+ */
+Contact* newContact()
+{
+    Contact* c = (Contact*) poolAlloc(&contactPool);
+    memset((void*) c, (int) '\0', sizeof(Contact));
+
+    return c;
+}
+
+/** \brief Frees a contact allocated with newContact() that is not in any list. Releases its name.
+ *
+ * \param c Contact* Contact to be freed. May be NULL.
+ *
+ */
+void freeContact(Contact* c)
+{
+    if (c == NULL)
+        return;
+
+    clearContactName(c);
+    releaseString(c->wire);
+    poolFree(&contactPool, c);
+}
+
+/** \brief Renders the wire line of a contact, used in RPL and LST messages.
+ *
+ * \param c Contact* Contact whose fields are rendered. Any previous wire line is released.
+ *
+ */
+static void renderContact(Contact* c)
+{
+    char line[NAME_LEN + 64];
+    int rplLen, wireLen;
+
+    rplLen = snprintf(line, sizeof(line), "RPL %s;%s;%d", contactName(c), inet_ntoa(c->ip), c->talkPort);
+    wireLen = rplLen + snprintf(line + rplLen, sizeof(line) - rplLen, ";%d\n", c->dnsPort);
+
+    releaseString(c->wire);
+    c->wire = internString(line, wireLen);
+    c->wireLen = wireLen;
+    c->rplLen = rplLen;
+}
+
+/** \brief Appends bytes to the cached LST message of a list, growing it if needed.
+ */
+static void appendToListMessage(List* list, const char* bytes, int len)
+{
+    // Always keep room for the terminating empty line
+    if (list->lstLen + len + 1 > list->lstCapacity)
+    {
+        while (list->lstLen + len + 1 > list->lstCapacity)
+            list->lstCapacity *= 2;
+
+        list->lst = realloc(list->lst, list->lstCapacity);
+        if (list->lst == NULL)
+        {
+            printf("Error: out of memory.\n");
+            exit(-1);
+        }
+    }
+
+    memcpy(list->lst + list->lstLen, bytes, len);
+    list->lstLen += len;
+}
+
+/** \brief Picks a new, non-zero epoch for a list.
+ */
+static unsigned int newEpoch()
+{
+    static unsigned int counter = 0;
+    unsigned int epoch;
+
+    do
+    {
+        epoch = ((unsigned int) time(NULL) * 2654435761u) ^ ((unsigned int) getpid() << 8) ^ (++counter * 40503u);
+    } while (epoch == 0);
+
+    return epoch;
+}
+
+/** \brief Records a change in the change log of a list. Called right after the version is incremented.
+ *
+ * \param list List* List that changed.
+ * \param c Contact* Contact that was added, updated or removed.
+ * \param removed int 1 if the contact was removed.
+ *
+ */
+static void logChange(List* list, Contact* c, int removed)
+{
+    Change* change;
+
+    if (list->changesCount < CHANGE_LOG_SIZE)
+    {
+        change = &(list->changes[(list->changesFirst + list->changesCount) % CHANGE_LOG_SIZE]);
+        list->changesCount++;
+    }
+    else
+    {
+        // Full, overwrite the oldest change
+        change = &(list->changes[list->changesFirst]);
+        list->changesFirst = (list->changesFirst + 1) % CHANGE_LOG_SIZE;
+    }
+
+    change->version = list->version;
+    change->removed = removed;
+    strncpy(change->name, contactName(c), NAME_LEN - 1);
+    change->name[NAME_LEN - 1] = '\0';
+}
+
+/** \brief Gets the changes made to a list after a certain version, from its change log.
+ *
+ * \param list List* List whose changes are wanted.
+ * \param version unsigned int Version of the list the caller already knows.
+ * \param out_changes const Change** Array where pointers to the changes will be written, oldest first.
+ * \param max int Size of out_changes.
+ * \return int Number of changes. -1 if the log does not go back that far, or if there are more than max changes.
+ *
+ */
+int changesSince(List* list, unsigned int version, const Change** out_changes, int max)
+{
+    int i;
+
+    // Every increment of the version is logged, so the log covers (oldest - 1, current]
+    if (version > list->version)
+        return -1;
+
+    int n = (int) (list->version - version);
+    if (n > list->changesCount || n > max)
+        return -1;
+
+    for (i = 0; i < n; i++)
+        out_changes[i] = &(list->changes[(list->changesFirst + list->changesCount - n + i) % CHANGE_LOG_SIZE]);
+
+    return n;
+}
 
 /** \brief Creates a new, empty list.
- * Empty lists are a Node that points to NULL.
- * The "contact" of the first Node is always NULL.
- * \return Node* Header node of an empty list.
+ * Empty lists are a header that points to NULL.
+ * \return List* Header of an empty list.
  *
  */
-Node* newList()
+List* newList()
 {
-    Node* new = malloc(sizeof(Node));
+    // Pools are shared by every list, prepare them once
+    if (contactPool.objSize == 0)
+    {
+        poolInit(&contactPool, sizeof(Contact), CONTACTS_PER_SLAB);
+        poolInit(&nodePool, sizeof(Node), CONTACTS_PER_SLAB);
+    }
+
+    List* new = malloc(sizeof(List));
     new->next = NULL;
-    new->c = NULL;
+    new->length = 0;
+
+    indexInit(&(new->byName), nameLink, hashNodeName);
+    indexInit(&(new->byAddr), addrLink, hashNodeAddr);
+
+    bloomInit(&(new->filter), FILTER_INITIAL_SIZE, FILTER_HASHES);
+    new->queries = 0;
+    new->filtered = 0;
+    new->falsePositives = 0;
+
+    new->lst = malloc(LST_INITIAL_CAPACITY);
+    new->lstCapacity = LST_INITIAL_CAPACITY;
+    new->lstLen = 0;
+    new->lstStale = 0;
+    appendToListMessage(new, "LST\n", 4);
+    new->version = 0;
+
+    new->epoch = newEpoch();
+    new->changes = malloc(CHANGE_LOG_SIZE * sizeof(Change));
+    new->changesFirst = 0;
+    new->changesCount = 0;
+
+    new->snapshot = NULL;
 
     return new;
 }
 
-/** \brief Adds an already-existing dynamically allocated contact to a list.
+/** \brief Rebuilds the name filter of a list with a new size, from the contacts in the list.
+ *
+ * \param list List* List whose filter is rebuilt.
+ * \param size unsigned int New number of counters. Must be a power of 2.
+ *
+ */
+static void rebuildFilter(List* list, unsigned int size)
+{
+    Node* p;
+
+    bloomFree(&(list->filter));
+    bloomInit(&(list->filter), size, FILTER_HASHES);
+
+    for (p = list->next; p != NULL; p = p->next)
+        bloomAdd(&(list->filter), hashContactName(p->c));
+}
+
+/** \brief Adds a contact allocated with newContact() to a list.
  *
- * The contact is added in the beginning of the list.
+ * The contact is added in the beginning of the list, and indexed by its name and DNS address.
+ * Its dnsAddr field is filled in from its ip and dnsPort, and its wire line is rendered.
  *
- * \param list Node* Header of a list
+ * \param list List* Header of a list
  * \param c Contact* Contact to be added
  */
-void add(Node* list, Contact* c)
+void add(List* list, Contact* c)
 {
-    Node* newnode = malloc(sizeof(Node));
+    Node* newnode = (Node*) poolAlloc(&nodePool);
     newnode->c = c;
 
     // By default, no OKs are expected
     c->okExpected = 0;
+    setDnsAddr(c);
+    renderContact(c);
 
     // Point new node to the previously-first node
     newnode->next = list->next;
+    newnode->prev = NULL;
+    if (list->next != NULL)
+        list->next->prev = newnode;
 
     // Hook up list header to the new node
     list->next = newnode;
+    list->length++;
+
+    indexInsert(&(list->byName), newnode);
+    indexInsert(&(list->byAddr), newnode);
+
+    bloomAdd(&(list->filter), hashContactName(c));
+    if (list->filter.count * FILTER_COUNTERS_PER_NAME > (int) list->filter.size)
+        rebuildFilter(list, list->filter.size * 2);
+
+    if (!list->lstStale)
+        appendToListMessage(list, c->wire + WIRE_LST_OFFSET, c->wireLen - WIRE_LST_OFFSET);
+    list->version++;
+    logChange(list, c, 0);
+
     return;
 }
 
 /** \brief Removes a contact from the list.
  *
  * Removes a certain contact from the list. The contact is found by its name.surname.
- * This function frees the node and the contact, and assumes contact was allocated dynamically.
+ * This function frees the node and the contact, and assumes contact was allocated with newContact().
  *
  * \param list Header of a list
  * \param name Name of a contact, in the format name.surname
  *
  * \return int 0 if the removal was successful. -1 if no contact with the provided name exist in the list.
  */
-int removeFrom(Node* list, char* name)
+int removeFrom(List* list, const char* name)
 {
-    Node* p = list->next;
-    Node* prevP = list;
-
-    // Find desired contact node, and also node before it
-    while (p != NULL && strcmp(p->c->name, name) != 0)
-    {
-        prevP = p;
-        p = p->next;
-    }
+    Node* p = indexFind(&(list->byName), hashName(name), matchName, name);
 
     if (p != NULL)
     {
-        logm(1, "Removed node with contact %s.\n", p->c->name);
+        logm(1, "Removed node with contact %s.\n", contactName(p->c));
 
         // Name found, remove it
-        prevP->next = p->next;
-        free(p->c);
-        free(p);
+        indexRemove(&(list->byName), p);
+        indexRemove(&(list->byAddr), p);
+        bloomRemove(&(list->filter), hashContactName(p->c));
+
+        if (p->prev != NULL)
+            p->prev->next = p->next;
+        else
+            list->next = p->next;
+
+        if (p->next != NULL)
+            p->next->prev = p->prev;
+
+        list->length--;
+        list->lstStale = 1;
+        list->version++;
+        logChange(list, p->c, 1);
+
+        freeContact(p->c);
+        poolFree(&nodePool, p);
         return 0;
     }
 
@@ -89,17 +538,14 @@ int removeFrom(Node* list, char* name)
  *
  * Returns a pointer to the contact itself, or NULL if the contact does not exist.
  *
- * \param list Node* List to be searched.
- * \param name char* Name of the contact to be found.
+ * \param list List* List to be searched.
+ * \param name const char* Name of the contact to be found.
  * \return Contact* Pointer to the found contact, or NULL if it was not found.
  *
  */
-Contact* get(Node* list, char* name)
+Contact* get(List* list, const char* name)
 {
-    Node* p = list->next;
-
-    while (p != NULL && strcmp(p->c->name, name) != 0)
-        p = p->next;
+    Node* p = indexFind(&(list->byName), hashName(name), matchName, name);
 
     if (p != NULL)
         return p->c;
@@ -107,22 +553,109 @@ Contact* get(Node* list, char* name)
         return NULL;
 }
 
-/** \brief Finds a contact in the list by its name.
+/** \brief Finds a contact in the list by its name, answering unknown names from the name filter.
+ *
+ * Same as get(), but most names that are not in the list are rejected
+ * without touching the index. Keeps the query counters of the list.
+ *
+ * \param list List* List to be searched.
+ * \param name const char* Name of the contact to be found.
+ * \return Contact* Pointer to the found contact, or NULL if it was not found.
+ *
+ */
+Contact* queryName(List* list, const char* name)
+{
+    unsigned int hash = hashName(name);
+
+    // Query workers update the counters concurrently
+    __atomic_add_fetch(&(list->queries), 1, __ATOMIC_RELAXED);
+
+    if (!bloomMayContain(&(list->filter), hash))
+    {
+        __atomic_add_fetch(&(list->filtered), 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+
+    Node* p = indexFind(&(list->byName), hash, matchName, name);
+    if (p == NULL)
+    {
+        __atomic_add_fetch(&(list->falsePositives), 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+
+    return p->c;
+}
+
+/** \brief Gets the LST message with every contact in the list, ready to be sent.
+ *
+ * The message is cached. It is only rebuilt if contacts were removed since it was last built,
+ * and even then only the pre-rendered wire lines are copied.
+ *
+ * \param list List* List to be sent.
+ * \param out_len int* Out parameter. Length of the message.
+ * \return const char* The LST message, terminated by an empty line. Valid until the list changes.
+ *
+ */
+const char* getListMessage(List* list, int* out_len)
+{
+    if (list->lstStale)
+    {
+        Node* p;
+
+        list->lstLen = 0;
+        appendToListMessage(list, "LST\n", 4);
+
+        for (p = list->next; p != NULL; p = p->next)
+            appendToListMessage(list, p->c->wire + WIRE_LST_OFFSET, p->c->wireLen - WIRE_LST_OFFSET);
+
+        list->lstStale = 0;
+    }
+
+    // Terminate LST with an empty line. There is always room for it.
+    list->lst[list->lstLen] = '\n';
+
+    *out_len = list->lstLen + 1;
+    return list->lst;
+}
+
+/** \brief Changes the talk port of a contact in a list, keeping its wire line and the LST up to date.
+ *
+ * \param list List* List the contact is in.
+ * \param c Contact* Contact to be updated.
+ * \param talkPort int New talk port.
+ *
+ */
+void setTalkPort(List* list, Contact* c, int talkPort)
+{
+    if (c->talkPort == talkPort)
+        return;
+
+    c->talkPort = talkPort;
+    renderContact(c);
+
+    list->lstStale = 1;
+    list->version++;
+    logChange(list, c, 0);
+}
+
+/** \brief Finds a contact in the list by its DNS address.
  *
  * Returns a pointer to the contact itself, or NULL if the contact does not exist.
+ * The address index is keyed by the contact's ip and dnsPort, so it never goes stale
+ * when setDnsAddr() is called on a listed contact.
  *
- * \param list Node* List to be searched.
- * \param addr struct sockaddr_in* Address to be found. Will be compared byte by byte.
+ * \param list List* List to be searched.
+ * \param addr struct sockaddr_in* Address to be found. Only the IP and port are compared.
  * \param addrlen socklen_t Length of addr.
  * \return Contact* Pointer to the found contact, or NULL if it was not found.
  *
  */
-Contact* getByAddr(Node* list, struct sockaddr_in* addr, socklen_t addrlen)
+Contact* getByAddr(List* list, struct sockaddr_in* addr, socklen_t addrlen)
 {
-    Node* p = list->next;
+    if (addrlen < sizeof(struct sockaddr_in) || addr->sin_family != AF_INET)
+        return NULL;
 
-    while (p != NULL && memcmp(addr, &(p->c->dnsAddr), addrlen))
-        p = p->next;
+    Node* p = indexFind(&(list->byAddr), hashAddr(addr->sin_addr, ntohs(addr->sin_port)), matchAddr, addr);
 
     if (p != NULL)
         return p->c;
@@ -132,50 +665,95 @@ Contact* getByAddr(Node* list, struct sockaddr_in* addr, socklen_t addrlen)
 
 /** \brief Empties list and frees its contents (contacts).
  *
- * Assumes contacts were allocated dynamically.
- * Does NOT free the list itself (ie. the list header).
+ * Assumes contacts were allocated with newContact().
+ * If the list holds every contact and node in use, their pools and the names are reset in one go.
+ * Does NOT free the list itself (ie. the list header), but does free its index.
  *
- * \param list Node* Header of the list
+ * \param list List* Header of the list
  *
  */
-void emptyList(Node* list)
+void emptyList(List* list)
 {
-    Node* p = list -> next;
-    Node* nextp = p;
-
-    while (nextp != NULL)
+    if (list->length == nodePool.live && list->length == contactPool.live)
+    {
+        poolReset(&contactPool);
+        poolReset(&nodePool);
+        resetStrings();
+    }
+    else
     {
-        p = nextp;
-        nextp = p->next;
+        Node* p = list -> next;
+        Node* nextp = p;
 
-        // Free contact, and then node
-        free(p->c);
-        free(p);
+        while (nextp != NULL)
+        {
+            p = nextp;
+            nextp = p->next;
+
+            // Free contact, and then node
+            freeContact(p->c);
+            poolFree(&nodePool, p);
+        }
     }
 
     // Leave list marked as empty
     list->next = NULL;
+    list->length = 0;
+
+    indexClear(&(list->byName));
+    indexClear(&(list->byAddr));
+
+    bloomFree(&(list->filter));
+    bloomInit(&(list->filter), FILTER_INITIAL_SIZE, FILTER_HASHES);
+
+    list->lstLen = 0;
+    list->lstStale = 0;
+    appendToListMessage(list, "LST\n", 4);
+    list->version++;
+
+    // Versions before this point can not be brought up to date with changes anymore
+    list->epoch = newEpoch();
+    list->changesFirst = 0;
+    list->changesCount = 0;
+}
+
+/** \brief Empties a list and frees it, including its header.
+ *
+ * Its last snapshot is freed as well, so no other thread may still be reading it.
+ *
+ * \param list List* List to be freed.
+ *
+ */
+void freeList(List* list)
+{
+    emptyList(list);
+
+    bloomFree(&(list->filter));
+    free(list->lst);
+    free(list->changes);
+    free(list->snapshot);
+    free(list);
 }
 
 /** \brief Prints the contents of the list to STDOUT in a table format. Debug function.
  *
- * \param list Node* List to be printed.
+ * \param list List* List to be printed.
  *
  */
-void printList(Node* list)
+void printList(List* list)
 {
     printf("%2s   %22s  %15s  %8s  %9s\n", "No", "Name", "IP Address", "DNS Port", "Talk Port");
 
     int i;
-    for(i = 1; list->next != NULL; i++)
+    Node* n = list->next;
+    for(i = 1; n != NULL; i++, n = n->next)
     {
-        list = list->next;
-        printf("%2d:  %22s  %15s  %8d  %9d", i, list->c->name, inet_ntoa(list->c->ip), list->c->dnsPort, list->c->talkPort);
+        printf("%2d:  %22s  %15s  %8d  %9d", i, contactName(n->c), inet_ntoa(n->c->ip), n->c->dnsPort, n->c->talkPort);
 
-        if (strcmp(list->c->name, myName) == 0)
+        if (contactNameIs(n->c, myName))
             printf(" Myself");
 
-        if (nameServer != NULL && strcmp(list->c->name, nameServer->name) == 0)
+        if (n->c == nameServer)
             printf(" DNS");
 
         printf("\n");
@@ -185,6 +763,7 @@ void printList(Node* list)
 /** \brief Updates the socket dnsAddr field of a contact.
  *
  * Uses the other contact fields: ip and dnsPort.
+ * Contacts in a list are indexed by those fields, so they must not change once the contact is added.
  *
  * \param c Contact* Contact to be updated.
  *
@@ -200,11 +779,11 @@ void setDnsAddr(Contact* c)
 
 /** \brief Checks if a list has one and only one element.
  *
- * \param list Node* List to test
+ * \param list List* List to test
  * \return int 1 if the list has one and only one element. 0 otherwise.
  *
  */
-int hasOneElement(Node* list)
+int hasOneElement(List* list)
 {
-    return list->next != NULL && list->next->next == NULL;
+    return list->length == 1;
 }
@@ -2,27 +2,134 @@
 #define LIST_H_INCLUDED
 
 #include "contact.h"
+#include "pool.h"
+#include "names.h"
+#include "bloom.h"
 
 /** \brief A single node of a list of contacts.
  */
 typedef struct Node
 {
     struct Node* next;
+    struct Node* prev;
+
+    /** Next node in the same bucket of the name index. */
+    struct Node* nameNext;
+
+    /** Next node in the same bucket of the address index. */
+    struct Node* addrNext;
+
     Contact* c;
 } Node;
 
-Node* newList();
-void add(Node* list, Contact* c);
-int removeFrom(Node* list, char* name);
+/** \brief Hash table over the nodes of a list. Chains are linked through the nodes themselves.
+ *
+ * Grows incrementally: while rehashing, both tables are live and every operation
+ * moves a few buckets from the old table to the new one.
+ */
+typedef struct Index
+{
+    Node** table[2];
+    unsigned int size[2];
+    unsigned int used;
+
+    /** Next bucket of table[0] to be moved to table[1]. -1 when not rehashing. */
+    int rehashPos;
+
+    /** Returns the address of the chain link a node uses in this index. */
+    Node** (*link)(Node* n);
+
+    /** Hashes the key of a node. */
+    unsigned int (*hashNode)(Node* n);
+} Index;
+
+/** Number of changes kept in the change log of a list. */
+#define CHANGE_LOG_SIZE 256
+
+/** \brief A change to the contents of a list, kept in its change log.
+ */
+typedef struct Change
+{
+    /** Version of the list right after the change. */
+    unsigned int version;
+
+    /** 1 if the contact was removed. 0 if it was added or updated. */
+    int removed;
+
+    char name[NAME_LEN];
+} Change;
+
+/** \brief Header of a list of contacts, indexed by name.
+ *
+ * Its 'next' field points to the first node, just like a Node's,
+ * so the list can be walked with the usual list->next idiom.
+ */
+typedef struct List
+{
+    Node* next;
+    int length;
+
+    Index byName;
+
+    /** Index by DNS address (ip and dnsPort), used to match OKs to contacts. */
+    Index byAddr;
+
+    /** Filter of the names in the list, answers most queries for unknown names. */
+    Bloom filter;
+
+    /** Query counters: total, answered by the filter alone, and let through by the filter but not found. */
+    long queries;
+    long filtered;
+    long falsePositives;
+
+    /** Cached LST message: 'LST\n' followed by the wire line of every contact.
+     * Contacts are appended as they are added. Removals mark it stale, and it is
+     * rebuilt from the wire lines the next time it is needed. */
+    char* lst;
+    int lstLen;
+    int lstCapacity;
+    int lstStale;
+
+    /** Incremented whenever the contents of the list change. */
+    unsigned int version;
+
+    /** Random number, changed when versions stop being comparable: when the list is created or emptied. */
+    unsigned int epoch;
+
+    /** Ring of the last CHANGE_LOG_SIZE changes. The oldest is at changesFirst. */
+    Change* changes;
+    int changesFirst;
+    int changesCount;
+
+    /** Last snapshot published with publishSnapshot(), read by other threads. NULL until the first one. */
+    struct Snapshot* snapshot;
+} List;
+
+/** Pools all contacts and list nodes are allocated from. */
+extern Pool contactPool;
+extern Pool nodePool;
+
+Contact* newContact();
+void freeContact(Contact* c);
+
+List* newList();
+void add(List* list, Contact* c);
+int removeFrom(List* list, const char* name);
+
+Contact* get(List* list, const char* name);
+Contact* queryName(List* list, const char* name);
 
-Contact* get(Node* list, char* name);
-Contact* getByAddr(Node* list, struct sockaddr_in* addr, socklen_t addrlen);
+const char* getListMessage(List* list, int* out_len);
+int changesSince(List* list, unsigned int version, const Change** out_changes, int max);
+void setTalkPort(List* list, Contact* c, int talkPort);
+Contact* getByAddr(List* list, struct sockaddr_in* addr, socklen_t addrlen);
 
 void setDnsAddr(Contact* c);
 
-void emptyList(Node* list);
-void printList(Node* list);
+void emptyList(List* list);
+void freeList(List* list);
+void printList(List* list);
 
-int hasOneElement(Node* list);
+int hasOneElement(List* list);
 
 #endif
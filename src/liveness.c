@@ -0,0 +1,388 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "globals.h"
+#include "debug.h"
+#include "list.h"
+#include "reliable.h"
+#include "commands.h"
+#include "gossip.h"
+#include "liveness.h"
+
+/** \brief A member sent a PNG that did not answer yet.
+ */
+typedef struct Probed
+{
+    /** Full name of the member. Empty while this entry of the table is free. */
+    char name[NAME_LEN];
+
+    /** Where the PNGs go. Any datagram from there counts as an answer. */
+    struct sockaddr_in addr;
+
+    /** PNGs sent and not answered. */
+    int unanswered;
+} Probed;
+
+LivenessStats livenessStats;
+
+/** Members waiting to answer. Small enough for a linear scan. */
+static Probed probed[LIVENESS_MAX_PROBED];
+static int nProbed = 0;
+
+static Timer roundTimer;
+static Timer okTimer;
+static int timersReady = 0;
+
+static void probeRound(void* arg);
+static void okWaitOver(void* arg);
+
+/** \brief Sets up the timers, the first time they are needed.
+ */
+static void initLivenessTimers()
+{
+    if (timersReady)
+        return;
+
+    timerInit(&roundTimer, probeRound, NULL);
+    timerInit(&okTimer, okWaitOver, NULL);
+    timersReady = 1;
+}
+
+/** \brief Sends a PNG to a member.
+ */
+static void sendProbe(Probed* p)
+{
+    if (sendto(dnsSocket, "PNG", 3, 0, (struct sockaddr*) &(p->addr), sizeof(p->addr)) == -1)
+        perror("Could not send PNG");
+
+    p->unanswered++;
+    livenessStats.probes++;
+}
+
+/** \brief Gets the entry of a member being probed, by its address.
+ */
+static Probed* findProbed(struct sockaddr_in* addr)
+{
+    int i;
+
+    for (i = 0; i < LIVENESS_MAX_PROBED; i++)
+    {
+        Probed* p = &(probed[i]);
+
+        if (p->name[0] != '\0' && p->addr.sin_addr.s_addr == addr->sin_addr.s_addr && p->addr.sin_port == addr->sin_port)
+            return p;
+    }
+
+    return NULL;
+}
+
+/** \brief Frees the entry of a member being probed.
+ */
+static void forgetProbed(Probed* p)
+{
+    p->name[0] = '\0';
+    nProbed--;
+}
+
+/** \brief Forgets every member being probed.
+ */
+static void clearProbed()
+{
+    int i;
+
+    for (i = 0; i < LIVENESS_MAX_PROBED; i++)
+        probed[i].name[0] = '\0';
+    nProbed = 0;
+}
+
+/** \brief Drops a member that left too many PNGs unanswered, and tells the rest of the family.
+ *
+ * With gossip on, its leave is spread like any other. Otherwise every member is sent 'UNR name.surname',
+ * with the incarnation it joined with, if any. The member is sent the same UNR: if it is only cut off
+ * for a while, it announces itself again once it gets it.
+ * Nothing is done if the member left or moved in the meantime.
+ *
+ * \param p Probed* The member. Its entry is freed.
+ *
+ */
+static void dropMember(Probed* p)
+{
+    char buffer[NAME_LEN + 24];
+    struct sockaddr_in addrs[FANOUT_BATCH];
+    int sent[FANOUT_BATCH];
+    int n = 0;
+    Node* q;
+
+    Contact* c = get(contacts, p->name);
+
+    if (c == NULL || c == nameServer || c->dnsAddr.sin_addr.s_addr != p->addr.sin_addr.s_addr
+        || c->dnsAddr.sin_port != p->addr.sin_port)
+    {
+        forgetProbed(p);
+        return;
+    }
+
+    printf("Member %s stopped answering. Dropped it from the family.\n", p->name);
+    livenessStats.dropped++;
+
+    // Whatever we were still sending it is not going to be answered. Its own UNR replaces it
+    cancelReliableTo(&(p->addr));
+
+    if (c->incarnation != 0)
+        sprintf(buffer, "UNR %s\nINC %u", p->name, c->incarnation);
+    else
+        sprintf(buffer, "UNR %s", p->name);
+
+    if (sendReliable(buffer, &(p->addr)) == -1)
+        perror("Could not send UNR to the dropped member");
+
+    if (gossipFanout > 0)
+    {
+        spreadRumor(c, 1);
+        gossipStats.started++;
+        forgetMember(p->name);
+        forgetProbed(p);
+        return;
+    }
+
+    forgetMember(p->name);
+    forgetProbed(p);
+
+    for (q = contacts->next; q != NULL; q = q->next)
+    {
+        if (contactNameIs(q->c, myName))
+            continue;
+
+        addrs[n++] = q->c->dnsAddr;
+        if (n == FANOUT_BATCH)
+        {
+            livenessStats.told += sendReliableMany(buffer, addrs, n, sent);
+            n = 0;
+        }
+    }
+
+    if (n > 0)
+        livenessStats.told += sendReliableMany(buffer, addrs, n, sent);
+}
+
+/** \brief Timer callback. Probes a few members, as the DNS, and drops those that never answer.
+ *
+ * Members that did not answer their last PNG are sent another one. After LIVENESS_ATTEMPTS
+ * in a row they are dropped. Then LIVENESS_PROBES members picked at random are sent a first one.
+ *
+ */
+static void probeRound(void* arg)
+{
+    Contact* picked[LIVENESS_PROBES];
+    int i, j, n;
+
+    if (!isServer() || joinStatus != Joined)
+    {
+        clearProbed();
+        return;
+    }
+
+    for (i = 0; i < LIVENESS_MAX_PROBED; i++)
+    {
+        Probed* p = &(probed[i]);
+
+        if (p->name[0] == '\0')
+            continue;
+
+        if (p->unanswered == 1)
+            livenessStats.suspected++;
+
+        if (p->unanswered >= LIVENESS_ATTEMPTS)
+            dropMember(p);
+        else
+            sendProbe(p);
+    }
+
+    n = pickMembers(picked, LIVENESS_PROBES, 0);
+
+    for (i = 0; i < n && nProbed < LIVENESS_MAX_PROBED; i++)
+    {
+        if (findProbed(&(picked[i]->dnsAddr)) != NULL)
+            continue;
+
+        for (j = 0; probed[j].name[0] != '\0'; j++)
+            ;
+
+        Probed* p = &(probed[j]);
+        strncpy(p->name, contactName(picked[i]), NAME_LEN - 1);
+        p->name[NAME_LEN - 1] = '\0';
+        p->addr = picked[i]->dnsAddr;
+        p->unanswered = 0;
+        nProbed++;
+
+        sendProbe(p);
+    }
+
+    if (nProbed > 0 || contacts->length > 1)
+        timerStart(&roundTimer, LIVENESS_PERIOD_MS);
+}
+
+/** \brief As the DNS, starts probing the members, if not doing it already.
+ *
+ * Called whenever we become the DNS of a family, or someone joins it. The rounds stop
+ * by themselves once we are not the DNS anymore, or are alone.
+ *
+ */
+void watchMembers()
+{
+    initLivenessTimers();
+
+    if (!timerPending(&roundTimer))
+        timerStart(&roundTimer, LIVENESS_PERIOD_MS);
+}
+
+/** \brief Counts any datagram from a member being probed as an answer.
+ *
+ * \param addr struct sockaddr_in* Sender of a datagram received on the dnsSocket.
+ *
+ */
+void memberHeard(struct sockaddr_in* addr)
+{
+    if (nProbed == 0)
+        return;
+
+    Probed* p = findProbed(addr);
+    if (p == NULL)
+        return;
+
+    livenessStats.answered++;
+    forgetProbed(p);
+}
+
+/** \brief Handles a PNG from the DNS: says we are alive, with 'ALV'.
+ */
+void answerProbe(Message* msg, struct sockaddr_in* addr, socklen_t addrLen)
+{
+    if (sendReply("ALV", 3, addr, addrLen) == -1)
+        perror("Could not send ALV");
+}
+
+/** \brief Handles an ALV. Nothing left to do: memberHeard() took it as an answer already.
+ */
+void probeAnswered(Message* msg, struct sockaddr_in* addr, socklen_t addrLen)
+{
+    logm(2, "%s:%d is alive.\n", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port));
+}
+
+/** \brief Timer callback. Ends a join that still waits for OKs, as they may come from members that died.
+ *
+ * The REGs are still sent again to them, and their OKs still welcome. The DNS drops the dead ones by itself.
+ *
+ */
+static void okWaitOver(void* arg)
+{
+    Node* p;
+    int silent = 0;
+
+    if (joinStatus != WaitForOK)
+        return;
+
+    for (p = contacts->next; p != NULL; p = p->next)
+    {
+        if (p->c->okExpected)
+        {
+            logm(1, "No OK from %s yet.\n", contactName(p->c));
+            p->c->okExpected = 0;
+            silent++;
+        }
+    }
+
+    printf("Joined successfully. %d members did not answer yet.\n", silent);
+    livenessStats.partialJoins++;
+
+    oksExpected = 0;
+    joinStatus = Joined;
+    timerStop(&joinTimer);
+}
+
+/** \brief As a joining member, starts waiting for the OKs to our REGs, once the whole LST is in.
+ */
+void awaitOKs()
+{
+    initLivenessTimers();
+    timerStart(&okTimer, LIVENESS_OK_WAIT_MS);
+}
+
+/** \brief Tells the family we are still in it, after the DNS dropped us for leaving its PNGs unanswered.
+ *
+ * Our REG is sent again, as in a join but with a new incarnation, so that it wins over the leave
+ * spread for us. It goes to the DNS, and to gossipFanout members picked at random, who spread it,
+ * or to every member with gossip off. Their OKs acknowledge it, and nothing else waits for them.
+ *
+ * \param dnsAddr struct sockaddr_in* Address of the DNS, which sent us our own UNR.
+ *
+ */
+void announceAgain(struct sockaddr_in* dnsAddr)
+{
+    char buffer[128 + 16];
+    struct sockaddr_in addrs[FANOUT_BATCH];
+    int sent[FANOUT_BATCH];
+    Contact* picked[GOSSIP_MAX_FANOUT];
+    int i, n = 0;
+    Node* q;
+
+    printf("The DNS dropped us from the family, as we did not answer it. Telling it we are still here.\n");
+    livenessStats.announced++;
+
+    myIncarnation = newIncarnation();
+    int len = getRegMessage(buffer);
+    sprintf(buffer + len, "\nINC %u", myIncarnation);
+
+    addrs[n++] = *dnsAddr;
+
+    if (gossipFanout > 0)
+    {
+        int nPicked = pickMembers(picked, (gossipFanout < GOSSIP_MAX_FANOUT ? gossipFanout : GOSSIP_MAX_FANOUT), 0);
+
+        for (i = 0; i < nPicked; i++)
+            addrs[n++] = picked[i]->dnsAddr;
+
+        sendReliableMany(buffer, addrs, n, sent);
+        return;
+    }
+
+    for (q = contacts->next; q != NULL; q = q->next)
+    {
+        if (contactNameIs(q->c, myName) || q->c == nameServer)
+            continue;
+
+        addrs[n++] = q->c->dnsAddr;
+        if (n == FANOUT_BATCH)
+        {
+            sendReliableMany(buffer, addrs, n, sent);
+            n = 0;
+        }
+    }
+
+    if (n > 0)
+        sendReliableMany(buffer, addrs, n, sent);
+}
+
+/** \brief Stops probing, and forgets the members being probed. Called when leaving the family.
+ */
+void resetLiveness()
+{
+    clearProbed();
+
+    if (timersReady)
+    {
+        timerStop(&roundTimer);
+        timerStop(&okTimer);
+    }
+}
+
+/** \brief Prints the counters of the failure detector.
+ */
+void printLivenessStats()
+{
+    printf("Liveness:     %ld PNGs, %ld answered, %ld suspected, %ld dropped, %ld members told; %ld joins without every OK, "
+           "%ld times dropped while alive\n",
+           livenessStats.probes, livenessStats.answered, livenessStats.suspected, livenessStats.dropped,
+           livenessStats.told, livenessStats.partialJoins, livenessStats.announced);
+}
@@ -0,0 +1,57 @@
+#ifndef LIVENESS_H_INCLUDED
+#define LIVENESS_H_INCLUDED
+
+#include "server.h"
+
+/** Interval between the probe rounds of the DNS, in milliseconds. */
+#define LIVENESS_PERIOD_MS 500
+
+/** Members picked at random and sent a PNG in every round. */
+#define LIVENESS_PROBES 4
+
+/** PNGs in a row, one per round, a member may leave unanswered before it is dropped.
+ * With 15% loss each way a live member is dropped about once in 300000 probes. */
+#define LIVENESS_ATTEMPTS 10
+
+/** Most members waiting to answer a PNG at once. No new ones are probed while it is full. */
+#define LIVENESS_MAX_PROBED 32
+
+/** Time a joining member waits for the OKs to its REGs, in milliseconds, before it counts itself as joined. */
+#define LIVENESS_OK_WAIT_MS 4000
+
+/** \brief Counters of the failure detector.
+ */
+typedef struct LivenessStats
+{
+    /** PNGs sent, as the DNS, and members that answered. */
+    long probes;
+    long answered;
+
+    /** Members that did not answer their first PNG, and those dropped for not answering any. */
+    long suspected;
+    long dropped;
+
+    /** Members told about the ones dropped, with a UNR or a gossip round. */
+    long told;
+
+    /** Joins we ended before every member said OK, as the joining member. */
+    long partialJoins;
+
+    /** Times the DNS dropped us though we were alive, and we announced ourselves to the family again. */
+    long announced;
+} LivenessStats;
+
+extern LivenessStats livenessStats;
+
+void watchMembers();
+void memberHeard(struct sockaddr_in* addr);
+void awaitOKs();
+void announceAgain(struct sockaddr_in* dnsAddr);
+void resetLiveness();
+
+void answerProbe(Message* msg, struct sockaddr_in* addr, socklen_t addrLen);
+void probeAnswered(Message* msg, struct sockaddr_in* addr, socklen_t addrLen);
+
+void printLivenessStats();
+
+#endif // LIVENESS_H_INCLUDED
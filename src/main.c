@@ -1,7 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/time.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <netdb.h>
@@ -15,6 +14,10 @@ extern int errno;
 #include "list.h"
 #include "commands.h"
 #include "debug.h"
+#include "snapshot.h"
+#include "workers.h"
+#include "reactor.h"
+#include "timers.h"
 
 /**
  *  True (1) while the program runs. Set to 0 if user types 'exit'.
@@ -32,7 +35,7 @@ void sigintHandler()
 {
     logm(1, "Got Ctrl+C\n");
 
-    // Program is on select() loop - attempt to exit gracefully
+    // Program is on the main loop - attempt to exit gracefully
     if (joinStatus == Joined)
         leave();
 
@@ -61,6 +64,28 @@ void getDefaultSS(struct in_addr *a_out)
     logm(1, "Found %s at %s\n", h->h_name, inet_ntoa(*t));
 }
 
+/** \brief Reactor callback for stdin. Reads and runs one user command.
+ *
+ * \param fd int STDIN_FILENO.
+ * \param arg void* Unused.
+ *
+ */
+void readCommand(int fd, void* arg)
+{
+    static char buffer[2048];
+
+    if (fgets(buffer, 2047, stdin) == NULL)
+    {
+        // End of input: keep running on the network alone, instead of waking up for stdin forever
+        reactorRemove(reactor, fd);
+        return;
+    }
+
+    parseCommand(buffer, &isRunning);
+
+    printPrompt();
+}
+
 int main(int argc, char** argv)
 {
     #ifdef printauthor
@@ -69,7 +94,7 @@ int main(int argc, char** argv)
 
     if (argc < 3 || argc % 2 != 1)
     {
-        printf("Usage: %s name.surname IP [-t talkport] [-d dnsport] [-i saIP] [-p saport]\n", argv[0]);
+        printf("Usage: %s name.surname IP [-t talkport] [-d dnsport] [-i saIP] [-p saport] [-w queryworkers] [-g gossipfanout] [-r epoll|uring]\n", argv[0]);
         exit(-2);
     }
 
@@ -112,21 +137,49 @@ int main(int argc, char** argv)
 
         if (strcmp(argv[i], "-p") == 0)
             saPort = atoi(argv[i+1]);
+
+        if (strcmp(argv[i], "-w") == 0)
+            queryWorkers = atoi(argv[i+1]);
+
+        if (strcmp(argv[i], "-g") == 0)
+            gossipFanout = atoi(argv[i+1]);
+
+        if (strcmp(argv[i], "-r") == 0)
+        {
+            if (strcmp(argv[i+1], "uring") == 0)
+                ioBackend = ReactorUring;
+            else if (strcmp(argv[i+1], "epoll") == 0)
+                ioBackend = ReactorEpoll;
+            else
+            {
+                printf("Error on argument -r. Must be 'epoll' or 'uring'.\n");
+                exit(-2);
+            }
+        }
     }
 
     // Get default IP if it has not been set
     if (saIP.s_addr == 0)
         getDefaultSS(&saIP);
 
-    fd_set rfds;
     int ret;
-    char buffer[2048];
-    buffer[2047] = '\0';    // Ensure buffer is always null-terminated.
-    int max = 0;
 
     contacts = newList();
     talkServerSocket = prepareTalkServer();
 
+    initTimers();
+
+    // Every socket is handled by the callback it is registered with
+    reactor = newReactor(ioBackend);
+    if (reactor == NULL)
+        exit(-1);
+    logm(1, "Waiting for I/O with %s.\n", reactorName(reactor));
+
+    // Unbuffered, so that lines typed ahead stay in the kernel, where epoll can see them
+    setvbuf(stdin, NULL, _IONBF, 0);
+    reactorAdd(reactor, STDIN_FILENO, REACTOR_LEVEL, readCommand, NULL);
+    reactorAdd(reactor, talkServerSocket, REACTOR_EDGE, talkServerReadable, NULL);
+
     // Set handler the SIGINT (Ctrl+C) signal, which automatically leaves before terminating
     signal(SIGINT, sigintHandler);
 
@@ -135,46 +188,16 @@ int main(int argc, char** argv)
     // Run while in normal conditions, or while we're in the process of leaving and exiting
     while (isRunning || joinStatus != NotJoined)
     {
-        FD_ZERO(&rfds);
-        FD_SET(STDIN_FILENO, &rfds);
-        max = (STDIN_FILENO > max) ? STDIN_FILENO : max;
+        // Query workers only live as long as the dnsSocket they share the port with
+        if (dnsSocket == -1 && workersRunning())
+            stopWorkers();
 
-        // Add different sockets to rfds if they are ready to be used
+        // Query workers answer from a snapshot of the contacts, bring it up to date with the last changes
+        if (workersRunning())
+            publishSnapshot(contacts);
 
-        /* Always add the TCP server socket for starting chats
-           There's no problem if we're not even joined yet, the chats only depend on the
-           rest of the program to find the IP+port. */
-        FD_SET(talkServerSocket, &rfds);
-        max = (talkServerSocket > max) ? talkServerSocket : max;
-
-        // Chat socket, possibly open with a contact
-        if (talkSocket != -1)
-        {
-            FD_SET(talkSocket, &rfds);
-            max = (talkSocket > max) ? talkSocket : max;
-        }
-
-        // DNS socket, used to trade behind-the-scenes messages like queries, etc
-        if (dnsSocket != -1)
-        {
-            FD_SET(dnsSocket, &rfds);
-            max = (dnsSocket > max) ? dnsSocket : max;
-        }
-
-        // Set timeout if state is not stable (if we are waiting for OKs, etc)
-        struct timeval timeout;
-        struct timeval* pTimeout = NULL;
-        if ((joinStatus != Joined && joinStatus != NotJoined)
-            ||
-            (findStatus != NotFinding))
-        {
-            pTimeout = &timeout;
-            timeout.tv_sec = 10;
-            timeout.tv_usec = 0;
-        }
-
-        // Multiplex all possible inputs
-        ret = select(max + 1, &rfds, NULL, NULL, pTimeout);
+        // Wait for any input until the next deadline, and let the callbacks of the ready sockets handle it
+        ret = reactorRun(reactor, timersTimeout());
         if (ret < 0)
         {
             // If user pressed Ctrl+C (INTerRuption), don't leave the loop yet
@@ -188,64 +211,21 @@ int main(int argc, char** argv)
                     continue;
             }
 
-            perror("Error on select()");
+            perror("Error waiting for I/O");
             exit(-1);
         }
 
-        // Handle a timeout
-        if (ret == 0)
-        {
-            if (joinStatus != Joined)
-            {
-                if (joinStatus < Joined)
-                    printf("Join timed out. Aborted join. Please try again.\n");
-                else
-                    printf("Leave timed out. Forced leave.\n");
-                    logm(1, "Other members' state may be inconsistent. Sent UNR to Surname Server just in case.\n");
-
-                abortJoin();
-            }
-
-            if (findStatus != NotFinding)
-            {
-                findStatus = NotFinding;
-                printf("Find timed out. Find cancelled.\n");
-            }
-        }
-
-        // Read user commands from stdin
-        if (FD_ISSET(STDIN_FILENO, &rfds))
-        {
-            fgets(buffer, 2047, stdin);
-            parseCommand(buffer, &isRunning);
-
-            printPrompt();
-        }
-
-        // Read messages from current call
-        if (talkSocket != -1 && FD_ISSET(talkSocket, &rfds))
-        {
-            receiveMessage(buffer);
-        }
-
-        // Accept an imcoming call from the Call Server
-        if (talkServerSocket != -1 && FD_ISSET(talkServerSocket, &rfds))
-        {
-            acceptCall();
-        }
-
-        // Handle a query or reply on the DNS
-        if (dnsSocket != -1 && FD_ISSET(dnsSocket, &rfds))
-        {
-            parseServerCommand(&isRunning);
-        }
+        // Join, leave and find handle their own deadlines
+        runTimers();
     }
 
+    stopWorkers();
+
     // Loop ends when user wants to close program
 
     // Free memory
-    emptyList(contacts);
-    free(contacts);
+    freeList(contacts);
+    freeReactor(reactor);
 
     logm(1, "Exiting gracefully.\n");
     exit(0);
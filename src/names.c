@@ -0,0 +1,300 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+#include "names.h"
+
+/** Number of buckets of the string table when it is first used. Must be a power of 2. */
+#define STRINGS_INITIAL_SIZE 64
+
+/** Number of static buffers contactName() rotates through. */
+#define NAME_BUFFERS 4
+
+/** \brief An interned string, shared by everyone who interned the same characters.
+ */
+typedef struct String
+{
+    struct String* next;
+    unsigned int hash;
+
+    /** Number of times this string was interned and not yet released. */
+    int refs;
+
+    char chars[];
+} String;
+
+static String** table = NULL;
+static unsigned int tableSize = 0;
+
+/** Number of distinct strings currently interned, and the memory they take. */
+int internedStrings = 0;
+size_t internedBytes = 0;
+
+/** FNV-1a, split in steps so a name can be hashed in pieces. */
+#define FNV_START 2166136261u
+
+static unsigned int hashStep(unsigned int h, const char* s, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++)
+    {
+        h ^= (unsigned char) s[i];
+        h *= 16777619u;
+    }
+
+    return h;
+}
+
+/** \brief Doubles the string table, or creates it.
+ */
+static void growTable()
+{
+    unsigned int newSize = (tableSize == 0) ? STRINGS_INITIAL_SIZE : tableSize * 2;
+    String** newTable = calloc(newSize, sizeof(String*));
+    unsigned int i;
+
+    for (i = 0; i < tableSize; i++)
+    {
+        String* s = table[i];
+
+        while (s != NULL)
+        {
+            String* next = s->next;
+            s->next = newTable[s->hash & (newSize - 1)];
+            newTable[s->hash & (newSize - 1)] = s;
+            s = next;
+        }
+    }
+
+    free(table);
+    table = newTable;
+    tableSize = newSize;
+}
+
+/** \brief Gets the shared copy of a string, creating it if needed.
+ *
+ * Every call must be matched by a call to releaseString().
+ *
+ * \param s const char* Characters of the string. Need not be null-terminated.
+ * \param len size_t Number of characters.
+ * \return const char* Null-terminated shared copy. Must not be modified.
+ *
+ */
+const char* internString(const char* s, size_t len)
+{
+    unsigned int hash = hashStep(FNV_START, s, len);
+    String* str;
+
+    if (tableSize != 0)
+    {
+        for (str = table[hash & (tableSize - 1)]; str != NULL; str = str->next)
+        {
+            if (str->hash == hash && strncmp(str->chars, s, len) == 0 && str->chars[len] == '\0')
+            {
+                str->refs++;
+                return str->chars;
+            }
+        }
+    }
+
+    if ((unsigned int) internedStrings >= tableSize)
+        growTable();
+
+    str = malloc(sizeof(String) + len + 1);
+    if (str == NULL)
+    {
+        printf("Error: out of memory.\n");
+        exit(-1);
+    }
+
+    memcpy(str->chars, s, len);
+    str->chars[len] = '\0';
+    str->hash = hash;
+    str->refs = 1;
+
+    str->next = table[hash & (tableSize - 1)];
+    table[hash & (tableSize - 1)] = str;
+
+    internedStrings++;
+    internedBytes += sizeof(String) + len + 1;
+
+    return str->chars;
+}
+
+/** \brief Releases a string gotten from internString(). Frees it when nobody else uses it.
+ *
+ * \param s const char* Interned string. May be NULL.
+ *
+ */
+void releaseString(const char* s)
+{
+    if (s == NULL)
+        return;
+
+    String* str = (String*) (s - offsetof(String, chars));
+
+    if (--str->refs > 0)
+        return;
+
+    String** pp = &(table[str->hash & (tableSize - 1)]);
+    while (*pp != str)
+        pp = &((*pp)->next);
+
+    *pp = str->next;
+
+    internedStrings--;
+    internedBytes -= sizeof(String) + strlen(str->chars) + 1;
+    free(str);
+}
+
+/** \brief Frees every interned string at once, no matter how many references it has.
+ *
+ * Any pointer gotten from internString() becomes invalid.
+ *
+ */
+void resetStrings()
+{
+    unsigned int i;
+
+    for (i = 0; i < tableSize; i++)
+    {
+        String* s = table[i];
+
+        while (s != NULL)
+        {
+            String* next = s->next;
+            free(s);
+            s = next;
+        }
+
+        table[i] = NULL;
+    }
+
+    internedStrings = 0;
+    internedBytes = 0;
+}
+
+/** \brief Sets the name of a contact, interning its given name and surname separately.
+ *
+ * Contacts of the same family share the same copy of the surname.
+ * Any previous name of the contact is released.
+ *
+ * \param c Contact* Contact to be updated.
+ * \param fullName const char* Name in the format name.surname.
+ * \return int 0 on success. -1 if the name does not have a '.surname'.
+ *
+ */
+int setContactName(Contact* c, const char* fullName)
+{
+    const char* dot = strchr(fullName, '.');
+
+    if (dot == NULL)
+        return -1;
+
+    clearContactName(c);
+
+    c->givenName = internString(fullName, dot - fullName);
+    c->surname = internString(dot + 1, strlen(dot + 1));
+
+    return 0;
+}
+
+/** \brief Releases the name of a contact. The contact is left without a name.
+ *
+ * \param c Contact* Contact whose name is released.
+ *
+ */
+void clearContactName(Contact* c)
+{
+    releaseString(c->givenName);
+    releaseString(c->surname);
+
+    c->givenName = NULL;
+    c->surname = NULL;
+}
+
+/** \brief Gets the full name of a contact, in the format name.surname.
+ *
+ * Like inet_ntoa(), the name is written to a static buffer. There are a few buffers used in turn,
+ * so it is safe to use a handful of names in the same printf().
+ *
+ * \param c const Contact* Contact.
+ * \return const char* Full name of the contact. Overwritten by later calls.
+ *
+ */
+const char* contactName(const Contact* c)
+{
+    static char buffers[NAME_BUFFERS][NAME_LEN];
+    static int next = 0;
+
+    char* buffer = buffers[next];
+    next = (next + 1) % NAME_BUFFERS;
+
+    if (c->givenName == NULL)
+        buffer[0] = '\0';
+    else
+        snprintf(buffer, NAME_LEN, "%s.%s", c->givenName, c->surname);
+
+    return buffer;
+}
+
+/** \brief Checks if a contact has a certain name, without building its full name.
+ *
+ * \param c const Contact* Contact.
+ * \param name const char* Name in the format name.surname.
+ * \return int True (not 0) if the contact has that name.
+ *
+ */
+int contactNameIs(const Contact* c, const char* name)
+{
+    if (c->givenName == NULL)
+        return 0;
+
+    size_t givenLen = strlen(c->givenName);
+
+    return strncmp(c->givenName, name, givenLen) == 0
+           && name[givenLen] == '.'
+           && strcmp(c->surname, name + givenLen + 1) == 0;
+}
+
+/** \brief Checks if two contacts have the same name.
+ *
+ * Interned strings are unique, so this just compares pointers.
+ *
+ * \return int True (not 0) if both contacts have the same name.
+ *
+ */
+int sameName(const Contact* a, const Contact* b)
+{
+    return a->givenName == b->givenName && a->surname == b->surname;
+}
+
+/** \brief Hashes a name in the format name.surname.
+ *
+ * \param name const char* Name to be hashed.
+ * \return unsigned int Hash of the name. Same as hashContactName() of a contact with that name.
+ *
+ */
+unsigned int hashName(const char* name)
+{
+    return hashStep(FNV_START, name, strlen(name));
+}
+
+/** \brief Hashes the full name of a contact, without building it.
+ *
+ * \param c const Contact* Contact to be hashed.
+ * \return unsigned int Hash of the full name. Same as hashName() of that name.
+ *
+ */
+unsigned int hashContactName(const Contact* c)
+{
+    unsigned int h = FNV_START;
+
+    h = hashStep(h, c->givenName, strlen(c->givenName));
+    h = hashStep(h, ".", 1);
+    h = hashStep(h, c->surname, strlen(c->surname));
+
+    return h;
+}
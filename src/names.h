@@ -0,0 +1,25 @@
+#ifndef NAMES_H_INCLUDED
+#define NAMES_H_INCLUDED
+
+#include <stddef.h>
+
+#include "contact.h"
+
+const char* internString(const char* s, size_t len);
+void releaseString(const char* s);
+void resetStrings();
+
+extern int internedStrings;
+extern size_t internedBytes;
+
+int setContactName(Contact* c, const char* fullName);
+void clearContactName(Contact* c);
+
+const char* contactName(const Contact* c);
+int contactNameIs(const Contact* c, const char* name);
+int sameName(const Contact* a, const Contact* b);
+
+unsigned int hashName(const char* name);
+unsigned int hashContactName(const Contact* c);
+
+#endif // NAMES_H_INCLUDED
@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pool.h"
+
+/** Objects are aligned to this many bytes. */
+#define POOL_ALIGN 8
+
+/** \brief Prepares an empty pool. No memory is allocated until the first poolAlloc().
+ *
+ * \param pool Pool* Pool to be initialized.
+ * \param objSize size_t Size of each object.
+ * \param perSlab int Number of objects allocated at once when the pool runs out.
+ *
+ */
+void poolInit(Pool* pool, size_t objSize, int perSlab)
+{
+    // Free objects store the free list link in themselves
+    if (objSize < sizeof(void*))
+        objSize = sizeof(void*);
+
+    pool->objSize = (objSize + POOL_ALIGN - 1) / POOL_ALIGN * POOL_ALIGN;
+    pool->perSlab = perSlab;
+    pool->slabs = NULL;
+    pool->current = NULL;
+    pool->cursor = 0;
+    pool->freeList = NULL;
+    pool->live = 0;
+    pool->highWater = 0;
+    pool->nSlabs = 0;
+}
+
+/** \brief Allocates one object from the pool.
+ *
+ * Reuses freed objects first, then unused objects of the existing slabs.
+ * Only allocates a new slab when every slab is in use. Exits if out of memory.
+ *
+ * \param pool Pool* Pool to allocate from.
+ * \return void* The new object. Its contents are undefined.
+ *
+ */
+void* poolAlloc(Pool* pool)
+{
+    void* obj;
+
+    if (pool->freeList != NULL)
+    {
+        obj = pool->freeList;
+        pool->freeList = *((void**) obj);
+    }
+    else
+    {
+        // Current slab is full (or there is none): move on to the next one
+        if (pool->current == NULL || pool->cursor == pool->perSlab)
+        {
+            Slab* next = (pool->current == NULL) ? pool->slabs : pool->current->next;
+
+            if (next == NULL)
+            {
+                next = malloc(sizeof(Slab));
+                next->objects = (next != NULL) ? malloc(pool->objSize * pool->perSlab) : NULL;
+                if (next == NULL || next->objects == NULL)
+                {
+                    printf("Error: out of memory.\n");
+                    exit(-1);
+                }
+
+                next->next = NULL;
+                if (pool->current == NULL)
+                    pool->slabs = next;
+                else
+                    pool->current->next = next;
+
+                pool->nSlabs++;
+            }
+
+            pool->current = next;
+            pool->cursor = 0;
+        }
+
+        obj = pool->current->objects + pool->objSize * pool->cursor;
+        pool->cursor++;
+    }
+
+    pool->live++;
+    if (pool->live > pool->highWater)
+        pool->highWater = pool->live;
+
+    return obj;
+}
+
+/** \brief Returns one object to the pool.
+ *
+ * \param pool Pool* Pool the object was allocated from.
+ * \param obj void* Object to be freed. May be NULL.
+ *
+ */
+void poolFree(Pool* pool, void* obj)
+{
+    if (obj == NULL)
+        return;
+
+    *((void**) obj) = pool->freeList;
+    pool->freeList = obj;
+    pool->live--;
+}
+
+/** \brief Frees every object of the pool at once.
+ *
+ * The slabs are kept and will be reused by later allocations.
+ * Any pointer to an object of this pool becomes invalid.
+ *
+ * \param pool Pool* Pool to be reset.
+ *
+ */
+void poolReset(Pool* pool)
+{
+    pool->current = NULL;
+    pool->cursor = 0;
+    pool->freeList = NULL;
+    pool->live = 0;
+}
+
+/** \brief Frees every object of the pool and gives its slabs back to the system.
+ *
+ * \param pool Pool* Pool to be released.
+ *
+ */
+void poolRelease(Pool* pool)
+{
+    Slab* s = pool->slabs;
+
+    while (s != NULL)
+    {
+        Slab* next = s->next;
+        free(s->objects);
+        free(s);
+        s = next;
+    }
+
+    poolInit(pool, pool->objSize, pool->perSlab);
+}
@@ -0,0 +1,50 @@
+#ifndef POOL_H_INCLUDED
+#define POOL_H_INCLUDED
+
+#include <stddef.h>
+
+/** \brief A block of memory holding many objects of the same size.
+ */
+typedef struct Slab
+{
+    struct Slab* next;
+    char* objects;
+} Slab;
+
+/** \brief Allocator for many small objects of the same size.
+ *
+ * Objects are carved out of slabs. Freed objects go to a free list and are reused first.
+ * poolReset() frees every object at once, keeping the slabs for later use.
+ */
+typedef struct Pool
+{
+    size_t objSize;
+    int perSlab;
+
+    /** All slabs ever allocated, in order. */
+    Slab* slabs;
+
+    /** Slab currently being carved, and index of its next unused object. */
+    Slab* current;
+    int cursor;
+
+    /** Objects freed one by one, reused before carving new ones. */
+    void* freeList;
+
+    /** Number of objects allocated and not yet freed. */
+    int live;
+
+    /** Highest value 'live' ever reached. */
+    int highWater;
+
+    /** Number of slabs allocated. */
+    int nSlabs;
+} Pool;
+
+void poolInit(Pool* pool, size_t objSize, int perSlab);
+void* poolAlloc(Pool* pool);
+void poolFree(Pool* pool, void* obj);
+void poolReset(Pool* pool);
+void poolRelease(Pool* pool);
+
+#endif // POOL_H_INCLUDED
@@ -0,0 +1,531 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include "debug.h"
+#include "uring.h"
+#include "reactor.h"
+
+/** Largest number of events handled per call to reactorRun(). */
+#define REACTOR_EVENTS 64
+
+/** \brief What the reactor does for a registered descriptor.
+ */
+typedef enum
+{
+    /** Calls a ReactorCallback when the descriptor is readable. */
+    HandlerReady,
+
+    /** Receives datagrams itself and hands them to a ReactorDatagramCallback. */
+    HandlerDatagrams,
+
+    /** Reads a stream itself and hands the bytes to a ReactorStreamCallback. */
+    HandlerStream
+} HandlerKind;
+
+/** \brief Callback registered for a file descriptor.
+ */
+typedef struct Handler
+{
+    HandlerKind kind;
+    int flags;
+
+    ReactorCallback ready;
+    ReactorDatagramCallback datagram;
+    ReactorBatchCallback batchEnd;
+    ReactorStreamCallback stream;
+    void* arg;
+
+    /** 1 while the descriptor is registered. */
+    int registered;
+
+    /** Changed whenever the descriptor is registered, so that events for an old registration are dropped. */
+    unsigned int generation;
+} Handler;
+
+/** \brief An event loop: the descriptors it watches, with their callbacks, and the backend that waits for them.
+ */
+struct Reactor
+{
+    ReactorBackend backend;
+
+    int epollFd;
+    Uring* uring;
+
+    /** Handlers, indexed by file descriptor. */
+    Handler* handlers;
+    int handlersSize;
+};
+
+/** \brief Creates a reactor.
+ *
+ * If io_uring is asked for but the kernel (or the build) does not support it, falls back to epoll.
+ *
+ * \param backend ReactorBackend Backend wanted.
+ * \return Reactor* The reactor, or NULL on error.
+ *
+ */
+Reactor* newReactor(ReactorBackend backend)
+{
+    Reactor* r = calloc(1, sizeof(Reactor));
+    if (r == NULL)
+        return NULL;
+
+    r->epollFd = -1;
+
+    if (backend == ReactorUring)
+    {
+        r->uring = uringOpen();
+        if (r->uring != NULL)
+        {
+            r->backend = ReactorUring;
+            return r;
+        }
+
+        printf("io_uring not available (%s). Using epoll.\n", strerror(errno));
+    }
+
+    r->backend = ReactorEpoll;
+    r->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (r->epollFd == -1)
+    {
+        perror("Could not create epoll instance");
+        free(r);
+        return NULL;
+    }
+
+    return r;
+}
+
+/** \brief Frees a reactor. Registered descriptors are not closed.
+ */
+void freeReactor(Reactor* r)
+{
+    if (r == NULL)
+        return;
+
+    if (r->epollFd != -1)
+        close(r->epollFd);
+    uringClose(r->uring);
+
+    free(r->handlers);
+    free(r);
+}
+
+/** \brief Gets the backend a reactor ended up with.
+ */
+ReactorBackend reactorBackend(Reactor* r)
+{
+    return r->backend;
+}
+
+/** \brief Gets the name of the backend of a reactor, for prints.
+ */
+const char* reactorName(Reactor* r)
+{
+    return (r->backend == ReactorUring) ? "io_uring" : "epoll";
+}
+
+/** \brief Gets the handler of a descriptor, growing the table if needed.
+ *
+ * \return Handler* The handler, or NULL if out of memory.
+ *
+ */
+static Handler* handlerFor(Reactor* r, int fd)
+{
+    if (fd >= r->handlersSize)
+    {
+        int newSize = (r->handlersSize == 0) ? 64 : r->handlersSize;
+        while (newSize <= fd)
+            newSize *= 2;
+
+        Handler* grown = realloc(r->handlers, newSize * sizeof(Handler));
+        if (grown == NULL)
+        {
+            printf("Could not allocate memory for reactor handlers.\n");
+            return NULL;
+        }
+
+        memset((void*) (grown + r->handlersSize), (int) '\0', (newSize - r->handlersSize) * sizeof(Handler));
+        r->handlers = grown;
+        r->handlersSize = newSize;
+    }
+
+    return &(r->handlers[fd]);
+}
+
+/** \brief Identifies a registration in the events of the backend.
+ */
+static unsigned long long eventKey(int fd, unsigned int generation)
+{
+    return ((unsigned long long) generation << 32) | (unsigned int) fd;
+}
+
+/** \brief Arms the io_uring request that watches a registered descriptor.
+ *
+ * \return int 0 on success, -1 on error.
+ *
+ */
+static int armUring(Reactor* r, int fd, Handler* h)
+{
+    unsigned long long key = eventKey(fd, h->generation);
+
+    switch (h->kind)
+    {
+        case HandlerDatagrams: return uringRecvmsg(r->uring, fd, key);
+        case HandlerStream: return uringRecv(r->uring, fd, key);
+        default: return uringPoll(r->uring, fd, !(h->flags & REACTOR_EDGE), key);
+    }
+}
+
+/** \brief Registers a descriptor with a handler filled in by the caller.
+ *
+ * \return int 0 on success, -1 on error.
+ *
+ */
+static int registerHandler(Reactor* r, int fd, Handler* h)
+{
+    // Replacing a registration: the old one must not report anything anymore
+    if (h->registered)
+        reactorRemove(r, fd);
+
+    h->generation++;
+
+    if (r->backend == ReactorUring)
+    {
+        if (armUring(r, fd, h) == -1)
+        {
+            printf("Could not register file descriptor %d in reactor: ring full.\n", fd);
+            return -1;
+        }
+    }
+    else
+    {
+        struct epoll_event ev;
+        memset((void*) &ev, (int) '\0', sizeof(ev));
+        ev.events = EPOLLIN | ((h->flags & REACTOR_EDGE) ? EPOLLET : 0);
+        ev.data.u64 = eventKey(fd, h->generation);
+
+        int ret = epoll_ctl(r->epollFd, EPOLL_CTL_ADD, fd, &ev);
+
+        // Closing a descriptor drops it from epoll, so a stale registration may still be there
+        if (ret == -1 && errno == EEXIST)
+            ret = epoll_ctl(r->epollFd, EPOLL_CTL_MOD, fd, &ev);
+
+        if (ret == -1)
+        {
+            perror("Could not register file descriptor in reactor");
+            return -1;
+        }
+    }
+
+    h->registered = 1;
+    logm(2, "Reactor: registered fd %d on %s.\n", fd, reactorName(r));
+    return 0;
+}
+
+/** \brief Registers a file descriptor, to have callback called when it becomes readable.
+ *
+ * \param r Reactor* The reactor.
+ * \param fd int File descriptor. Edge-triggered ones should be read without blocking.
+ * \param flags int REACTOR_EDGE or REACTOR_LEVEL.
+ * \param callback ReactorCallback Called with fd and arg when fd is readable, or on error or hang up.
+ * \param arg void* Passed to callback.
+ * \return int 0 on success, -1 on error.
+ *
+ */
+int reactorAdd(Reactor* r, int fd, int flags, ReactorCallback callback, void* arg)
+{
+    if (fd < 0)
+        return -1;
+
+    Handler* h = handlerFor(r, fd);
+    if (h == NULL)
+        return -1;
+
+    Handler new = *h;
+    new.kind = HandlerReady;
+    new.flags = flags;
+    new.ready = callback;
+    new.arg = arg;
+
+    *h = new;
+    return registerHandler(r, fd, h);
+}
+
+/** \brief Registers a UDP socket whose datagrams the reactor receives itself.
+ *
+ * Only backends that receive into their own buffers support this. The others return -1
+ * without printing anything, and the caller should use reactorAdd() and receive by itself.
+ *
+ * \param r Reactor* The reactor.
+ * \param fd int UDP socket.
+ * \param callback ReactorDatagramCallback Called with every datagram received.
+ * \param batchEnd ReactorBatchCallback Called after the datagrams received in one wait. May be NULL.
+ * \param arg void* Passed to both callbacks.
+ * \return int 0 on success, -1 if not supported or on error.
+ *
+ */
+int reactorAddDatagrams(Reactor* r, int fd, ReactorDatagramCallback callback, ReactorBatchCallback batchEnd, void* arg)
+{
+    if (fd < 0 || r->backend != ReactorUring)
+        return -1;
+
+    Handler* h = handlerFor(r, fd);
+    if (h == NULL)
+        return -1;
+
+    h->kind = HandlerDatagrams;
+    h->flags = REACTOR_EDGE;
+    h->datagram = callback;
+    h->batchEnd = batchEnd;
+    h->arg = arg;
+
+    return registerHandler(r, fd, h);
+}
+
+/** \brief Registers a stream socket whose bytes the reactor reads itself.
+ *
+ * Only backends that receive into their own buffers support this. The others return -1
+ * without printing anything, and the caller should use reactorAdd() and read by itself.
+ *
+ * \param r Reactor* The reactor.
+ * \param fd int TCP socket.
+ * \param callback ReactorStreamCallback Called with every read, and once more when the stream ends.
+ * \param arg void* Passed to callback.
+ * \return int 0 on success, -1 if not supported or on error.
+ *
+ */
+int reactorAddStream(Reactor* r, int fd, ReactorStreamCallback callback, void* arg)
+{
+    if (fd < 0 || r->backend != ReactorUring)
+        return -1;
+
+    Handler* h = handlerFor(r, fd);
+    if (h == NULL)
+        return -1;
+
+    h->kind = HandlerStream;
+    h->flags = REACTOR_EDGE;
+    h->stream = callback;
+    h->arg = arg;
+
+    return registerHandler(r, fd, h);
+}
+
+/** \brief Unregisters a file descriptor. Must be called before the descriptor is closed.
+ *
+ * Pending events for the descriptor are dropped, even if they were already returned by the backend.
+ *
+ * \param r Reactor* The reactor.
+ * \param fd int File descriptor. Ignored if not registered.
+ *
+ */
+void reactorRemove(Reactor* r, int fd)
+{
+    if (fd < 0 || fd >= r->handlersSize || !r->handlers[fd].registered)
+        return;
+
+    if (r->backend == ReactorUring)
+        uringCancel(r->uring, fd);
+    else
+        epoll_ctl(r->epollFd, EPOLL_CTL_DEL, fd, NULL);
+
+    r->handlers[fd].registered = 0;
+    r->handlers[fd].generation++;
+}
+
+/** \brief Finds the handler an event is for.
+ *
+ * \return Handler* The handler, or NULL if the registration the event was for is gone.
+ *
+ */
+static Handler* handlerOfEvent(Reactor* r, unsigned long long key, int* out_fd)
+{
+    int fd = (int) (key & 0xFFFFFFFF);
+    unsigned int generation = (unsigned int) (key >> 32);
+
+    *out_fd = fd;
+
+    // A previous callback may have unregistered this descriptor, or closed it and opened another
+    if (fd >= r->handlersSize || !r->handlers[fd].registered || r->handlers[fd].generation != generation)
+        return NULL;
+
+    return &(r->handlers[fd]);
+}
+
+/** \brief Waits with epoll, and calls the callbacks of the ready descriptors.
+ */
+static int runEpoll(Reactor* r, int timeoutMs)
+{
+    struct epoll_event events[REACTOR_EVENTS];
+    int i, fd;
+
+    int n = epoll_wait(r->epollFd, events, REACTOR_EVENTS, timeoutMs);
+    if (n <= 0)
+        return n;
+
+    for (i = 0; i < n; i++)
+    {
+        Handler* h = handlerOfEvent(r, events[i].data.u64, &fd);
+        if (h != NULL)
+            h->ready(fd, h->arg);
+    }
+
+    return n;
+}
+
+/** \brief Handles a completion of a stream receive.
+ */
+static void streamEvent(Reactor* r, int fd, Handler* h, UringEvent* ev)
+{
+    if (ev->res > 0)
+    {
+        ev->buffer[ev->res] = '\0';
+        h->stream(fd, ev->buffer, ev->res, h->arg);
+        return;
+    }
+
+    if (ev->res == -ENOBUFS || ev->res == -ECANCELED)
+        return;
+
+    // Peer closed the connection, or it failed
+    ReactorStreamCallback callback = h->stream;
+    void* arg = h->arg;
+
+    reactorRemove(r, fd);
+    callback(fd, NULL, (ev->res == 0) ? 0 : -1, arg);
+}
+
+/** \brief Waits with io_uring, and hands out whatever the kernel received or reported ready.
+ */
+static int runUring(Reactor* r, int timeoutMs)
+{
+    UringEvent events[REACTOR_EVENTS];
+    int batched[REACTOR_EVENTS];
+    unsigned int batchedGeneration[REACTOR_EVENTS];
+    int nBatched = 0;
+    int i, j, fd;
+
+    int n = uringWait(r->uring, timeoutMs, events, REACTOR_EVENTS);
+    if (n <= 0)
+        return n;
+
+    for (i = 0; i < n; i++)
+    {
+        UringEvent* ev = &(events[i]);
+        Handler* h = handlerOfEvent(r, ev->userData, &fd);
+
+        if (h != NULL)
+        {
+            unsigned int generation = h->generation;
+
+            switch (h->kind)
+            {
+                case HandlerDatagrams:
+                {
+                    struct sockaddr_in addr;
+                    socklen_t addrLen;
+                    int len;
+                    char* data = uringDatagram(ev, &len, &addr, &addrLen);
+
+                    if (data != NULL)
+                    {
+                        for (j = 0; j < nBatched && batched[j] != fd; j++)
+                            ;
+                        if (j == nBatched)
+                        {
+                            batched[nBatched] = fd;
+                            batchedGeneration[nBatched++] = generation;
+                        }
+
+                        h->datagram(data, len, &addr, addrLen, h->arg);
+                    }
+                    else if (ev->res < 0 && ev->res != -ENOBUFS && ev->res != -ECANCELED)
+                        printf("Receive on fd %d failed: %s\n", fd, strerror(-ev->res));
+                    break;
+                }
+
+                case HandlerStream:
+                    streamEvent(r, fd, h, ev);
+                    break;
+
+                default:
+                    if (ev->res >= 0)
+                        h->ready(fd, h->arg);
+                    break;
+            }
+
+            // Multishot requests stop when out of buffers or on some errors. Arm them again if still wanted.
+            h = handlerOfEvent(r, ev->userData, &fd);
+            if (h != NULL && !ev->more)
+                armUring(r, fd, h);
+        }
+
+        uringReleaseBuffer(r->uring, ev->bufferId);
+    }
+
+    for (j = 0; j < nBatched; j++)
+    {
+        Handler* h = handlerOfEvent(r, eventKey(batched[j], batchedGeneration[j]), &fd);
+        if (h != NULL && h->batchEnd != NULL)
+            h->batchEnd(h->arg);
+    }
+
+    return n;
+}
+
+/** \brief Waits for registered descriptors to be ready, and calls their callbacks.
+ *
+ * \param r Reactor* The reactor.
+ * \param timeoutMs int Longest wait, in milliseconds. -1 to wait forever.
+ * \return int Number of events handled. 0 on timeout, -1 on error (errno is set, EINTR included).
+ *
+ */
+int reactorRun(Reactor* r, int timeoutMs)
+{
+    if (r->backend == ReactorUring)
+        return runUring(r, timeoutMs);
+    else
+        return runEpoll(r, timeoutMs);
+}
+
+/** \brief Sends datagrams with as few system calls as the backend allows. Same contract as sendmmsg().
+ *
+ * \param r Reactor* The reactor.
+ * \param fd int UDP socket. Need not be registered.
+ * \param msgs struct mmsghdr* Messages.
+ * \param n int Number of messages.
+ * \return int Number of messages sent, or -1 if the first one failed (errno is set).
+ *
+ */
+int reactorSendmmsg(Reactor* r, int fd, struct mmsghdr* msgs, int n)
+{
+    if (r->backend == ReactorUring)
+        return uringSendmmsg(r->uring, fd, msgs, n);
+    else
+        return sendmmsg(fd, msgs, n, 0);
+}
+
+/** \brief Sends bytes on a stream socket. Same contract as send().
+ *
+ * \param r Reactor* The reactor.
+ * \param fd int TCP socket. Need not be registered.
+ * \param data const void* Bytes to send.
+ * \param len int Number of bytes.
+ * \return int Bytes sent, or -1 on error (errno is set).
+ *
+ */
+int reactorSend(Reactor* r, int fd, const void* data, int len)
+{
+    if (r->backend == ReactorUring)
+        return uringSend(r->uring, fd, data, len);
+    else
+        return send(fd, data, len, 0);
+}
@@ -0,0 +1,64 @@
+#ifndef REACTOR_H_INCLUDED
+#define REACTOR_H_INCLUDED
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+struct mmsghdr;
+
+/** \brief Called by the reactor when a registered file descriptor is ready.
+ *
+ * Edge-triggered descriptors are only reported again after new data arrives,
+ * so their callbacks must read until the read would block.
+ */
+typedef void (*ReactorCallback)(int fd, void* arg);
+
+/** \brief Called by the reactor with a datagram it received on a registered socket.
+ *
+ * data is null-terminated, may be overwritten, and is only valid during the call.
+ */
+typedef void (*ReactorDatagramCallback)(char* data, int len, struct sockaddr_in* addr, socklen_t addrLen, void* arg);
+
+/** \brief Called by the reactor after a run of ReactorDatagramCallback calls.
+ */
+typedef void (*ReactorBatchCallback)(void* arg);
+
+/** \brief Called by the reactor with bytes it read from a registered stream socket.
+ *
+ * data is null-terminated and only valid during the call. len is 0 when the peer closed
+ * the connection, or -1 on error. The descriptor is unregistered in both cases.
+ */
+typedef void (*ReactorStreamCallback)(int fd, char* data, int len, void* arg);
+
+/** Flags for reactorAdd(). */
+#define REACTOR_LEVEL 0
+#define REACTOR_EDGE 1
+
+/** \brief Ways of waiting for I/O.
+ */
+typedef enum
+{
+    /** Readiness with epoll. The callbacks do the reads. */
+    ReactorEpoll,
+
+    /** io_uring. Datagrams and stream data are received into buffers the kernel picks from a ring. */
+    ReactorUring
+} ReactorBackend;
+
+typedef struct Reactor Reactor;
+
+Reactor* newReactor(ReactorBackend backend);
+void freeReactor(Reactor* r);
+ReactorBackend reactorBackend(Reactor* r);
+const char* reactorName(Reactor* r);
+
+int reactorAdd(Reactor* r, int fd, int flags, ReactorCallback callback, void* arg);
+int reactorAddDatagrams(Reactor* r, int fd, ReactorDatagramCallback callback, ReactorBatchCallback batchEnd, void* arg);
+int reactorAddStream(Reactor* r, int fd, ReactorStreamCallback callback, void* arg);
+void reactorRemove(Reactor* r, int fd);
+int reactorRun(Reactor* r, int timeoutMs);
+
+int reactorSendmmsg(Reactor* r, int fd, struct mmsghdr* msgs, int n);
+int reactorSend(Reactor* r, int fd, const void* data, int len);
+
+#endif // REACTOR_H_INCLUDED
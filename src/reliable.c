@@ -0,0 +1,813 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "globals.h"
+#include "debug.h"
+#include "timers.h"
+#include "reactor.h"
+#include "reliable.h"
+
+/** Buckets of the peer table and of the table of requests seen. Must be powers of 2. */
+#define PEER_BUCKETS 256
+#define SEEN_BUCKETS 256
+
+/** Requests received whose replies are remembered, for duplicates. The oldest is forgotten first. */
+#define SEEN_MAX 256
+
+/** Most bytes of replies remembered for one request. A LST in its most chunks, of about 40000 contacts. */
+#define SEEN_REPLY_MAX (2 * 1024 * 1024)
+
+/** Bytes first allocated for the replies of a request. Doubled as they grow. */
+#define SEEN_REPLY_MIN 512
+
+/** Most bytes of replies remembered for all requests. The replies of the oldest requests are forgotten first. */
+#define SEEN_BYTES_MAX (8 * 1024 * 1024)
+
+struct Peer;
+
+/** \brief A request sent and not acknowledged yet.
+ */
+typedef struct Pending
+{
+    struct Pending* next;
+    struct Peer* peer;
+
+    unsigned int id;
+
+    /** When it was last sent, in microseconds. */
+    long long sentUs;
+
+    /** Times it was sent again. Its RTT is not measured if more than 0 (Karn's algorithm). */
+    int retransmits;
+
+    /** Wait before the next retransmission, doubled after each one. */
+    int rtoMs;
+    Timer timer;
+
+    int len;
+    char data[];
+} Pending;
+
+/** \brief What we know about a peer we send requests to.
+ */
+typedef struct Peer
+{
+    struct Peer* next;
+
+    struct in_addr ip;
+    unsigned short port;
+
+    /** Smoothed RTT and its mean deviation, in microseconds. srttUs is 0 until the first measure. */
+    long srttUs;
+    long rttvarUs;
+
+    /** Requests sent to this peer and not acknowledged, oldest first. */
+    Pending* head;
+    Pending* tail;
+} Peer;
+
+/** \brief A request received, and the replies we sent to it.
+ */
+typedef struct Seen
+{
+    struct Seen* next;
+
+    struct in_addr ip;
+    unsigned short port;
+    unsigned int id;
+
+    /** Replies, each as its length (an unsigned short) followed by its bytes, and the bytes allocated for them. */
+    char* replies;
+    int repliesLen;
+    int repliesSize;
+
+    /** 0 if the replies did not fit in SEEN_REPLY_MAX, or were forgotten to make room. Duplicates are then dropped. */
+    int complete;
+} Seen;
+
+ReliableStats reliableStats;
+
+static Peer* peers[PEER_BUCKETS];
+static Seen* seenBuckets[SEEN_BUCKETS];
+
+/** Requests seen, in the order they were received, as a ring. */
+static Seen* seenRing[SEEN_MAX];
+static int seenNext = 0;
+
+/** Bytes allocated for the replies of all requests seen. */
+static long seenBytes = 0;
+
+/** Request being handled, whose replies are being recorded. NULL if none. */
+static Seen* recording = NULL;
+
+/** Id and sender of the request being handled. Single-line replies to it echo the id. */
+static int answering = 0;
+static unsigned int answeringId;
+static struct sockaddr_in answeringAddr;
+
+/** Id of the next request sent. */
+static unsigned int nextId = 0;
+
+/** \brief Hashes a peer address. The buckets are taken from the low bits, so the high ones are folded into them:
+ * those of a product depend on every byte of the address, but its low ones only on the first byte, the same in a subnet.
+ */
+static unsigned int addrHash(struct in_addr ip, unsigned short port)
+{
+    unsigned int h = (ip.s_addr ^ (port * 40503u)) * 2654435761u;
+    return h ^ (h >> 16);
+}
+
+/** \brief Finds the entry of a peer, creating it if asked to.
+ *
+ * \return Peer* The peer, or NULL if not found (or out of memory).
+ *
+ */
+static Peer* findPeer(struct sockaddr_in* addr, int create)
+{
+    Peer** bucket = &(peers[addrHash(addr->sin_addr, addr->sin_port) & (PEER_BUCKETS - 1)]);
+    Peer* p;
+
+    for (p = *bucket; p != NULL; p = p->next)
+        if (p->ip.s_addr == addr->sin_addr.s_addr && p->port == addr->sin_port)
+            return p;
+
+    if (!create)
+        return NULL;
+
+    p = calloc(1, sizeof(Peer));
+    if (p == NULL)
+        return NULL;
+
+    p->ip = addr->sin_addr;
+    p->port = addr->sin_port;
+    p->next = *bucket;
+    *bucket = p;
+
+    return p;
+}
+
+/** \brief Gets the retransmission timeout of a peer, from its RTT: SRTT + 4 * RTTVAR, like TCP.
+ */
+static int peerRto(Peer* p)
+{
+    if (p->srttUs == 0)
+        return RTO_INITIAL_MS;
+
+    int rtoMs = (p->srttUs + 4 * p->rttvarUs) / 1000;
+
+    if (rtoMs < RTO_MIN_MS)
+        return RTO_MIN_MS;
+    if (rtoMs > RTO_MAX_MS)
+        return RTO_MAX_MS;
+    return rtoMs;
+}
+
+/** \brief Updates the RTT estimate of a peer with a new measure (Jacobson/Karels).
+ */
+static void measureRtt(Peer* p, long rttUs)
+{
+    if (p->srttUs == 0)
+    {
+        p->srttUs = rttUs;
+        p->rttvarUs = rttUs / 2;
+    }
+    else
+    {
+        long err = rttUs - p->srttUs;
+
+        // Gains of 1/8 and 1/4
+        p->srttUs += err / 8;
+        p->rttvarUs += ((err < 0 ? -err : err) - p->rttvarUs) / 4;
+    }
+
+    if (p->srttUs < 1)
+        p->srttUs = 1;
+
+    logm(2, "RTT to %s:%d: %ld us, srtt %ld us, rttvar %ld us, rto %d ms.\n",
+         inet_ntoa(p->ip), ntohs(p->port), rttUs, p->srttUs, p->rttvarUs, peerRto(p));
+}
+
+/** \brief Takes the oldest pending request of a peer off its queue.
+ */
+static Pending* popPending(Peer* p)
+{
+    Pending* r = p->head;
+    if (r == NULL)
+        return NULL;
+
+    p->head = r->next;
+    if (p->head == NULL)
+        p->tail = NULL;
+
+    timerStop(&(r->timer));
+    return r;
+}
+
+/** \brief Takes a pending request off the queue of its peer, wherever it is.
+ */
+static void unlinkPending(Pending* r)
+{
+    Peer* p = r->peer;
+    Pending** link = &(p->head);
+    Pending* prev = NULL;
+
+    while (*link != NULL && *link != r)
+    {
+        prev = *link;
+        link = &((*link)->next);
+    }
+
+    if (*link == NULL)
+        return;
+
+    *link = r->next;
+    if (p->tail == r)
+        p->tail = prev;
+}
+
+/** \brief Timer callback of a pending request. Sends it again, or gives up on it.
+ */
+static void retransmit(void* arg)
+{
+    Pending* r = (Pending*) arg;
+    Peer* p = r->peer;
+    struct sockaddr_in addr;
+
+    memset((void*) &addr, (int) '\0', sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr = p->ip;
+    addr.sin_port = p->port;
+
+    if (r->retransmits == MAX_RETRANSMITS || dnsSocket == -1)
+    {
+        logm(1, "No reply from %s:%d to request %u. Giving up on it.\n", inet_ntoa(p->ip), ntohs(p->port), r->id);
+        reliableStats.abandoned++;
+        unlinkPending(r);
+        free(r);
+        return;
+    }
+
+    r->retransmits++;
+    reliableStats.retransmits++;
+    logm(1, "Sending request %u to %s:%d again (%d).\n", r->id, inet_ntoa(p->ip), ntohs(p->port), r->retransmits);
+
+    if (sendto(dnsSocket, r->data, r->len, 0, (struct sockaddr*) &addr, sizeof(addr)) == -1)
+        perror("Could not send request again");
+
+    // Exponential backoff, as the RTT we know may be too short
+    r->rtoMs *= 2;
+    if (r->rtoMs > RTO_MAX_MS)
+        r->rtoMs = RTO_MAX_MS;
+
+    r->sentUs = nowUs();
+    timerStart(&(r->timer), r->rtoMs);
+}
+
+/** \brief Makes a request to a peer, with an id of its own, ready to be sent.
+ *
+ * \param msgLen int Length of msg, without a final '\n'.
+ * \return Pending* The request, or NULL if out of memory.
+ *
+ */
+static Pending* newPending(const char* msg, int msgLen, struct sockaddr_in* addr)
+{
+    Peer* p = findPeer(addr, 1);
+    Pending* r = (p != NULL) ? malloc(sizeof(Pending) + msgLen + 32) : NULL;
+    if (r == NULL)
+        return NULL;
+
+    // Ids start at a random point, so that a restarted user is not taken for its old self
+    if (nextId == 0)
+        nextId = (unsigned int) (nowUs() ^ getpid()) | 1;
+
+    r->next = NULL;
+    r->peer = p;
+    r->id = nextId++;
+    r->retransmits = 0;
+    r->rtoMs = peerRto(p);
+    r->len = sprintf(r->data, "%.*s\nID %u", msgLen, msg, r->id);
+
+    return r;
+}
+
+/** \brief Queues a request that was just sent, and starts its retransmission timer.
+ */
+static void queuePending(Pending* r)
+{
+    Peer* p = r->peer;
+
+    reliableStats.sent++;
+    r->sentUs = nowUs();
+    timerInit(&(r->timer), retransmit, r);
+    timerStart(&(r->timer), r->rtoMs);
+
+    if (p->tail != NULL)
+        p->tail->next = r;
+    else
+        p->head = r;
+    p->tail = r;
+}
+
+/** \brief Sends a request on the dnsSocket, and sends it again until the peer replies.
+ *
+ * A line 'ID n' is added to the request, so that the peer can tell it apart from a
+ * retransmission. The peer echoes it in its reply, which acknowledges that very request,
+ * with ackReliableId(). Replies without an id acknowledge the oldest one, with ackReliable().
+ *
+ * \param msg const char* Request. Lines after its first one go before the id line. A final '\n' is dropped.
+ * \param addr struct sockaddr_in* Peer.
+ * \return int Number of bytes sent, or -1 on error, like sendto().
+ *
+ */
+int sendReliable(const char* msg, struct sockaddr_in* addr)
+{
+    int msgLen = strlen(msg);
+    if (msgLen > 0 && msg[msgLen - 1] == '\n')
+        msgLen--;
+
+    Pending* r = newPending(msg, msgLen, addr);
+    if (r == NULL)
+    {
+        printf("Could not allocate memory for a request. Sending it once.\n");
+        return sendto(dnsSocket, msg, msgLen, 0, (struct sockaddr*) addr, sizeof(*addr));
+    }
+
+    reliableStats.sendCalls++;
+    int ret = sendto(dnsSocket, r->data, r->len, 0, (struct sockaddr*) addr, sizeof(*addr));
+    if (ret == -1)
+    {
+        free(r);
+        return -1;
+    }
+
+    queuePending(r);
+    return ret;
+}
+
+/** \brief Sends the same request to many peers, with as few sendmmsg() calls as possible, like sendReliable() each.
+ *
+ * Each copy gets an id of its own, and is sent again until its peer replies.
+ * A copy that could not be sent is reported in out_sent, and is not sent again.
+ *
+ * \param msg const char* Request. Lines after its first one go before the id line. A final '\n' is dropped.
+ * \param addrs struct sockaddr_in* Peers.
+ * \param n int Number of peers.
+ * \param out_sent int* Where 1 is written for every peer the request was sent to, and 0 for the others.
+ * \return int Number of peers the request was sent to.
+ *
+ */
+int sendReliableMany(const char* msg, struct sockaddr_in* addrs, int n, int* out_sent)
+{
+    struct mmsghdr msgs[FANOUT_BATCH];
+    struct iovec iovs[FANOUT_BATCH];
+    Pending* batch[FANOUT_BATCH];
+    int i, start, total = 0;
+
+    int msgLen = strlen(msg);
+    if (msgLen > 0 && msg[msgLen - 1] == '\n')
+        msgLen--;
+
+    for (start = 0; start < n; start += FANOUT_BATCH)
+    {
+        int count = (n - start < FANOUT_BATCH) ? n - start : FANOUT_BATCH;
+        int sent = 0;
+
+        memset((void*) msgs, (int) '\0', sizeof(msgs[0]) * count);
+
+        for (i = 0; i < count; i++)
+        {
+            out_sent[start + i] = 0;
+            batch[i] = newPending(msg, msgLen, &(addrs[start + i]));
+
+            // Out of memory: sent once, without an id, as sendReliable() does
+            iovs[i].iov_base = (batch[i] != NULL) ? batch[i]->data : (void*) msg;
+            iovs[i].iov_len = (batch[i] != NULL) ? batch[i]->len : msgLen;
+
+            msgs[i].msg_hdr.msg_iov = &(iovs[i]);
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_name = &(addrs[start + i]);
+            msgs[i].msg_hdr.msg_namelen = sizeof(addrs[start + i]);
+        }
+
+        while (sent < count)
+        {
+            int ret = reactorSendmmsg(reactor, dnsSocket, msgs + sent, count - sent);
+            reliableStats.sendCalls++;
+
+            if (ret == -1)
+            {
+                // The first unsent one failed. Skip it and go on with the rest
+                logm(1, "Could not send request to %s:%d.\n",
+                     inet_ntoa(addrs[start + sent].sin_addr), ntohs(addrs[start + sent].sin_port));
+                free(batch[sent]);
+                batch[sent] = NULL;
+                sent++;
+                continue;
+            }
+
+            for (i = sent; i < sent + ret; i++)
+            {
+                out_sent[start + i] = 1;
+                total++;
+
+                if (batch[i] != NULL)
+                    queuePending(batch[i]);
+            }
+
+            sent += ret;
+        }
+    }
+
+    return total;
+}
+
+/** \brief Acknowledges the oldest pending request to a peer, after a reply from it that carries no id.
+ *
+ * \param addr struct sockaddr_in* Sender of the reply.
+ *
+ */
+void ackReliable(struct sockaddr_in* addr)
+{
+    Peer* p = findPeer(addr, 0);
+    if (p == NULL)
+        return;
+
+    Pending* r = popPending(p);
+    if (r == NULL)
+        return;
+
+    // Replies to retransmitted requests could be to any of the copies
+    if (r->retransmits == 0)
+        measureRtt(p, nowUs() - r->sentUs);
+
+    free(r);
+}
+
+/** \brief Acknowledges the pending request to a peer that a reply names, by the id it echoes.
+ *
+ * Replies to requests already acknowledged, such as replies to retransmissions, are ignored.
+ *
+ * \param addr struct sockaddr_in* Sender of the reply.
+ * \param id unsigned int Id in the 'ID n' line of the reply.
+ *
+ */
+void ackReliableId(struct sockaddr_in* addr, unsigned int id)
+{
+    Peer* p = findPeer(addr, 0);
+    Pending* r;
+
+    if (p == NULL)
+        return;
+
+    for (r = p->head; r != NULL && r->id != id; r = r->next)
+        ;
+
+    if (r == NULL)
+        return;
+
+    unlinkPending(r);
+    timerStop(&(r->timer));
+
+    if (r->retransmits == 0)
+        measureRtt(p, nowUs() - r->sentUs);
+
+    free(r);
+}
+
+/** \brief Stops sending the pending requests to a peer.
+ *
+ * \param addr struct sockaddr_in* Peer.
+ *
+ */
+void cancelReliableTo(struct sockaddr_in* addr)
+{
+    Peer* p = findPeer(addr, 0);
+    Pending* r;
+
+    if (p == NULL)
+        return;
+
+    while ((r = popPending(p)) != NULL)
+        free(r);
+}
+
+/** \brief Stops sending the pending requests of one kind to a peer. The others are still sent.
+ *
+ * \param addr struct sockaddr_in* Peer.
+ * \param opcode const char* Start of the requests to drop, such as "DNS ".
+ *
+ */
+void cancelReliableRequests(struct sockaddr_in* addr, const char* opcode)
+{
+    Peer* p = findPeer(addr, 0);
+    Pending** link;
+    Pending* prev = NULL;
+    int len = strlen(opcode);
+
+    if (p == NULL)
+        return;
+
+    link = &(p->head);
+    while (*link != NULL)
+    {
+        Pending* r = *link;
+
+        if (strncmp(r->data, opcode, len) != 0)
+        {
+            prev = r;
+            link = &(r->next);
+            continue;
+        }
+
+        *link = r->next;
+        if (p->tail == r)
+            p->tail = prev;
+
+        timerStop(&(r->timer));
+        free(r);
+    }
+}
+
+/** \brief Checks if a request of one kind to a peer is still being sent, not acknowledged nor given up on.
+ *
+ * \param addr struct sockaddr_in* Peer.
+ * \param opcode const char* Start of the requests to look for, such as "DNS ".
+ * \return int 1 if there is one.
+ *
+ */
+int reliablePending(struct sockaddr_in* addr, const char* opcode)
+{
+    Peer* p = findPeer(addr, 0);
+    Pending* r;
+    int len = strlen(opcode);
+
+    if (p == NULL)
+        return 0;
+
+    for (r = p->head; r != NULL; r = r->next)
+        if (strncmp(r->data, opcode, len) == 0)
+            return 1;
+
+    return 0;
+}
+
+/** \brief Gets the smoothed RTT measured to a peer.
+ *
+ * \param addr struct sockaddr_in* Peer.
+ * \return long RTT in microseconds, or -1 if it was never measured.
+ *
+ */
+long measuredRtt(struct sockaddr_in* addr)
+{
+    Peer* p = findPeer(addr, 0);
+
+    return (p != NULL && p->srttUs > 0) ? p->srttUs : -1;
+}
+
+/** \brief Checks if a request was received before. If so, sends the same replies again.
+ *
+ * Otherwise, starts recording the replies to it, until endRequest().
+ *
+ * \param id unsigned int Id of the request, from its 'ID n' line.
+ * \param addr struct sockaddr_in* Sender.
+ * \param addrLen socklen_t Length of addr.
+ * \return int 1 if the request is a duplicate and must not be handled again, 0 otherwise.
+ *
+ */
+int receiveRequest(unsigned int id, struct sockaddr_in* addr, socklen_t addrLen)
+{
+    Seen** bucket = &(seenBuckets[(addrHash(addr->sin_addr, addr->sin_port) ^ id) & (SEEN_BUCKETS - 1)]);
+    Seen* s;
+
+    for (s = *bucket; s != NULL; s = s->next)
+    {
+        if (s->id != id || s->ip.s_addr != addr->sin_addr.s_addr || s->port != addr->sin_port)
+            continue;
+
+        reliableStats.duplicates++;
+
+        if (!s->complete)
+        {
+            logm(1, "Request %u from %s received again. Its replies were not kept, ignoring it.\n", id, inet_ntoa(addr->sin_addr));
+            return 1;
+        }
+
+        logm(1, "Request %u from %s received again. Sending the same replies.\n", id, inet_ntoa(addr->sin_addr));
+        reliableStats.replayed++;
+
+        int offset = 0;
+        while (offset < s->repliesLen)
+        {
+            unsigned short len;
+            memcpy(&len, s->replies + offset, sizeof(len));
+            offset += sizeof(len);
+
+            if (sendto(dnsSocket, s->replies + offset, len, 0, (struct sockaddr*) addr, addrLen) == -1)
+                perror("Could not send reply again");
+            offset += len;
+        }
+
+        return 1;
+    }
+
+    // Forget the oldest request seen to make room
+    Seen* old = seenRing[seenNext];
+    if (old != NULL)
+    {
+        Seen** link = &(seenBuckets[(addrHash(old->ip, old->port) ^ old->id) & (SEEN_BUCKETS - 1)]);
+        while (*link != old)
+            link = &((*link)->next);
+        *link = old->next;
+
+        seenBytes -= old->repliesSize;
+        free(old->replies);
+        free(old);
+        seenRing[seenNext] = NULL;
+    }
+
+    s = calloc(1, sizeof(Seen));
+    answering = 1;
+    answeringId = id;
+    answeringAddr = *addr;
+
+    if (s == NULL)
+        return 0;
+
+    s->ip = addr->sin_addr;
+    s->port = addr->sin_port;
+    s->id = id;
+    s->complete = 1;
+    s->next = *bucket;
+    *bucket = s;
+
+    seenRing[seenNext] = s;
+    seenNext = (seenNext + 1) % SEEN_MAX;
+
+    recording = s;
+    return 0;
+}
+
+/** \brief Writes the 'ID n' line that a reply to the request being handled ends with.
+ *
+ * \param addr struct sockaddr_in* Destination of the reply.
+ * \param out_line char* Where '\nID n' is written. At least REPLY_ID_LEN bytes.
+ * \return int Length of the line written. 0 if the reply is not to the sender of a request being handled.
+ *
+ */
+int replyIdLine(struct sockaddr_in* addr, char* out_line)
+{
+    if (!answering || answeringAddr.sin_addr.s_addr != addr->sin_addr.s_addr || answeringAddr.sin_port != addr->sin_port)
+        return 0;
+
+    return sprintf(out_line, "\nID %u", answeringId);
+}
+
+/** \brief Forgets the replies to a request seen. Its duplicates are dropped from then on.
+ */
+static void forgetReplies(Seen* s)
+{
+    seenBytes -= s->repliesSize;
+    free(s->replies);
+    s->replies = NULL;
+    s->repliesLen = 0;
+    s->repliesSize = 0;
+    s->complete = 0;
+}
+
+/** \brief Forgets the replies of the oldest requests seen, other than the one being recorded, until some bytes fit.
+ *
+ * \param needed long Bytes to make room for.
+ * \return int 1 if they fit in SEEN_BYTES_MAX now.
+ *
+ */
+static int makeRoomForReplies(long needed)
+{
+    int i;
+
+    for (i = 0; i < SEEN_MAX && seenBytes + needed > SEEN_BYTES_MAX; i++)
+    {
+        Seen* old = seenRing[(seenNext + i) % SEEN_MAX];
+
+        if (old != NULL && old != recording && old->replies != NULL)
+            forgetReplies(old);
+    }
+
+    return seenBytes + needed <= SEEN_BYTES_MAX;
+}
+
+/** \brief Remembers a reply to the request being handled, if it goes to the sender of the request.
+ *
+ * The memory for the replies grows by doubling, so that the chunks of a big LST are copied only a few times.
+ *
+ * \param iov const struct iovec* Pieces of the reply.
+ * \param iovLen int Number of pieces.
+ * \param addr struct sockaddr_in* Destination of the reply.
+ *
+ */
+void recordReply(const struct iovec* iov, int iovLen, struct sockaddr_in* addr)
+{
+    Seen* s = recording;
+    int i, len = 0;
+
+    if (s == NULL || !s->complete || s->ip.s_addr != addr->sin_addr.s_addr || s->port != addr->sin_port)
+        return;
+
+    for (i = 0; i < iovLen; i++)
+        len += iov[i].iov_len;
+
+    int needed = s->repliesLen + (int) sizeof(unsigned short) + len;
+    if (needed > SEEN_REPLY_MAX)
+    {
+        forgetReplies(s);
+        return;
+    }
+
+    if (needed > s->repliesSize)
+    {
+        int size = (s->repliesSize > 0) ? s->repliesSize : SEEN_REPLY_MIN;
+        while (size < needed)
+            size *= 2;
+        if (size > SEEN_REPLY_MAX)
+            size = SEEN_REPLY_MAX;
+
+        char* grown = makeRoomForReplies(size - s->repliesSize) ? realloc(s->replies, size) : NULL;
+        if (grown == NULL)
+        {
+            forgetReplies(s);
+            return;
+        }
+
+        seenBytes += size - s->repliesSize;
+        s->replies = grown;
+        s->repliesSize = size;
+    }
+
+    unsigned short shortLen = len;
+    memcpy(s->replies + s->repliesLen, &shortLen, sizeof(shortLen));
+    s->repliesLen += sizeof(shortLen);
+
+    for (i = 0; i < iovLen; i++)
+    {
+        memcpy(s->replies + s->repliesLen, iov[i].iov_base, iov[i].iov_len);
+        s->repliesLen += iov[i].iov_len;
+    }
+}
+
+/** \brief Stops recording the replies to the request being handled.
+ */
+void endRequest()
+{
+    recording = NULL;
+    answering = 0;
+}
+
+/** \brief Forgets every pending request, RTT estimate and request seen. Called once we are not joined anymore.
+ */
+void resetReliable()
+{
+    int i;
+
+    for (i = 0; i < PEER_BUCKETS; i++)
+    {
+        while (peers[i] != NULL)
+        {
+            Peer* p = peers[i];
+            Pending* r;
+
+            while ((r = popPending(p)) != NULL)
+                free(r);
+
+            peers[i] = p->next;
+            free(p);
+        }
+    }
+
+    for (i = 0; i < SEEN_MAX; i++)
+    {
+        if (seenRing[i] != NULL)
+        {
+            free(seenRing[i]->replies);
+            free(seenRing[i]);
+            seenRing[i] = NULL;
+        }
+    }
+
+    memset((void*) seenBuckets, (int) '\0', sizeof(seenBuckets));
+    seenBytes = 0;
+    recording = NULL;
+    answering = 0;
+}
+
+/** \brief Prints the counters of the reliability layer. Debug function.
+ */
+void printReliableStats()
+{
+    printf("Requests:     %ld sent in %ld system calls, %ld retransmissions, %ld given up; %ld duplicates received, %ld answered again\n",
+           reliableStats.sent, reliableStats.sendCalls, reliableStats.retransmits, reliableStats.abandoned,
+           reliableStats.duplicates, reliableStats.replayed);
+}
@@ -0,0 +1,59 @@
+#ifndef RELIABLE_H_INCLUDED
+#define RELIABLE_H_INCLUDED
+
+#include <sys/uio.h>
+#include <arpa/inet.h>
+
+/** RTO of a peer with no RTT measured yet, in milliseconds. */
+#define RTO_INITIAL_MS 500
+
+/** Bounds of the RTO, in milliseconds. */
+#define RTO_MIN_MS 100
+#define RTO_MAX_MS 4000
+
+/** Most copies of a request sendReliableMany() sends with one system call. */
+#define FANOUT_BATCH 256
+
+/** Most bytes of the '\nID n' line that replies to a request end with. */
+#define REPLY_ID_LEN 16
+
+/** Times a request is sent again before giving up on it. The deadline of the operation takes over then. */
+#define MAX_RETRANSMITS 5
+
+/** \brief Counters of the reliability layer.
+ */
+typedef struct ReliableStats
+{
+    /** Requests sent, times they were sent again, and requests given up on. */
+    long sent;
+    long retransmits;
+
+    /** System calls the requests were first sent with. Less than sent when sent with sendReliableMany(). */
+    long sendCalls;
+    long abandoned;
+
+    /** Requests received again, and how many of those were answered from the reply cache. */
+    long duplicates;
+    long replayed;
+} ReliableStats;
+
+extern ReliableStats reliableStats;
+
+int sendReliable(const char* msg, struct sockaddr_in* addr);
+int sendReliableMany(const char* msg, struct sockaddr_in* addrs, int n, int* out_sent);
+void ackReliable(struct sockaddr_in* addr);
+void ackReliableId(struct sockaddr_in* addr, unsigned int id);
+void cancelReliableTo(struct sockaddr_in* addr);
+void cancelReliableRequests(struct sockaddr_in* addr, const char* opcode);
+int reliablePending(struct sockaddr_in* addr, const char* opcode);
+long measuredRtt(struct sockaddr_in* addr);
+void resetReliable();
+
+int receiveRequest(unsigned int id, struct sockaddr_in* addr, socklen_t addrLen);
+int replyIdLine(struct sockaddr_in* addr, char* out_line);
+void recordReply(const struct iovec* iov, int iovLen, struct sockaddr_in* addr);
+void endRequest();
+
+void printReliableStats();
+
+#endif // RELIABLE_H_INCLUDED
@@ -1,3 +1,5 @@
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -6,99 +8,581 @@
 #include <sys/socket.h>
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 extern int errno;
 
 #include "globals.h"
 #include "server.h"
 #include "debug.h"
+#include "reactor.h"
+#include "uring.h"
+#include "reliable.h"
+#include "finds.h"
+#include "cache.h"
+#include "gossip.h"
+#include "handover.h"
+#include "standby.h"
+#include "liveness.h"
+
+/** Largest number of datagrams received, and of replies sent, in one system call. */
+#define BATCH_MAX 64
+
+/** Largest reply that can be queued for a batched send. Bigger replies are sent right away. */
+#define REPLY_MAX 256
+
+/** \brief A reply waiting to be sent at the end of a batch.
+ */
+typedef struct Reply
+{
+    char data[REPLY_MAX];
+    int len;
+    struct sockaddr_in addr;
+    socklen_t addrLen;
+} Reply;
+
+/** Replies queued while a batch of datagrams is being handled. */
+static Reply outbox[BATCH_MAX];
+static int outboxCount = 0;
+
+/** True while a batch of received datagrams is being handled. */
+static int batching = 0;
+
+BatchStats batchStats;
+
+/** Most chunks a LST may be split into. */
+#define LST_MAX_CHUNKS 1024
+
+/** Largest LST chunk. Datagrams are received into 2048-byte buffers. */
+#define LST_CHUNK_MAX 2047
+
+/** Bytes taken by the IP and UDP headers of a datagram. */
+#define UDP_IP_HEADERS 28
 
-/** Contact who was requested to become the new DNS. Used during leave by the current DNS. */
-Node* potentialDnsNode = NULL;
+/** Path MTU assumed when the kernel does not know it. */
+#define DEFAULT_MTU 1500
 
-/** \brief Parses a message on the dnsSocket (Given Name Server).
+/** Chunks of the LST received so far during join, and the sequence number of the last one (-1 if unknown). */
+static char lstSeen[LST_MAX_CHUNKS];
+static int lstChunksReceived = 0;
+static int lstLastChunk = -1;
+
+/** REGs sent to the members in the LST during join. */
+static int lstRegsSent = 0;
+
+/** \brief Sends a reply on the dnsSocket.
  *
- * Checks the first word of the message and calls the appropriate handler.
+ * While a batch of datagrams is being handled, the reply is queued instead,
+ * and sent with all the others when the batch ends.
+ * A reply of one line to a request sent with sendReliable() echoes its id, as an 'ID n' line.
+ *
+ * \param msg const char* Reply to be sent.
+ * \param len int Length of the reply.
+ * \param addr struct sockaddr_in* Destination.
+ * \param addrLen socklen_t Length of addr.
+ * \return int Number of bytes sent or queued, or -1 on error, like sendto().
  *
  */
-void parseServerCommand()
+int sendReply(const char* msg, int len, struct sockaddr_in* addr, socklen_t addrLen)
 {
-    int ret;
-    char buffer[2048];
-    char cmd[16];
+    char tagged[REPLY_MAX + REPLY_ID_LEN];
 
-    // Receive message from DNS socket
-    struct sockaddr_in addr;
-    memset((void*)&addr, (int)'\0', sizeof(addr));
-    socklen_t addrLen = sizeof(addr);
-
-    ret = recvfrom(dnsSocket, buffer, 2047, 0, (struct sockaddr*) &addr, &addrLen);
-    if (ret == -1)
+    // Not a LST: those are acknowledged by the requester once complete
+    if (len <= REPLY_MAX && memchr(msg, '\n', len) == NULL)
     {
-        perror("Error: could not receive message on dnsSocket");
-        return;
+        int idLen = replyIdLine(addr, tagged + len);
+        if (idLen > 0)
+        {
+            memcpy(tagged, msg, len);
+            msg = tagged;
+            len += idLen;
+        }
     }
 
-    // Always terminate the buffer with \0. This will never overwrite the received message.
-    buffer[ret] = '\0';
-    logm(2, "Received from %s: %s\n", inet_ntoa(addr.sin_addr), buffer);
+    struct iovec iov = { (void*) msg, len };
+
+    // Kept in case the request is received again
+    recordReply(&iov, 1, addr);
 
-    // Parse command (first word)
-    ret = sscanf(buffer, "%15s", cmd);
-    if (ret != 1)
+    if (!batching || len > REPLY_MAX || outboxCount == BATCH_MAX || addrLen > sizeof(struct sockaddr_in))
     {
-        printf("DNS Server got malformed message.\n");
-        return;
+        batchStats.replies++;
+        batchStats.sendCalls++;
+        return sendto(dnsSocket, msg, len, 0, (struct sockaddr*) addr, addrLen);
     }
 
-    // Switch command and call respective handler function
-    if (strcmp("QRY", cmd) == 0)
+    Reply* r = &(outbox[outboxCount++]);
+    memcpy(r->data, msg, len);
+    r->len = len;
+    memcpy(&(r->addr), addr, addrLen);
+    r->addrLen = addrLen;
+
+    return len;
+}
+
+/** \brief Sends every queued reply with as few sendmmsg() calls (or io_uring submissions) as possible.
+ */
+static void flushReplies()
+{
+    struct mmsghdr msgs[BATCH_MAX];
+    struct iovec iovs[BATCH_MAX];
+    int i, sent = 0;
+
+    memset((void*) msgs, (int) '\0', sizeof(msgs[0]) * outboxCount);
+
+    for (i = 0; i < outboxCount; i++)
     {
-        replyToQuery(buffer, &addr, addrLen);
+        iovs[i].iov_base = outbox[i].data;
+        iovs[i].iov_len = outbox[i].len;
+
+        msgs[i].msg_hdr.msg_iov = &(iovs[i]);
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = &(outbox[i].addr);
+        msgs[i].msg_hdr.msg_namelen = outbox[i].addrLen;
     }
-    else if (strcmp("REG", cmd) == 0)
+
+    while (sent < outboxCount && dnsSocket != -1)
     {
-        registerNewUser(buffer, &addr, addrLen);
+        int ret = reactorSendmmsg(reactor, dnsSocket, msgs + sent, outboxCount - sent);
+        batchStats.sendCalls++;
+
+        if (ret == -1)
+        {
+            // The first unsent reply failed. Skip it and go on with the rest.
+            perror("Could not send reply");
+            sent++;
+            continue;
+        }
+
+        sent += ret;
+        batchStats.replies += ret;
     }
-    else if (strcmp("UNR", cmd) == 0)
+
+    outboxCount = 0;
+}
+
+/** \brief Receives and handles messages on the dnsSocket (Given Name Server). Never blocks.
+ *
+ * If batchSize is more than 1, drains up to batchSize datagrams with one recvmmsg(),
+ * handles all of them, and then sends all the queued replies together.
+ * Otherwise, receives and handles a single datagram.
+ *
+ * \return int Number of datagrams received. 0 if there were none waiting.
+ *
+ */
+int parseServerCommand()
+{
+    static char buffers[BATCH_MAX][2048];
+    struct sockaddr_in addrs[BATCH_MAX];
+    int ret, i;
+
+    int n = (batchSize < 1) ? 1 : (batchSize > BATCH_MAX ? BATCH_MAX : batchSize);
+
+    if (n == 1)
     {
-        unregisterUser(buffer, &addr, addrLen);
+        memset((void*)&addrs[0], (int)'\0', sizeof(addrs[0]));
+        socklen_t addrLen = sizeof(addrs[0]);
+
+        // The dnsSocket stays blocking for the few places that wait for a reply, so ask for no wait here
+        ret = recvfrom(dnsSocket, buffers[0], 2047, MSG_DONTWAIT, (struct sockaddr*) &addrs[0], &addrLen);
+        batchStats.recvCalls++;
+        if (ret == -1)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                perror("Error: could not receive message on dnsSocket");
+            return 0;
+        }
+
+        // Always terminate the buffer with \0. This will never overwrite the received message.
+        buffers[0][ret] = '\0';
+        batchStats.wakeups++;
+        batchStats.datagrams++;
+
+        handleServerMessage(buffers[0], &addrs[0], addrLen);
+        return 1;
     }
-    else if (strcmp("LST", cmd) == 0)
+
+    struct mmsghdr msgs[BATCH_MAX];
+    struct iovec iovs[BATCH_MAX];
+
+    memset((void*) msgs, (int) '\0', sizeof(msgs[0]) * n);
+    for (i = 0; i < n; i++)
     {
-        receiveList(buffer, &addr, addrLen);
+        iovs[i].iov_base = buffers[i];
+        iovs[i].iov_len = 2047;
+
+        msgs[i].msg_hdr.msg_iov = &(iovs[i]);
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = &(addrs[i]);
+        msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
     }
-    else if (strcmp("DNS", cmd) == 0)
+
+    // Only take what is already there
+    ret = recvmmsg(dnsSocket, msgs, n, MSG_DONTWAIT, NULL);
+    batchStats.recvCalls++;
+    if (ret == -1)
     {
-        if (joinStatus == WaitForDNS)
-            continueJoin(buffer);
-        else
-            becomeDNS(buffer, &addr, addrLen);
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+            perror("Error: could not receive messages on dnsSocket");
+        return 0;
     }
-    else if (strcmp("OK", cmd) == 0)
-    {
-        if (joinStatus == LeavingUsers || joinStatus == LeavingDNS || joinStatus == SearchingNewDns)
-            continueLeave(buffer, &addr, addrLen);
 
-        else if (joinStatus == WaitForOK)
-            continueJoinOK(&addr, addrLen);
+    batchStats.wakeups++;
+    batchStats.datagrams += ret;
+
+    batching = 1;
+    for (i = 0; i < ret && dnsSocket != -1; i++)
+    {
+        buffers[i][msgs[i].msg_len] = '\0';
+        handleServerMessage(buffers[i], &addrs[i], msgs[i].msg_hdr.msg_namelen);
     }
-    else if (strcmp("FW", cmd) == 0)
+    batching = 0;
+
+    flushReplies();
+    return ret;
+}
+
+/** \brief Reactor callback for the dnsSocket. Handles every datagram waiting on it.
+ *
+ * The dnsSocket is edge-triggered, so it is drained until there is nothing left,
+ * or until a handler closes it (eg. at the end of a leave).
+ *
+ * \param fd int The dnsSocket.
+ * \param arg void* Unused.
+ *
+ */
+void dnsReadable(int fd, void* arg)
+{
+    while (dnsSocket == fd && parseServerCommand() > 0)
+        ;
+}
+
+/** \brief Reactor callback with a datagram received on the dnsSocket, when the reactor receives them itself.
+ *
+ * Replies are queued, and sent together by dnsBatchEnd().
+ *
+ * \param data char* The datagram, null-terminated, in a buffer of the reactor.
+ * \param len int Length of the datagram.
+ * \param addr struct sockaddr_in* Sender.
+ * \param addrLen socklen_t Length of addr.
+ * \param arg void* Unused.
+ *
+ */
+void dnsDatagram(char* data, int len, struct sockaddr_in* addr, socklen_t addrLen, void* arg)
+{
+    if (dnsSocket == -1)
+        return;
+
+    batchStats.datagrams++;
+
+    batching = (batchSize > 1);
+    handleServerMessage(data, addr, addrLen);
+
+    // A handler closed the dnsSocket (eg. at the end of a leave): the queued replies have nowhere to go
+    if (dnsSocket == -1)
     {
-        continueFindFW(buffer);
+        batching = 0;
+        outboxCount = 0;
     }
-    else if (strcmp("RPL", cmd) == 0)
+}
+
+/** \brief Reactor callback after the datagrams received on the dnsSocket in one wait. Sends the queued replies.
+ *
+ * \param arg void* Unused.
+ *
+ */
+void dnsBatchEnd(void* arg)
+{
+    batchStats.wakeups++;
+
+    batching = 0;
+    flushReplies();
+}
+
+/** \brief Returns the opcode of the first word of a message.
+ *
+ * \param word const char* First word of the message. Need not be null-terminated.
+ * \param len int Length of the word.
+ * \return Opcode Opcode of the word, or OpUnknown.
+ *
+ */
+static Opcode classifyOpcode(const char* word, int len)
+{
+    #define IS(w) (len == sizeof(w) - 1 && memcmp(word, w, sizeof(w) - 1) == 0)
+
+    // One comparison at most for each first letter
+    switch (word[0])
+    {
+        case 'Q': return IS("QRY") ? OpQRY : OpUnknown;
+        case 'R': return IS("REG") ? OpREG : (IS("RPL") ? OpRPL : OpUnknown);
+        case 'U': return IS("UNR") ? OpUNR : OpUnknown;
+        case 'L': return IS("LST") ? OpLST : OpUnknown;
+        case 'D': return IS("DNS") ? OpDNS : (IS("DLT") ? OpDLT : OpUnknown);
+        case 'O': return IS("OK") ? OpOK : OpUnknown;
+        case 'F': return IS("FW") ? OpFW : OpUnknown;
+        case 'N': return IS("NOK") ? OpNOK : OpUnknown;
+        case 'S': return IS("SYN") ? OpSYN : OpUnknown;
+        case 'G': return IS("GSP") ? OpGSP : OpUnknown;
+        case 'P': return IS("PNG") ? OpPNG : OpUnknown;
+        case 'A': return IS("ALV") ? OpALV : OpUnknown;
+        default: return OpUnknown;
+    }
+
+    #undef IS
+}
+
+/** \brief Splits a line on ';', in place.
+ *
+ * Every field is null-terminated and trimmed of surrounding blanks.
+ * If there are more than maxFields fields, the last one keeps the rest of the line.
+ *
+ * \param line char* Null-terminated line, without the '\n'. Will be overwritten.
+ * \param out_fields Field* Array of at least maxFields fields.
+ * \param maxFields int Size of out_fields.
+ * \return int Number of fields. 0 if the line is empty.
+ *
+ */
+int splitFields(char* line, Field* out_fields, int maxFields)
+{
+    int n = 0;
+    char* p = line;
+
+    while (*p == ' ' || *p == '\t')
+        p++;
+
+    if (*p == '\0')
+        return 0;
+
+    while (n < maxFields)
     {
-        continueFindRPL(buffer);
+        char* start = p;
+
+        if (n < maxFields - 1)
+        {
+            while (*p != ';' && *p != '\0')
+                p++;
+        }
+        else
+            p += strlen(p);
+
+        char* next = (*p == ';') ? p + 1 : NULL;
+
+        // Trim trailing blanks (and the '\r' of '\r\n' terminated messages)
+        char* end = p;
+        while (end > start && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r'))
+            end--;
+        *end = '\0';
+
+        out_fields[n].str = start;
+        out_fields[n].len = end - start;
+        n++;
+
+        if (next == NULL)
+            break;
+
+        p = next;
+        while (*p == ' ' || *p == '\t')
+            p++;
     }
+
+    return n;
+}
+
+/** \brief Tokenizes a message received on the dnsSocket, in a single pass.
+ *
+ * Classifies the first word and splits the rest of the first line on ';'.
+ * Handlers get the fields already split, and never need to scan the buffer again.
+ *
+ * \param buffer char* Received message, null-terminated. Will be overwritten.
+ * \param out_msg Message* Where the opcode and fields will be written.
+ * \return int 0 on success. -1 if the message is empty.
+ *
+ */
+int parseMessage(char* buffer, Message* out_msg)
+{
+    char* p = buffer;
+
+    // First word, up to the first blank
+    while (*p != '\0' && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n')
+        p++;
+    char* wordEnd = p;
+
+    // Rest of the first line
+    while (*p == ' ' || *p == '\t' || *p == '\r')
+        p++;
+    char* line = p;
+
+    while (*p != '\0' && *p != '\n')
+        p++;
+
+    out_msg->rest = (*p == '\n') ? p + 1 : p;
+    *p = '\0';
+    *wordEnd = '\0';
+
+    out_msg->word = buffer;
+    out_msg->opcode = (wordEnd == buffer) ? OpUnknown : classifyOpcode(buffer, wordEnd - buffer);
+    out_msg->nFields = (line < p) ? splitFields(line, out_msg->fields, MAX_FIELDS) : 0;
+
+    return (wordEnd == buffer) ? -1 : 0;
+}
+
+/** \brief Parses a port or other non-negative number from a field.
+ *
+ * \param f Field* Field to parse.
+ * \param out_value int* Where the number will be written.
+ * \return int 0 on success. -1 if the field is not a number.
+ *
+ */
+static int fieldToInt(Field* f, int* out_value)
+{
+    char* end;
+    long value = strtol(f->str, &end, 10);
+
+    if (f->len == 0 || *end != '\0' || value < 0 || value > 65535)
+        return -1;
+
+    *out_value = (int) value;
+    return 0;
+}
+
+/** \brief Parses an epoch or version number from a field.
+ *
+ * \param f Field* Field to parse.
+ * \param out_value unsigned int* Where the number will be written.
+ * \return int 0 on success. -1 if the field is not a number.
+ *
+ */
+static int fieldToUnsigned(Field* f, unsigned int* out_value)
+{
+    char* end;
+    unsigned long value = strtoul(f->str, &end, 10);
+
+    if (f->len == 0 || *end != '\0' || value > 0xFFFFFFFFUL)
+        return -1;
+
+    *out_value = (unsigned int) value;
+    return 0;
+}
+
+/** \brief Handles a DNS message: the SS reply during join, or a request to become DNS. */
+static void handleDNS(Message* msg, struct sockaddr_in* addr, socklen_t addrLen)
+{
+    if (joinStatus == WaitForDNS)
+        continueJoin(msg, addr, addrLen);
     else
+        becomeDNS(msg, addr, addrLen);
+}
+
+/** \brief Handles an OK message, during join or leave. */
+static void handleOK(Message* msg, struct sockaddr_in* addr, socklen_t addrLen)
+{
+    if (joinStatus >= LeavingDNS && joinStatus <= UpdatingSS)
+        continueLeave(msg, addr, addrLen);
+
+    else if (joinStatus == WaitForOK || joinStatus == WaitForLST)
+        continueJoinOK(msg, addr, addrLen);
+
+    else if (joinStatus == Joined)
+        continueStandby(msg, addr);
+}
+
+/** \brief Handles NOKs and unknown messages. Any of them rejects a DNS request during leave. */
+static void handleOther(Message* msg, struct sockaddr_in* addr, socklen_t addrLen)
+{
+    if (joinStatus >= LeavingUsers && joinStatus <= UpdatingSS)
+        continueLeave(msg, addr, addrLen);
+    else if (joinStatus != Joined || !continueStandby(msg, addr))
+        printf("DNS Server got unknown/unexpected message: %s\n", msg->word);
+}
+
+/** \brief Handles a FW message from the SS: the DNS of our family we asked for, or the DNS of someone we are finding. */
+static void handleFW(Message* msg, struct sockaddr_in* addr, socklen_t addrLen)
+{
+    // Finds never ask the SS about our own family, so a FW with our surname is the answer to our lookup
+    if (lookingUpNameServer())
     {
-        if (joinStatus == SearchingNewDns)
-            continueLeave(buffer, &addr, addrLen);
-        else
-            printf("DNS Server got unknown/unexpected message: %s\n", cmd);
+        char* mySurname = strchr(myName, '.');
+        char* surname = (msg->nFields > 0 ? strchr(msg->fields[0].str, '.') : NULL);
+
+        if (msg->nFields == 0 && oldestFind(WaitForFW, NULL, NULL) == NULL)
+        {
+            nameServerLookedUp(NULL);
+            return;
+        }
+
+        if (surname != NULL && mySurname != NULL && strcmp(surname, mySurname) == 0)
+        {
+            nameServerLookedUp(msg->fields[0].str);
+            return;
+        }
     }
 
-    return;
+    continueFindFW(msg, addr, addrLen);
+}
+
+/** Handler of each opcode. */
+static void (* const handlers[OpCount])(Message* msg, struct sockaddr_in* addr, socklen_t addrLen) =
+{
+    [OpUnknown] = handleOther,
+    [OpQRY] = replyToQuery,
+    [OpREG] = registerNewUser,
+    [OpUNR] = unregisterUser,
+    [OpLST] = receiveList,
+    [OpDNS] = handleDNS,
+    [OpOK] = handleOK,
+    [OpFW] = handleFW,
+    [OpRPL] = continueFindRPL,
+    [OpNOK] = handleOther,
+    [OpSYN] = replyToSync,
+    [OpDLT] = receiveDelta,
+    [OpGSP] = receiveGossip,
+    [OpPNG] = answerProbe,
+    [OpALV] = probeAnswered
+};
+
+/** \brief Parses a message received on the dnsSocket (Given Name Server).
+ *
+ * Tokenizes the message and calls the handler of its opcode.
+ *
+ * \param buffer char* Received message, null-terminated. Will be overwritten.
+ * \param addr struct sockaddr_in* Address of the sender.
+ * \param addrLen socklen_t Length of addr.
+ *
+ */
+void handleServerMessage(char* buffer, struct sockaddr_in* addr, socklen_t addrLen)
+{
+    Message msg;
+
+    logm(2, "Received from %s: %s\n", inet_ntoa(addr->sin_addr), buffer);
+
+    if (parseMessage(buffer, &msg) != 0)
+    {
+        printf("DNS Server got malformed message.\n");
+        return;
+    }
+
+    // A reply acknowledges the request whose id it echoes. One without an id, the oldest request we sent the peer.
+    // A LST only once all of its chunks are in: see receiveList()
+    unsigned int replyId;
+    if ((msg.opcode == OpOK || msg.opcode == OpNOK) && restNumber(msg.rest, "ID", &replyId))
+        ackReliableId(addr, replyId);
+    else if (msg.opcode == OpOK || msg.opcode == OpNOK)
+        ackReliable(addr);
+
+    heardFrom(addr);
+    memberHeard(addr);
+
+    // Requests sent with sendReliable() carry an id, so that retransmissions are not handled twice
+    unsigned int id;
+    int isRequest = (msg.opcode == OpREG || msg.opcode == OpUNR || msg.opcode == OpDNS)
+                    && restNumber(msg.rest, "ID", &id);
+
+    if (isRequest && receiveRequest(id, addr, addrLen))
+        return;
+
+    handlers[msg.opcode](&msg, addr, addrLen);
+
+    if (isRequest)
+        endRequest();
 }
 
 /** \brief Prepares the talk server socket.
@@ -143,46 +627,89 @@ int prepareTalkServer()
         exit(-1);
     }
 
+    // Calls are accepted until there are none left, which must not block
+    if (fcntl(serverSocket, F_SETFL, fcntl(serverSocket, F_GETFL) | O_NONBLOCK) == -1)
+    {
+        perror("Could not make TCP server socket non-blocking");
+        exit(-1);
+    }
+
     return serverSocket;
 }
 
 /** \brief Responds to a QRY request.
  *
- * Searches for the requested contact and sends a RPL message back the requester
+ * Searches for the requested contact and sends its pre-rendered RPL message back the requester
  * through the dnsSocket.
  *
- * \param buffer char* Contents of the QRY message. Will be overwritten with the RPL message.
+ * Hedged QRYs may ask for their name to be echoed, and for other members of the family to be listed,
+ * so that any member can answer them, and the next ones can be sent to several members.
+ *
+ * \param msg Message* QRY message, of the format 'QRY name.surname'.
  * \param addr struct sockaddr_in* Address of the sender. RPL will be sent to this.
  * \param addrLen socklen_t Length of the addr parameter.
  *
  */
-void replyToQuery(char* buffer, struct sockaddr_in* addr, socklen_t addrLen)
+void replyToQuery(Message* msg, struct sockaddr_in* addr, socklen_t addrLen)
 {
     int ret;
-    char name[128];
+    char extended[NAME_LEN + 8 + MAX_ALTERNATES * (NAME_LEN + 32) + 256];
 
     // Format: QRY name.surname
-    ret = sscanf(buffer, "%*s %127s", name);
-    if (ret != 1)
+    if (msg->nFields != 1 || msg->fields[0].len == 0 || msg->fields[0].len >= NAME_LEN)
     {
         printf("Malformed QRY message from %s.\n", inet_ntoa(addr->sin_addr));
         return;
     }
 
-    // Find contact in local list
-    Contact* c = get(contacts, name);
+    char* name = msg->fields[0].str;
+
+    // Find contact in local list. Unknown names are mostly rejected by the name filter.
+    Contact* c = queryName(contacts, name);
+
+    // Reply is the pre-rendered RPL of the contact, or an empty RPL
+    const char* reply = "RPL";
+    int replyLen = 3;
 
-    // Prepare reply message
     if (c != NULL)
-        sprintf(buffer, "RPL %s;%s;%d", name, inet_ntoa(c->ip), c->talkPort);
-    else
-        sprintf(buffer, "RPL");
+    {
+        reply = c->wire;
+        replyLen = c->rplLen;
+    }
+
+    // Hedged QRYs want their name back, and maybe who else to ask
+    int flags = queryFlags(msg->rest);
+    if (flags != 0 && replyLen < 256)
+    {
+        memcpy(extended, reply, replyLen);
+
+        if (flags & QUERY_ECHO)
+            replyLen += sprintf(extended + replyLen, "\nQRY %s", name);
+
+        if (flags & QUERY_ALT)
+        {
+            Node* p;
+            int n = 0;
+
+            for (p = contacts->next; p != NULL && n < MAX_ALTERNATES; p = p->next)
+            {
+                if (contactNameIs(p->c, myName))
+                    continue;
+
+                replyLen += sprintf(extended + replyLen, "\nALT %s;%s;%d",
+                                    contactName(p->c), inet_ntoa(p->c->ip), p->c->dnsPort);
+                n++;
+            }
+        }
+
+        reply = extended;
+    }
 
     // Debug and logging
-    logm(1, "%s\n", buffer);
+    logm(1, "%.*s\n", replyLen, reply);
 
     // Send back the reply
-    ret = sendto(dnsSocket, buffer, strlen(buffer), 0, (struct sockaddr*) addr, addrLen);
+    ret = sendReply(reply, replyLen, addr, addrLen);
     if (ret == -1)
     {
         perror("Could not send RPL to QRY");
@@ -192,15 +719,71 @@ void replyToQuery(char* buffer, struct sockaddr_in* addr, socklen_t addrLen)
     return;
 }
 
+/** \brief Reads the flags of a QRY from the lines after its first one.
+ *
+ * \param rest const char* Lines after the first one, as left by parseMessage().
+ * \return int QUERY_ECHO and QUERY_ALT, or'ed. 0 for a plain QRY.
+ *
+ */
+int queryFlags(const char* rest)
+{
+    int flags = 0;
+
+    while (*rest != '\0')
+    {
+        int len = strcspn(rest, "\r\n");
+
+        if (len == 4 && strncmp(rest, "ECHO", 4) == 0)
+            flags |= QUERY_ECHO;
+        else if (len == 3 && strncmp(rest, "ALT", 3) == 0)
+            flags |= QUERY_ALT;
+
+        rest += len;
+        rest += strspn(rest, "\r\n");
+    }
+
+    return flags;
+}
+
+/** \brief Reads a 'KEY n' line, such as the id of a request, from the lines after the first one.
+ *
+ * \param rest const char* Lines after the first one, as left by parseMessage().
+ * \param key const char* The word the line starts with.
+ * \param out_value unsigned int* Where the number is written.
+ * \return int 1 if the line is there. 0 otherwise, and out_value is left as it was.
+ *
+ */
+int restNumber(const char* rest, const char* key, unsigned int* out_value)
+{
+    int keyLen = strlen(key);
+
+    while (*rest != '\0')
+    {
+        int len = strcspn(rest, "\r\n");
+
+        if (len > keyLen && strncmp(rest, key, keyLen) == 0 && rest[keyLen] == ' '
+            && sscanf(rest + keyLen + 1, "%u", out_value) == 1)
+            return 1;
+
+        rest += len;
+        rest += strspn(rest, "\r\n");
+    }
+
+    return 0;
+}
+
 /** \brief Handles a request for a chat call.
  *
- * Accepts the chat call and sets the global variable talkSocket for the created socket.
+ * Accepts the chat call, sets the global variable talkSocket for the created socket
+ * and registers it in the reactor.
  *
  * If there is a chat call already established, the call is accepted temporarily,
  * a human-readable rejection message is sent, and the temporary call is immediately closed.
  *
+ * \return int 1 if a call was accepted or rejected. 0 if there were no calls waiting, or on error.
+ *
  */
-void acceptCall()
+int acceptCall()
 {
     // If a call is in course, reject second call
     if (talkSocket != -1)
@@ -208,8 +791,9 @@ void acceptCall()
         int rejectionSocket = accept(talkServerSocket, NULL, NULL);
         if (rejectionSocket == -1)
         {
-            perror("Failed to properly reject second call");
-            return;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                perror("Failed to properly reject second call");
+            return 0;
         }
 
         // Send a message and immediately close socket
@@ -219,7 +803,7 @@ void acceptCall()
         close(rejectionSocket);
 
         printf("Incoming call rejected.\n");
-        return;
+        return 1;
     }
 
     // Store address for pretty prints
@@ -231,209 +815,425 @@ void acceptCall()
     talkSocket = accept(talkServerSocket, (struct sockaddr*) &addr, &addrlen);
     if (talkSocket == -1)
     {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return 0;
+
         perror("Could not accept TCP call");
         printf("TCP request came from %s:%d\n", inet_ntoa(addr.sin_addr), ntohs(addr.sin_port));
-        return;
+        return 0;
     }
 
+    if (reactorAddStream(reactor, talkSocket, talkReceived, NULL) == -1)
+        reactorAdd(reactor, talkSocket, REACTOR_EDGE, talkReadable, NULL);
+
     printf("Accepted call from %s:%d.\n", inet_ntoa(addr.sin_addr), ntohs(addr.sin_port));
+    return 1;
+}
+
+/** \brief Reactor callback for the talk server socket. Accepts or rejects every call waiting.
+ *
+ * \param fd int The talkServerSocket.
+ * \param arg void* Unused.
+ *
+ */
+void talkServerReadable(int fd, void* arg)
+{
+    while (acceptCall() > 0)
+        ;
+}
+
+/** \brief Gets the largest UDP payload that reaches an address without IP fragmentation.
+ *
+ * Asks the kernel for the path MTU through a temporary connected socket.
+ *
+ * \param addr struct sockaddr_in* Destination.
+ * \param addrLen socklen_t Length of addr.
+ * \return int Largest payload, never more than LST_CHUNK_MAX.
+ *
+ */
+static int maxPayloadTo(struct sockaddr_in* addr, socklen_t addrLen)
+{
+    int mtu = DEFAULT_MTU;
+    socklen_t optLen = sizeof(mtu);
+
+    int probe = socket(AF_INET, SOCK_DGRAM, 0);
+    if (probe != -1)
+    {
+        if (connect(probe, (struct sockaddr*) addr, addrLen) == -1
+            || getsockopt(probe, IPPROTO_IP, IP_MTU, &mtu, &optLen) == -1)
+        {
+            mtu = DEFAULT_MTU;
+        }
+        close(probe);
+    }
+
+    int payload = mtu - UDP_IP_HEADERS;
+    return (payload > LST_CHUNK_MAX) ? LST_CHUNK_MAX : payload;
+}
+
+/** \brief Sends contact lines in chunks that fit in maxPayload bytes.
+ *
+ * Each chunk is the header, its sequence number, a '\n' and whole lines.
+ * The last chunk ends with an empty line. Chunks are sent straight from the lines, without copying.
+ *
+ * \param header const char* Start of the first line of every chunk, eg. 'LST '.
+ * \param lines const char* Lines to be sent, each ending with '\n'.
+ * \param end const char* End of the lines.
+ * \param maxPayload int Largest chunk.
+ * \param addr struct sockaddr_in* Destination.
+ * \param addrLen socklen_t Length of addr.
+ * \return int Number of chunks sent, or -1 on error.
+ *
+ */
+static int sendChunks(const char* header, const char* lines, const char* end, int maxPayload,
+                      struct sockaddr_in* addr, socklen_t addrLen)
+{
+    int seq = 0;
+
+    do
+    {
+        if (seq == LST_MAX_CHUNKS)
+        {
+            printf("List is too big to be sent in %d chunks.\n", LST_MAX_CHUNKS);
+            return -1;
+        }
+
+        char first[64];
+        int firstLen = snprintf(first, sizeof(first), "%s%d\n", header, seq);
+
+        // Take as many whole lines as fit, leaving room for the empty line
+        int room = maxPayload - firstLen - 1;
+        const char* chunkEnd = lines;
+        while (chunkEnd < end)
+        {
+            const char* next = memchr(chunkEnd, '\n', end - chunkEnd);
+            next = (next != NULL) ? next + 1 : end;
+
+            if (next - lines > room && chunkEnd > lines)
+                break;
+
+            chunkEnd = next;
+        }
+
+        struct iovec iov[3];
+        iov[0].iov_base = first;
+        iov[0].iov_len = firstLen;
+        iov[1].iov_base = (void*) lines;
+        iov[1].iov_len = chunkEnd - lines;
+        iov[2].iov_base = "\n";
+        iov[2].iov_len = 1;
+
+        struct msghdr hdr;
+        memset((void*) &hdr, (int) '\0', sizeof(hdr));
+        hdr.msg_name = addr;
+        hdr.msg_namelen = addrLen;
+        hdr.msg_iov = iov;
+        hdr.msg_iovlen = (chunkEnd == end) ? 3 : 2;
+
+        if (sendmsg(dnsSocket, &hdr, 0) == -1)
+            return -1;
+
+        recordReply(iov, hdr.msg_iovlen, addr);
+
+        lines = chunkEnd;
+        seq++;
+    } while (lines < end);
+
+    return seq;
+}
+
+/** \brief Sends the list of contacts to a new member.
+ *
+ * If the LST fits in one datagram, it is sent as is. Otherwise, it is split into chunks
+ * that fit the path MTU, each with a 'LST seq' header and whole contact lines.
+ * The last chunk ends with the empty line that ends a LST.
+ *
+ * \param addr struct sockaddr_in* Address of the new member.
+ * \param addrLen socklen_t Length of addr.
+ * \return int Number of chunks sent (1 for a plain LST), or -1 on error.
+ *
+ */
+static int sendList(struct sockaddr_in* addr, socklen_t addrLen)
+{
+    int lstLen;
+    const char* lst = getListMessage(contacts, &lstLen);
+    int maxPayload = maxPayloadTo(addr, addrLen);
+
+    if (lstLen <= maxPayload)
+    {
+        if (sendReply(lst, lstLen, addr, addrLen) == -1)
+            return -1;
+        return 1;
+    }
+
+    // Contact lines of the cached message, without the 'LST' line and the final empty line
+    return sendChunks("LST ", strchr(lst, '\n') + 1, lst + lstLen - 1, maxPayload, addr, addrLen);
 }
 
 /** \brief Registers a new user at the local database.
  *
  * Sends an OK back if everything was ok. Sends a NOK if the user's surname is not ours.
+ * With gossip on, the new user told only a few members, so we spread its join to the rest.
  *
- * \param newUserREG char* REG message received.
+ * \param msg Message* REG message received, of the format 'REG name.surname;ip;talkPort;dnsPort'.
  * \param addr struct sockaddr_in* Address of the sender. Will be used as new destination.
  * \param addrLen socklen_t Length of addr.
  *
  */
-void registerNewUser(char* newUserREG, struct sockaddr_in* addr, socklen_t addrLen)
+void registerNewUser(Message* msg, struct sockaddr_in* addr, socklen_t addrLen)
 {
-    int ret, ret2;
+    int ret;
 
     // Add newly-received contact
-    Contact* c = (Contact*) malloc(sizeof(Contact));
-
-    // Skip first word, "REG".
-    ret = sscanf(newUserREG, "%*s %127s", newUserREG);
+    Contact* c = newContact();
 
-    ret2 = getContactFromMsg(newUserREG, c);
-    if (ret2 != 0 || ret != 1)
+    ret = getContactFromFields(msg->fields, msg->nFields, c);
+    if (ret != 0)
     {
         printf("Received malformed REG message.\n");
-        free(c);
+        freeContact(c);
         return;
     }
 
+    // Members that send no incarnation keep 0
+    restNumber(msg->rest, "INC", &(c->incarnation));
+
     // Compare surnames, refuse if they do not match
-    if (strcmp(strstr(myName, "."), strstr(c->name, ".")) != 0)
+    if (strcmp(strstr(myName, ".") + 1, c->surname) != 0)
     {
         char nokMsg[192];
         // +1 to ignore '.' character
         sprintf(nokMsg, "NOK - You do not have my surname (%s)", strstr(myName, ".") + 1);
 
-        ret = sendto(dnsSocket, nokMsg, strlen(nokMsg), 0, (struct sockaddr*) addr, addrLen);
+        ret = sendReply(nokMsg, strlen(nokMsg), addr, addrLen);
         if (ret == -1)
         {
             perror("Could not send NOK message in reply to REG");
         }
-        free(c);
+        freeContact(c);
         return;
     }
 
     // If received contact already exists on list, duplicate will be != NULL
-    Contact* duplicate = get(contacts, c->name);
+    Contact* duplicate = get(contacts, contactName(c));
 
     if (duplicate == NULL)
     {
         add(contacts, c);
-        logm(1, "Registered new user of same family: %s\n", c->name);
+        logm(1, "Registered new user of same family: %s\n", contactName(c));
+
+        if (gossipFanout > 0)
+        {
+            spreadRumor(c, 0);
+            gossipStats.started++;
+        }
     }
     else
-        logm(1, "User claims to be %s, but name already exists in database.\nSending empty LST.\n", c->name);
-
-    // If we are the DNS, send LST to this contact
-    if (nameServer != NULL && strcmp(myName, nameServer->name) == 0)
     {
-        // Send this contact the current list of users
-        char buffer[2048];
-        char* caret = buffer;
-        Node* n = contacts->next;
+        logm(1, "User claims to be %s, but name already exists in database.\nSending empty LST.\n", contactName(c));
 
-        caret += sprintf(caret, "LST\n");
+        // Only the registered contact is kept
+        freeContact(c);
+        c = duplicate;
+    }
 
-        // If the contact is, in fact, a new user, send them the LST
+    // If we are the DNS, send LST to this contact
+    if (nameServer != NULL && contactNameIs(nameServer, myName))
+    {
+        // Send this contact the current list of users (cached), or an empty LST if it is a duplicate
         if (duplicate == NULL)
-        {
-            while (n != NULL)
-            {
-                // Format: name.surname;ipN;talkportN;dnsportN
-                caret += sprintf(caret, "%s;%s;%d;%d\n",
-                                 n->c->name,
-                                 inet_ntoa(n->c->ip),
-                                 n->c->talkPort,
-                                 n->c->dnsPort);
-
-                n = n->next;
-            }
-        }
-        // Terminate LST with an empty line
-        caret += sprintf(caret, "\n");
+            ret = sendList(addr, addrLen);
+        else
+            ret = sendReply("LST\n\n", 5, addr, addrLen);
 
-        ret = sendto(dnsSocket, buffer, strlen(buffer), 0, (struct sockaddr*) addr, addrLen);
         if (ret == -1)
         {
             perror("Could not send LST message");
-            removeFrom(contacts, c->name);
-            printf("Contact %s removed.\n", c->name);
+            printf("Contact %s removed.\n", contactName(c));
+            removeFrom(contacts, contactName(c));
             return;
         }
 
-        logm(1, "Sent LST to contact %s.\n\n%s", c->name, buffer);
+        logm(1, "Sent LST to contact %s (%d datagrams).\n", contactName(c), (duplicate == NULL) ? ret : 1);
+
+        // The first member to join, and any after the standby left, may be the standby
+        designateStandby(NULL);
+        watchMembers();
     }
     // If we are a regular user, just say OK
     else
     {
         char* okMsg = "OK";
 
-        ret = sendto(dnsSocket, okMsg, strlen(okMsg), 0, (struct sockaddr*) addr, addrLen);
+        ret = sendReply(okMsg, strlen(okMsg), addr, addrLen);
         if (ret == -1)
         {
             perror("Could not send OK message in reply to REG");
-            removeFrom(contacts, c->name);
-            printf("Contact %s removed.\n", c->name);
+            printf("Contact %s removed.\n", contactName(c));
+            removeFrom(contacts, contactName(c));
             return;
         }
     }
 }
 
-/** \brief Parses a contact data message and fills in a Contact data structure.
+/** \brief Fills in a Contact data structure from the fields of a contact data message.
  *
- * The message should be of the format 'name.surname;IP;talkPort;dnsPort'.
+ * The fields should be those of a line of the format 'name.surname;IP;talkPort;dnsPort'.
  *
- * \param message char* Message of the specified format.
+ * \param fields Field* Fields of the line, as split by splitFields().
+ * \param nFields int Number of fields.
  * \param out_contact Contact* Pre-allocated Contact structure where the data will be written.
  * \return int 0 if the data was valid and the structure could be filled in. -1 if data could not be read.
  *
  */
-int getContactFromMsg(char* message, Contact* out_contact)
+int getContactFromFields(Field* fields, int nFields, Contact* out_contact)
 {
     int ret;
+    int talkPort, dnsPort;
 
-    char nameBuf[128];
-    char ipBuf[32];
-
-    // Parse format: name.surname;IP;talkPort;dnsPort
-    ret = sscanf(message, "%[^;];%[^;];%d;%d", nameBuf, ipBuf, &(out_contact->talkPort), &(out_contact->dnsPort));
-    if (ret != 4)
+    // Format: name.surname;IP;talkPort;dnsPort
+    if (nFields != 4 || fields[0].len >= NAME_LEN
+        || fieldToInt(&fields[2], &talkPort) != 0 || fieldToInt(&fields[3], &dnsPort) != 0)
     {
-        logm(1, "Bad format on getContactFromMsg, format.\n%s\n", message);
+        logm(1, "Bad format on getContactFromFields, format.\n");
         return -1;
     }
 
-    // Verify name format: name.surname
-    if (strstr(nameBuf, ".") == NULL)
+    // Copy IP address
+    ret = inet_aton(fields[1].str, &(out_contact->ip));
+    if (ret == 0)
     {
-        logm(1, "Bad format on getContactFromMsg, name does not have .surname\n");
+        logm(1, "Bad format on getContactFromFields, IP %s.\n", fields[1].str);
         return -1;
     }
 
-    // Copy name
-    strcpy(out_contact->name, nameBuf);
-
-    // Copy IP address
-    ret = inet_aton(ipBuf, &(out_contact->ip));
-    if (ret == 0)
+    // Verify name format: name.surname, and copy it
+    if (setContactName(out_contact, fields[0].str) != 0)
     {
-        logm(1, "Bad format on getContactFromMsg, IP.\n%s\n", message);
+        logm(1, "Bad format on getContactFromFields, name does not have .surname\n");
         return -1;
     }
 
+    out_contact->talkPort = talkPort;
+    out_contact->dnsPort = dnsPort;
+
     return 0;
 }
 
+/** \brief Stops waiting for the OK of a member to our REG, as it came, or the member is gone.
+ *
+ * Once no more OKs are expected, and the whole LST is in, the join sequence is complete.
+ *
+ * \param c Contact* The member.
+ *
+ */
+static void stopExpectingOK(Contact* c)
+{
+    c->okExpected = 0;
+    oksExpected--;
+
+    // OKs may arrive while the rest of a chunked LST is still on its way
+    if (oksExpected == 0 && joinStatus == WaitForOK)
+    {
+        printf("Joined successfully.\n");
+        joinStatus = Joined;
+        timerStop(&joinTimer);
+    }
+}
+
+/** \brief Removes a member that left, or that the DNS found dead, from the local database.
+ *
+ * If it was our DNS, it is forgotten, to be asked to the SS when needed.
+ *
+ * \param name const char* Full name of the member.
+ * \return int 0 on success. -1 if it was not in the local database.
+ *
+ */
+int forgetMember(const char* name)
+{
+    Contact* c = get(contacts, name);
+
+    standbyMemberLeft(name);
+
+    // Joining, and the DNS dropped a member we sent a REG to: its OK is never coming
+    if (c != NULL && c->okExpected == 1 && (joinStatus == WaitForLST || joinStatus == WaitForOK))
+        stopExpectingOK(c);
+
+    // Our DNS is leaving. Delete its cached data
+    if (nameServer != NULL && contactNameIs(nameServer, name))
+    {
+        logm(1, "My DNS %s is leaving. Gotta ask the SS who the new DNS is.\n", name);
+
+        nameServer = NULL;
+    }
+
+    // A member offered to be the new DNS is leaving too. Take it as a refusal
+    handoverMemberLeft(name);
+    if (joinStatus == SearchingNewDns)
+        advanceLeave();
+
+    return removeFrom(contacts, name);
+}
+
 /** \brief Handles a UNR message.
  *
  * Removes the user in question from the local database and sends an OK back.
  * Sends OK even if user did not exist in local database.
+ * A UNR of ourselves from the DNS means it dropped us, though we are alive: see announceAgain().
+ * With gossip on, the user told only a few members, so we spread its leave to the rest.
  *
- * \param buffer char* Received UNR message in the format 'UNR name.surname'.
+ * \param msg Message* Received UNR message in the format 'UNR name.surname'.
  * \param addr struct sockaddr_in* Address of the sender. Will send OK to this.
  * \param addrLen socklen_t Length of addr.
  *
  */
-void unregisterUser(char* buffer, struct sockaddr_in* addr, socklen_t addrLen)
+void unregisterUser(Message* msg, struct sockaddr_in* addr, socklen_t addrLen)
 {
     int ret;
-    char name[128];
 
-    ret = sscanf(buffer, "%*s %127s", name);
-    if (ret != 1)
+    // Format: UNR name.surname. A DNS that leaves does not name its successor: the one that takes over says so itself
+    if (msg->nFields != 1 || msg->fields[0].len == 0)
     {
-        printf("Malformated UNR message coming from %s. Ignoring:\n%s", inet_ntoa(addr->sin_addr), buffer);
+        printf("Malformated UNR message coming from %s. Ignoring.\n", inet_ntoa(addr->sin_addr));
         return;
     }
 
-    // Our DNS is leaving. Delete its cached data
-    if (nameServer != NULL && strcmp(name, nameServer->name) == 0)
+    char* name = msg->fields[0].str;
+    unsigned int incarnation;
+
+    // Our own: the DNS dropped us, as we did not answer its PNGs. Unless we said we are here already, say so
+    if (strcmp(name, myName) == 0)
     {
-        logm(1, "My DNS %s is leaving. Gotta ask the SS who the new DNS is.\n", nameServer->name);
+        sendReply("OK", 2, addr, addrLen);
 
-        nameServer = NULL;
+        if (joinStatus == Joined && nameServer != NULL && !contactNameIs(nameServer, myName)
+            && nameServer->dnsAddr.sin_addr.s_addr == addr->sin_addr.s_addr && nameServer->dnsAddr.sin_port == addr->sin_port
+            && !(restNumber(msg->rest, "INC", &incarnation) && incarnationNewer(myIncarnation, incarnation)))
+            announceAgain(addr);
+        return;
+    }
+
+    // A UNR from an earlier membership than the one we know of is stale
+    Contact* leaving = get(contacts, name);
+    if (leaving != NULL && restNumber(msg->rest, "INC", &incarnation))
+    {
+        if (incarnationNewer(leaving->incarnation, incarnation))
+        {
+            logm(1, "UNR of %s is from an earlier join. Ignoring it.\n", name);
+            sendReply("OK", 2, addr, addrLen);
+            return;
+        }
+        leaving->incarnation = incarnation;
     }
 
-    Contact* cToRemove = get(contacts, name);
-    if (joinStatus == SearchingNewDns
-        && potentialDnsNode != NULL
-        && strcmp(potentialDnsNode->c->name, cToRemove->name) == 0)
+    if (gossipFanout > 0 && leaving != NULL && !contactNameIs(leaving, myName))
     {
-        // Contact to which we sent the DNS request is also leaving. Consider next contact
-        potentialDnsNode = potentialDnsNode->next;
+        spreadRumor(leaving, 1);
+        gossipStats.started++;
     }
 
     // Remove contact from local database
-    ret = removeFrom(contacts, name);
+    ret = forgetMember(name);
     if (ret == -1)
     {
         printf("Contact %s sent UNR message but does not exist in local database. Sending OK anyway.\n", name);
@@ -446,13 +1246,24 @@ void unregisterUser(char* buffer, struct sockaddr_in* addr, socklen_t addrLen)
     char* okMsg = "OK";
 
     // Send OK reply
-    ret = sendto(dnsSocket, okMsg, strlen(okMsg), 0, (struct sockaddr*) addr, addrLen);
+    ret = sendReply(okMsg, strlen(okMsg), addr, addrLen);
     if (ret == -1)
     {
         printf("Could not send OK to reply UNR to contact %s:", name); perror("");
     }
 }
 
+/** \brief Forgets any LST chunks received before. Called before asking the DNS for a LST.
+ */
+static void resetListTransfer()
+{
+    memset((void*) lstSeen, (int) '\0', sizeof(lstSeen));
+    lstChunksReceived = 0;
+    lstLastChunk = -1;
+    lstRegsSent = 0;
+    oksExpected = 0;
+}
+
 /** \brief Continues join sequence after REG to SS: handles DNS message.
  *
  * The DNS contact is added to the local database.
@@ -460,59 +1271,72 @@ void unregisterUser(char* buffer, struct sockaddr_in* addr, socklen_t addrLen)
  * If we are the DNS, the join sequence is completed.
  * Otherwise, this sends a REG message to the DNS and puts the program in WaitForLST state.
  *
- * \param buffer char* DNS message of the format 'DNS name.surname;ip.ip.ip.ip;dnsport'.
+ * \param msg Message* DNS message of the format 'DNS name.surname;ip.ip.ip.ip;dnsport'.
+ * \param addr struct sockaddr_in* Address of the sender (the Surname Server).
+ * \param addrLen socklen_t Length of addr.
  *
  */
-void continueJoin(char* buffer)
+void continueJoin(Message* msg, struct sockaddr_in* addr, socklen_t addrLen)
 {
     int n;
+    int dnsPort;
 
     // Message should be of the format
     // DNS name.surname;ip.ip.ip.ip;dnsport
+    Field* f = msg->fields;
 
-    Contact* server = malloc(sizeof(Contact));
-
-    char ipBuf[128];
+    Contact* server = newContact();
 
-    // Parse name, dnsPort, save ip onto buffer
-    n = sscanf(buffer, "DNS %[^;];%[^;];%d", (server->name), ipBuf, &(server->dnsPort));
-    if (n != 3)
+    if (msg->nFields != 3 || f[0].len >= NAME_LEN || fieldToInt(&f[2], &dnsPort) != 0
+        || setContactName(server, f[0].str) != 0)
     {
         printf("Server replied abnormally.\n");
+        freeContact(server);
         joinStatus = NotJoined;
+        timerStop(&joinTimer);
         emptyList(contacts);
         return;
     }
 
-    n = inet_aton(ipBuf, &(server->ip));
+    server->dnsPort = dnsPort;
+
+    n = inet_aton(f[1].str, &(server->ip));
     if (n == 0)
     {
         printf("Server replied abnormally: DNS IP invalid.\n");
+        freeContact(server);
         joinStatus = NotJoined;
+        timerStop(&joinTimer);
         return;
     }
 
     nameServer = server;
 
+    // A new roster, which we never synced with
+    syncEpoch = 0;
+    syncVersion = 0;
+    syncing = 0;
+
     // Add DNS to contacts (could be ourselves)
     add(contacts, server);
 
     // Check who the Given Name Server is
-    if (strcmp(server->name, myName) == 0)
+    if (contactNameIs(server, myName))
     {
         // We are the first user with this surname
         joinStatus = Joined;
+        timerStop(&joinTimer);
 
         // Only we know our own talk port at first
-        server->talkPort = myTalkPort;
+        setTalkPort(contacts, server, myTalkPort);
 
         printf("Joined successfully.\n");
     }
     else
     {
         // Add ourselves to list of contacts
-        Contact* me = (Contact*) malloc(sizeof(Contact));
-        strcpy(me->name, myName);
+        Contact* me = newContact();
+        setContactName(me, myName);
         me->ip = myIP;
         me->dnsPort = myDnsPort;
         me->talkPort = myTalkPort;
@@ -521,9 +1345,11 @@ void continueJoin(char* buffer)
 
         // Someone else is the server: contact him to get the list of everyone with our surname
         joinStatus = WaitForLST;
+        resetListTransfer();
 
-        // Prepare REG message again, this time for DNS
-        sprintf(buffer, "REG %s;%s;%d;%d", myName, inet_ntoa(myIP), myTalkPort, myDnsPort);
+        // Prepare REG message again, this time for DNS, with the incarnation of this join
+        char buffer[256];
+        sprintf(buffer, "REG %s;%s;%d;%d\nINC %u", myName, inet_ntoa(myIP), myTalkPort, myDnsPort, myIncarnation);
 
         // Prepare DNS's address
         struct sockaddr_in sendAddr;
@@ -532,12 +1358,13 @@ void continueJoin(char* buffer)
         sendAddr.sin_addr = server->ip;
         sendAddr.sin_port = htons(server->dnsPort);
 
-        // Send message to DNS, await for LST message
-        n = sendto(dnsSocket, buffer, strlen(buffer), 0, (struct sockaddr*) &sendAddr, sizeof(sendAddr));
+        // Send message to DNS, await for LST message. Sent again until the LST comes.
+        n = sendReliable(buffer, &sendAddr);
         if (n == -1)
         {
             perror("Could not send REG message to DNS");
             joinStatus = NotJoined;
+            timerStop(&joinTimer);
             return;
         }
 
@@ -545,18 +1372,78 @@ void continueJoin(char* buffer)
     }
 }
 
+/** \brief Sends REG to members of the family, with as few system calls as possible, and expects their OKs.
+ *
+ * Only the members the REG could be sent to are expected to answer.
+ *
+ * \param members Contact** The members.
+ * \param n int Number of members.
+ * \param regBuffer const char* The REG message.
+ * \return int 0 on success. -1 if the REG could not be sent to some of them.
+ *
+ */
+static int registerWith(Contact** members, int n, const char* regBuffer)
+{
+    struct sockaddr_in addrs[FANOUT_BATCH];
+    int sent[FANOUT_BATCH];
+    int i, start, failed = 0;
+
+    for (start = 0; start < n; start += FANOUT_BATCH)
+    {
+        int count = (n - start < FANOUT_BATCH) ? n - start : FANOUT_BATCH;
+
+        for (i = 0; i < count; i++)
+            addrs[i] = members[start + i]->dnsAddr;
+
+        sendReliableMany(regBuffer, addrs, count, sent);
+
+        for (i = 0; i < count; i++)
+        {
+            Contact* c = members[start + i];
+
+            if (!sent[i])
+            {
+                failed = 1;
+                continue;
+            }
+
+            logm(1, "Sent REG message to %s.\n", contactName(c));
+
+            // We have to keep track of how many OKs we're expecting later
+            c->okExpected = 1;
+            oksExpected++;
+            lstRegsSent++;
+        }
+    }
+
+    return failed ? -1 : 0;
+}
+
 /** \brief Continues join sequence after REG to DNS: handles LST message.
  *
  * Parses the LST message and fills in the local database with the contact data.
- * Sends a registration (REG) message to every contact in the list except ourselves and the DNS.
- * Sets the global variable oksExpected accordingly. Puts the program in the WaitForOK state.
+ * Sends a registration (REG) message to every contact in the list except ourselves and the DNS,
+ * those of each chunk together, with sendReliableMany().
+ * With gossip on, sends it only to gossipFanout members picked at random once the whole LST is in,
+ * and they spread the join to the rest.
+ * Sets the global variable oksExpected accordingly.
+ *
+ * Big lists arrive in several chunks, 'LST seq' followed by some of the contacts,
+ * the last one ending with an empty line. Each chunk is handled as soon as it arrives,
+ * in any order. Once every chunk up to the last one has been received, our REG to the DNS
+ * is acknowledged and the program is put in the WaitForOK state. Until then the REG is sent
+ * again with the same id, and the DNS sends every chunk again, so that lost ones are made up for.
  *
- * \param buffer char* The received LST message.
+ * \param msg Message* The received LST message. Its contacts are in msg->rest.
+ * \param addr struct sockaddr_in* Address of the sender (the DNS).
+ * \param addrLen socklen_t Length of addr.
  *
  */
-void receiveList(char* buffer)
+void receiveList(Message* msg, struct sockaddr_in* addr, socklen_t addrLen)
 {
     int ret, i;
+    int seq = 0;
+    int chunked = (msg->nFields == 1);
 
     if (joinStatus != WaitForLST)
     {
@@ -564,33 +1451,38 @@ void receiveList(char* buffer)
         return;
     }
 
-    char regBuffer[128];
-    sprintf(regBuffer, "REG %s;%s;%d;%d", myName, inet_ntoa(myIP), myTalkPort, myDnsPort);
-
-    // Pointer to the beginning of second line (ignore LST line)
-    char* caret = strchr(buffer, '\n') + 1;
+    if (msg->nFields > 1 || (chunked && (fieldToInt(&msg->fields[0], &seq) != 0 || seq >= LST_MAX_CHUNKS)))
+    {
+        printf("Received malformed LST. Ignoring.\n");
+        return;
+    }
 
-    if (caret == NULL)
+    if (lstSeen[seq])
     {
-        printf("Received malformed LST. Cancelling join.\n");
-        logm(1, "%s\n", buffer);
-        joinStatus = NotJoined;
-        close(dnsSocket);
-        dnsSocket = -1;
-        emptyList(contacts);
-        nameServer = NULL;
+        logm(1, "Received LST chunk %d twice. Ignoring.\n", seq);
         return;
     }
 
-    // Reset OKs counter
-    oksExpected = 0;
+    lstSeen[seq] = 1;
+    lstChunksReceived++;
+
+    char regBuffer[128 + 16];
+    sprintf(regBuffer, "REG %s;%s;%d;%d\nINC %u", myName, inet_ntoa(myIP), myTalkPort, myDnsPort, myIncarnation);
+
+    // Beginning of second line (the LST line was split off by parseMessage)
+    char* caret = msg->rest;
 
     Contact* c;
 
+    // Members of this chunk to send REG to, all at once
+    Contact* newMembers[FANOUT_BATCH];
+    int nNew = 0;
+
     // Check for empty LST
-    if (*caret == '\n' || *caret == '\0')
+    if (!chunked && (*caret == '\n' || *caret == '\0'))
     {
         // DNS refused to aknowledge us, we probably have a duplicated name
+        ackReliable(addr);
         printf("DNS refused registration. Another user has the name %s.\n", myName);
         abortJoin();
         return;
@@ -606,373 +1498,444 @@ void receiveList(char* buffer)
         if (i > 65535)
             break;
 
-        c = (Contact*) malloc(sizeof(Contact));
-        ret = getContactFromMsg(caret, c);
+        // Split off this line, and find the next one
+        char* line = caret;
+        caret = strchr(line, '\n');
+        if (caret != NULL)
+            *caret++ = '\0';
+        else
+            caret = line + strlen(line);
+
+        Field fields[MAX_FIELDS];
+        int nFields = splitFields(line, fields, MAX_FIELDS);
+
+        c = newContact();
+        ret = getContactFromFields(fields, nFields, c);
         if (ret != 0)
         {
             printf("Error on LST, line %d. Ignoring contact.\n", i);
-            free(c);
+            freeContact(c);
             continue;
         }
 
-        // Find the next line
-        caret = strchr(caret + 1, '\n') + 1;
-        if (caret == NULL)
-        {
-            printf("Error on LST, line %d. Join may have been left incomplete.\n", i);
-        }
-
         // Add new contacts, skip ourselves and authorized DNS
-        if (strcmp(c->name, myName) != 0 && strcmp(c->name, nameServer->name) != 0)
+        if (!contactNameIs(c, myName) && !sameName(c, nameServer))
         {
             add(contacts, c);
         }
         else
         {
             // Store the DNS's talkport, since we didn't get it from the SS
-            if (strcmp(c->name, nameServer->name) == 0)
-                nameServer->talkPort = c->talkPort;
+            if (sameName(c, nameServer))
+                setTalkPort(contacts, nameServer, c->talkPort);
 
             // No need for two contacts with the DNS's info
-            free(c);
+            freeContact(c);
             continue;
         }
 
-        // Prepare contacts's address
-        setDnsAddr(c);
+        // Debug and logging
+        logm(1, "Added contact %s to contact list.\n", contactName(c));
 
-        // Send REG message to contact, will receive OK later on
-        ret = sendto(dnsSocket, regBuffer, strlen(regBuffer), 0, (struct sockaddr*) &(c->dnsAddr), sizeof(c->dnsAddr));
-        if (ret == -1)
+        if (gossipFanout > 0)
+            continue;
+
+        // REG is sent to them later on, and they will reply with OK
+        newMembers[nNew++] = c;
+        if (nNew == FANOUT_BATCH)
         {
-            perror("Could not send REG to same-surname contact. Aborting join.");
-            abortJoin();
-            break;
+            ret = registerWith(newMembers, nNew, regBuffer);
+            nNew = 0;
+
+            if (ret == -1)
+            {
+                perror("Could not send REG to same-surname contact. Aborting join.");
+                abortJoin();
+                return;
+            }
         }
+    }
 
-        logm(1, "Sent REG message to %s.\n", c->name);
+    if (nNew > 0 && registerWith(newMembers, nNew, regBuffer) == -1)
+    {
+        perror("Could not send REG to same-surname contact. Aborting join.");
+        abortJoin();
+        return;
+    }
 
-        // We have to keep track of how many OKs we're expecting later
-        c->okExpected = 1;
-        oksExpected++;
+    // A plain LST is complete by itself. A chunked one ends with the chunk that has the empty line
+    if (!chunked || *caret == '\n')
+        lstLastChunk = seq;
 
-        // Debug and logging
-        logm(1, "Added contact %s to contact list.\n", c->name);
+    if (lstLastChunk == -1 || lstChunksReceived < lstLastChunk + 1)
+    {
+        logm(1, "Got LST chunk %d, %d received so far.\n", seq, lstChunksReceived);
+        return;
+    }
+
+    // The whole LST is in: no need to send the REG to the DNS again
+    ackReliable(addr);
+
+    if (gossipFanout > 0)
+    {
+        Contact* picked[GOSSIP_MAX_FANOUT];
+        int n = pickMembers(picked, (gossipFanout < GOSSIP_MAX_FANOUT ? gossipFanout : GOSSIP_MAX_FANOUT), 0);
+
+        if (registerWith(picked, n, regBuffer) == -1)
+        {
+            perror("Could not send REG to same-surname contact. Aborting join.");
+            abortJoin();
+            return;
+        }
     }
 
     if (oksExpected == 0)
     {
-        printf("Join into existing family successful.\n");
+        // Every member we sent a REG to may have replied before the last chunk arrived
+        if (lstRegsSent == 0)
+            printf("Join into existing family successful.\n");
+        else
+            printf("Joined successfully.\n");
         joinStatus = Joined;
+        timerStop(&joinTimer);
     }
     else
+    {
         joinStatus = WaitForOK;
+        awaitOKs();
+    }
 }
 
 /** \brief Continues join sequence after LST: handles OKs.
  *
  * Checks the sender address against the expected addresses. Decrements the oksExpected.
- * Once all OKs have been gotten, the join sequence is complete.
+ * Once all OKs have been gotten, and the whole LST too, the join sequence is complete.
  *
+ * \param msg Message* The received OK.
  * \param addr struct sockaddr_in* Sender address.
  * \param addrLen socklen_t Length of addr.
  *
  */
-void continueJoinOK(struct sockaddr_in* addr, socklen_t addrLen)
+void continueJoinOK(Message* msg, struct sockaddr_in* addr, socklen_t addrLen)
 {
     Contact* c = getByAddr(contacts, addr, addrLen);
 
     if (c != NULL && c->okExpected == 1)
     {
-        logm(1, "OK addr matched: came from %s\n", c->name);
-        c->okExpected = 0;
-        oksExpected--;
+        logm(1, "OK addr matched: came from %s\n", contactName(c));
+        stopExpectingOK(c);
     }
     else
         logm(1, "OK addr did not match any contact...\n");
+}
 
-    if (oksExpected == 0)
+/** \brief Ends the leave: forgets the family and closes the dnsSocket.
+ */
+static void finishLeave()
+{
+    timerStop(&leaveTimer);
+    resetHandover();
+    resetStandby();
+    resetLiveness();
+    resetReliable();
+    resetGossip();
+
+    emptyList(contacts);
+    nameServer = NULL; // was in the list, has already been freed
+
+    reactorRemove(reactor, dnsSocket);
+    close(dnsSocket);
+    dnsSocket = -1;
+
+    joinStatus = NotJoined;
+
+    printf("Left successfully.\n");
+}
+
+/** \brief Moves the leave on to the next state, from the OKs still expected and the step of the handover of the DNS.
+ *
+ * Ends the leave once every member acknowledged our UNR and the handover, if any, is done.
+ *
+ */
+void advanceLeave()
+{
+    if (joinStatus == LeavingUsers && oksExpected > 0)
+        return;
+
+    if (joinStatus != LeavingUsers && joinStatus != SearchingNewDns && joinStatus != UpdatingSS)
+        return;
+
+    switch (handoverPhase())
     {
-        printf("Joined successfully.\n");
-        joinStatus = Joined;
+        case HandoverProbing:
+        case HandoverCommitting:
+            joinStatus = SearchingNewDns;
+            break;
+
+        case HandoverUpdatingSS:
+            joinStatus = UpdatingSS;
+            break;
+
+        default:
+            finishLeave();
     }
 }
 
-/** \brief Continues the leave sequence after UNRs: handles OKs.
+/** \brief Continues the leave sequence after UNRs: handles OKs, and the answers to the handover of the DNS.
  *
  * On LeavingUsers state, receives the OKs from every family member after sending out the UNR messages.
- * On LeavingDNS, sends a DNS message, requesting another user to become the new DNS.
- * On SearchingNewDNS, expects an OK and sends DNS update to Surname Server, or a NOK and asks another user to become the DNS.
- * On LeavingForGood, wraps up and completes the leave sequence.
+ * If we are the DNS, the handover to another member (see handover.c) runs meanwhile, and its answers
+ * are told apart from the OKs of the UNRs.
+ * On SearchingNewDNS and UpdatingSS, every OK came, and the handover is still waiting for a member or the SS.
+ * On LeavingDNS, we were the last member, and the SS acknowledged our UNR.
  *
  * The original protocol did not define a rejection reply to the DNS request.
  * 'NOK' is used, but anything other than 'OK' will work as rejection.
  *
- * \param buffer char* Message received. Normally OK, but may be anything during SearchingNewDNS state.
+ * \param msg Message* Message received. Normally OK, but may be anything from a member asked to be the DNS.
  * \param addr struct sockaddr_in* Sender address.
  * \param addrLen socklen_t Length of addr.
  *
  */
-void continueLeave(char* buffer, struct sockaddr_in* addr, socklen_t addrLen)
+void continueLeave(Message* msg, struct sockaddr_in* addr, socklen_t addrLen)
 {
-    int ret;
+    logm(1, "%s\n", msg->word);
+
+    if (joinStatus == LeavingDNS)
+    {
+        finishLeave();
+        return;
+    }
 
-    logm(1, "%s\n", buffer);
+    if (continueHandover(msg, addr))
+    {
+        advanceLeave();
+        return;
+    }
 
-    if (joinStatus == LeavingUsers)
+    // Plain OKs only. Tagged ones are late answers to other requests
+    if (joinStatus == LeavingUsers && msg->opcode == OpOK && msg->nFields == 0)
     {
         Contact* c = getByAddr(contacts, addr, addrLen);
 
         if (c != NULL && c->okExpected == 1)
         {
-            logm(1, "OK addr matched: came from %s. %d OKs left...\n", c->name, oksExpected);
+            logm(1, "OK addr matched: came from %s. %d OKs left...\n", contactName(c), oksExpected);
             c->okExpected = 0;
             oksExpected--;
         }
         else
             logm(1, "OK addr did not match any contact...\n");
-
-        if (oksExpected == 0)
-            joinStatus = LeavingDNS;
-    }
-
-    if (joinStatus == SearchingNewDns)
-    {
-        char cmd[16];
-        sscanf(buffer, "%15s", cmd);
-
-        if (strcmp("OK", cmd) == 0)
-        {
-            // Peer accepted to be the new DNS. We can leave now
-            joinStatus = LeavingForGood;
-            nameServer = NULL;
-
-            Contact* foundDns = potentialDnsNode->c;
-            sprintf(buffer, "DNS %s;%s;%d", foundDns->name, inet_ntoa(foundDns->ip), foundDns->dnsPort);
-
-            logm(1, "Peer %s is willing to be the new DNS. We can leave now.\n", foundDns->name);
-
-            joinStatus = LeavingForGood;
-
-            // Send DNS change to Surname Server
-            ret = sendto(dnsSocket, buffer, strlen(buffer), 0, (struct sockaddr*) &saAddr, sizeof(saAddr));
-            if (ret == -1)
-            {
-                perror("Could not send new DNS to Surname Server for leaving. Leaving anyway");
-            }
-
-            ret = recvfrom(dnsSocket, buffer, 16, 0, NULL, NULL);
-        }
-    }
-
-    if (joinStatus == LeavingDNS || joinStatus == SearchingNewDns)
-    {
-        // We were this family's DNS. Nominate a new DNS.
-        getNameServer();
-        if (strcmp(nameServer->name, myName) == 0)
-        {
-            joinStatus = SearchingNewDns;
-
-            if (potentialDnsNode == NULL)
-            {
-                potentialDnsNode = contacts->next;
-            }
-            else
-            {
-                potentialDnsNode = potentialDnsNode->next;
-            }
-
-            // Search for contact who is NOT us
-            while (potentialDnsNode != NULL && strcmp(potentialDnsNode->c->name, myName) == 0)
-            {
-                potentialDnsNode = potentialDnsNode->next;
-            }
-
-            if (potentialDnsNode == NULL)
-            {
-                logm(1, "All peers refused to become DNS. Leaving anyway.\n");
-                joinStatus = LeavingForGood;
-            }
-            else
-            {
-                logm(1, "Considering %s to be the new DNS.\n", potentialDnsNode->c->name);
-                Contact* newDns = potentialDnsNode->c;
-
-                char tmpBuffer[128];
-                sprintf(tmpBuffer, "DNS %s;%s;%d", newDns->name, inet_ntoa(newDns->ip), newDns->dnsPort);
-
-                // Propose a contact to become the DNS (he/she may refuse)
-                struct sockaddr_in newDnsAddr;
-                memset((void*)&newDnsAddr, (int)'\0', sizeof(newDnsAddr));
-                newDnsAddr.sin_family = AF_INET;
-                newDnsAddr.sin_addr = newDns->ip;
-                newDnsAddr.sin_port = htons(newDns->dnsPort);
-
-                ret = sendto(dnsSocket, tmpBuffer, strlen(tmpBuffer), 0, (struct sockaddr*) &newDnsAddr, sizeof(newDnsAddr));
-                if (ret == -1)
-                {
-                    perror("Could not send DNS request to peer");
-                    printf("Leaving forcefully.\n");
-                    joinStatus = LeavingForGood;
-                }
-
-                // Await an OK
-                joinStatus = SearchingNewDns;
-            }
-        }
-        else
-        {
-            // We are not the DNS, we are just a regular user
-            // And we've sent UNRs to everyone, our work is done
-            joinStatus = LeavingForGood;
-        }
     }
 
-    if (joinStatus == LeavingForGood)
-    {
-        potentialDnsNode = NULL;
-
-        emptyList(contacts);
-        nameServer = NULL; // was in the list, has already been freed
-
-        close(dnsSocket);
-        dnsSocket = -1;
-
-        joinStatus = NotJoined;
+    advanceLeave();
+}
 
-        printf("Left successfully.\n");
-    }
+/** \brief Timer callback for the members asked to be the new DNS, and for the SS told about it.
+ *
+ * \param arg void* Unused.
+ *
+ */
+void handoverTimedOut(void* arg)
+{
+    handoverStepTimedOut();
+    advanceLeave();
 }
 
 /** \brief Continues the find sequence, after the Surname Server replies with a FW.
  *
- * Parses the FW, gets the target's DNS and sends it a new QRY.
- * May stop the find if the reply was simply "FW" without user data.
+ * Parses the FW, gets the target's DNS and sends it a new QRY, for every find waiting for the DNS of that surname.
+ * May stop the finds if the reply was simply "FW" without user data. That reply names no one,
+ * so it is taken as the answer to the oldest QRY, as the SS answers in order.
  *
- * \param buffer char* Buffer containing the FW from the SS.
+ * \param msg Message* FW message from the SS.
+ * \param addr struct sockaddr_in* Address of the sender.
+ * \param addrLen socklen_t Length of addr.
  *
  */
-void continueFindFW(char* buffer)
+void continueFindFW(Message* msg, struct sockaddr_in* addr, socklen_t addrLen)
 {
-    int ret;
-    char reply[16];
-    char info[128 - 16];
-
-    if (findStatus != WaitForFW)
-    {
-        logm(1, "Got unexpected FW. Ignoring.\n");
-        return;
-    }
+    int dnsPort;
+    Find* f;
 
     // Parse reply
     // Format: FW name.surname;authip;authdnsport
     // ....or: FW
-    ret = sscanf(buffer, "%15s %111s", reply, info);
-    if (ret != 1 && ret != 2)
+    if (msg->nFields == 0)
     {
-        printf("Abnormal FW message gotten. Find failed.\n");
-        findStatus = NotFinding;
+        f = oldestFind(WaitForFW, NULL, NULL);
+        if (f == NULL)
+        {
+            logm(1, "Got unexpected FW. Ignoring.\n");
+            return;
+        }
+
+        // Surname did not exist. Every target with it waited for this FW
+        char surname[NAME_LEN];
+        strcpy(surname, strchr(f->name, '.'));
+
+        while ((f = oldestFind(WaitForFW, surname, NULL)) != NULL)
+        {
+            printf("User %s could not be found.\n", f->name);
+            endFind(f);
+        }
         return;
     }
-    else if (ret == 1)
+
+    char* surname = strchr(msg->fields[0].str, '.');
+    if (surname == NULL || oldestFind(WaitForFW, surname, NULL) == NULL)
     {
-        // User did not exist
-        printf("User %s could not be found.\n", nameToFind);
-        findStatus = NotFinding;
+        logm(1, "Got unexpected FW. Ignoring.\n");
         return;
     }
 
-    char seps[] = ";";
-
-    strtok(info, seps); // ignore name
-    char* ipStr = strtok(NULL, seps);
-    char* tpStr = strtok(NULL, seps);
-
-    // Prepare addr of the authorized DNS for the find-person's surname
+    // Prepare addr of the authorized DNS for the find-person's surname (name is ignored)
     struct sockaddr_in dnsAddr;
     memset((void*)&dnsAddr, (int)'\0', sizeof(dnsAddr));
     dnsAddr.sin_family = AF_INET;
-    inet_aton(ipStr, &dnsAddr.sin_addr);
-    dnsAddr.sin_port = htons(atoi(tpStr));
-
-    // Prepare QRY message again
-    sprintf(buffer, "QRY %s", nameToFind);
-
-    // Debug and logging
-    logm(1, "Message:  %sDestination: %s : %d\n", buffer, inet_ntoa(dnsAddr.sin_addr), ntohs(dnsAddr.sin_port));
 
-    ret = sendto(dnsSocket, buffer, strlen(buffer), 0, (struct sockaddr*) &dnsAddr, sizeof(dnsAddr));
-    if (ret == -1)
+    if (msg->nFields != 3 || inet_aton(msg->fields[1].str, &dnsAddr.sin_addr) == 0
+        || fieldToInt(&msg->fields[2], &dnsPort) != 0)
     {
-        perror("Could not send QRY to DNS");
-        printf("User %s could not be found.\n", nameToFind);
-        findStatus = NotFinding;
+        while ((f = oldestFind(WaitForFW, surname, NULL)) != NULL)
+        {
+            printf("Abnormal FW message gotten. Find of %s failed.\n", f->name);
+            endFind(f);
+        }
         return;
     }
 
-    findStatus = WaitForRPL;
+    dnsAddr.sin_port = htons(dnsPort);
+    cacheDns(surname, &dnsAddr);
+
+    // Ask the DNS about every target with that surname
+    while ((f = oldestFind(WaitForFW, surname, NULL)) != NULL)
+        askDns(f, &dnsAddr, 1, 0);
 }
 
-/** \brief Continues the find sequence, after the DNS replies with a RPL.
+/** \brief Continues the find sequence, after the DNS (or another member of the family) replies with a RPL.
  *
- * Depending on the findMode, prints the found information, or uses it to start a chat call.
+ * The RPL is matched to its find by the name in it, or by the name it echoes on a 'QRY name' line.
+ * An empty RPL that echoes nothing goes to the oldest find waiting for a RPL from that member.
+ * Only the first RPL of a hedged find counts: once it is ended, the late ones are ignored.
+ * An empty one only counts from the DNS, or once every other member asked sent one (see findDenied()),
+ * and only the DNS's is cached.
+ *
+ * Any 'ALT name;ip;dnsport' lines name other members of the family, to hedge QRYs to next time.
+ *
+ * Depending on the mode of the find, prints the found information, or uses it to start a chat call.
  * Prints warning if user was not found (empty RPL message).
  *
- * \param buffer char* Message of the form 'RPL[ name.surname;ip;talkport]'.
+ * \param msg Message* Message of the form 'RPL[ name.surname;ip;talkport]'.
+ * \param addr struct sockaddr_in* Address of the sender.
+ * \param addrLen socklen_t Length of addr.
  *
  */
-void continueFindRPL(char* buffer)
+void continueFindRPL(Message* msg, struct sockaddr_in* addr, socklen_t addrLen)
 {
-    int ret;
+    int talkPort;
+    Find* f = NULL;
+    char* echoed = NULL;
+    struct sockaddr_in alternates[MAX_ALTERNATES];
+    int nAlternates = 0;
+
+    // Extension lines, one per line after the first
+    char* line = msg->rest;
+    while (*line != '\0')
+    {
+        char* end = strchr(line, '\n');
+        if (end != NULL)
+            *end = '\0';
+
+        Field fields[3];
+        int port;
 
-    char cmd[16];
-    char info[128-16];
+        if (strncmp(line, "QRY ", 4) == 0)
+        {
+            echoed = line + 4;
+        }
+        else if (strncmp(line, "ALT ", 4) == 0 && nAlternates < MAX_ALTERNATES
+                 && splitFields(line + 4, fields, 3) == 3 && fieldToInt(&fields[2], &port) == 0)
+        {
+            struct sockaddr_in* a = &(alternates[nAlternates]);
+            memset((void*) a, (int) '\0', sizeof(*a));
+            a->sin_family = AF_INET;
+            a->sin_port = htons(port);
+            if (inet_aton(fields[1].str, &(a->sin_addr)) != 0)
+                nAlternates++;
+        }
 
-    findStatus = NotFinding;
+        if (end == NULL)
+            break;
+        line = end + 1;
+    }
+
+    if (echoed != NULL)
+        f = getFind(echoed);
+    else if (msg->nFields > 0)
+        f = getFind(msg->fields[0].str);
+    else
+        f = oldestFind(WaitForRPL, NULL, addr);
 
-    ret = sscanf(buffer, "%15s %111s", cmd, info);
-    if (ret != 2)
+    if (f == NULL || f->status != WaitForRPL)
     {
-        printf("User %s not found.\n", nameToFind);
+        logm(1, "Got unexpected or late RPL. Ignoring.\n");
         return;
     }
 
-    if (strcmp(cmd, "RPL") != 0)
+    if (nAlternates > 0)
+        cacheAlternates(strchr(f->name, '.'), alternates, nAlternates);
+
+    int target = findTarget(f, addr);
+    if (msg->nFields == 0 && !findDenied(f, target))
     {
-        printf("Got unexpected message during find from the DNS.\n");
+        logm(1, "%s:%d does not know %s. Waiting for the other members asked.\n",
+             inet_ntoa(addr->sin_addr), ntohs(addr->sin_port), f->name);
         return;
     }
 
-    if (strcmp(buffer, "RPL") == 0)
+    if (target > 0)
+        findStats.hedgeWins++;
+
+    FindMode mode = f->mode;
+    char nameToFind[NAME_LEN];
+    strcpy(nameToFind, f->name);
+    endFind(f);
+
+    if (msg->nFields == 0)
     {
         printf("User %s not found.\n", nameToFind);
+
+        // Other members may just not have heard of a join yet
+        if (target == 0)
+            cachePeer(nameToFind, NULL);
         return;
     }
 
     // Format: RPL name.surname;ip;talkport
-    char name[128];
-    char ipStr[128];
-    int talkPort;
-
-    ret = sscanf(buffer, "RPL %[^;];%[^;];%d", name, ipStr, &talkPort);
-    if (ret != 3)
+    if (msg->nFields != 3 || fieldToInt(&msg->fields[2], &talkPort) != 0)
     {
         printf("Given Name Server replied abnormally. User %s not found.\n", nameToFind);
         return;
     }
 
-    if (findMode == FindForFind)
+    char* name = msg->fields[0].str;
+    char* ipStr = msg->fields[1].str;
+
+    struct sockaddr_in peerAddr;
+    memset((void*) &peerAddr, (int) '\0', sizeof(peerAddr));
+    peerAddr.sin_family = AF_INET;
+    peerAddr.sin_port = htons(talkPort);
+
+    if (inet_aton(ipStr, &peerAddr.sin_addr) != 0)
+        cachePeer(name, &peerAddr);
+
+    if (mode == FindForFind)
     {
         printf("User %s is at %s:%d.\n", name, ipStr, talkPort);
     }
-    else if (findMode == FindForConnect)
+    else if (mode == FindForConnect)
     {
-        struct sockaddr_in peerAddr;
-        memset((void*) &peerAddr, (int) '\0', sizeof(peerAddr));
-        peerAddr.sin_family = AF_INET;
-        inet_aton(ipStr, &peerAddr.sin_addr);
-        peerAddr.sin_port = htons(talkPort);
-
         startChatCall(name, peerAddr);
     }
 }
@@ -1006,24 +1969,31 @@ void startChatCall(char* name, struct sockaddr_in peerAddr)
         perror("Could not connect TCP socket to user");
         close(talkSocket);
         talkSocket = -1;
+
+        // The address may have come from the cache, and be stale
+        uncachePeer(name);
         return;
     }
 
+    if (reactorAddStream(reactor, talkSocket, talkReceived, NULL) == -1)
+        reactorAdd(reactor, talkSocket, REACTOR_EDGE, talkReadable, NULL);
+
     printf("Connected to user %s.\n", name);
 }
 
 /** \brief Handles a request to become DNS.
  *
- * Sends OK and sets the global variable nameServer if request was accepted.
+ * Sends 'OK DNS' and sets the global variable nameServer if request was accepted.
+ * An offer, 'DNS name.surname;ip;dnsPort;OFFER', is answered 'OK OFFER' instead, and changes nothing.
  * Sends NOK otherwise. Request will not be accepted if the user is already leaving.
  * Message will be ignored if it does not contain our name.
  *
- * \param buffer char* DNS message received
+ * \param msg Message* DNS message received
  * \param addr struct sockaddr_in* Address of the sender. (N)OK will be sent to this.
  * \param addrLen socklen_t Length of addr.
  *
  */
-void becomeDNS(char* buffer, struct sockaddr_in* addr, socklen_t addrLen)
+void becomeDNS(Message* msg, struct sockaddr_in* addr, socklen_t addrLen)
 {
     // If we are not joined and stable, refuse the DNS promotion
     // Let the leaving DNS choose another user to be the DNS
@@ -1033,49 +2003,96 @@ void becomeDNS(char* buffer, struct sockaddr_in* addr, socklen_t addrLen)
     logm(1, "Got request to become DNS.\n");
 
     // Check message validity
-    char otherName[NAME_LEN];
-    ret = sscanf(buffer, "DNS %[^;]", otherName);
-    if (ret != 1)
+    if (msg->nFields < 1 || msg->fields[0].len == 0)
     {
-        if (sendto(dnsSocket, "NOK", strlen("NOK"), 0, (struct sockaddr*) addr, addrLen) == -1)
+        if (sendReply("NOK", strlen("NOK"), addr, addrLen) == -1)
         {
             perror("Could not send NOK to DNS request");
         }
         return;
     }
 
+    // An offer ('DNS name;ip;port;OFFER') only asks if we are willing. Another member may be told to take over instead.
+    // STANDBY asks us to be ready to take over, and NEW is a member telling us it took over
+    const char* tag = (msg->nFields >= 4) ? msg->fields[3].str : "";
+    int offer = (strcmp(tag, "OFFER") == 0);
+
+    if (strcmp(tag, "NEW") == 0)
+    {
+        dnsTookOver(msg, addr, addrLen);
+        return;
+    }
+
     if (joinStatus <= Joined)
     {
         // Check if the name is actually ours
+        char* otherName = msg->fields[0].str;
         if (strcmp(myName, otherName) != 0)
         {
             logm(1, "DNS request did not have our name. Replying with NOK.\n");
 
             char* nokMsg = "NOK - That was not my name";
-            ret = sendto(dnsSocket, nokMsg, strlen(nokMsg), 0, (struct sockaddr*) addr, addrLen);
+            ret = sendReply(nokMsg, strlen(nokMsg), addr, addrLen);
             if (ret == -1)
                 perror("Could not send NOK in reply to DNS request");
             return;
         }
 
+        // Only a member that has the whole roster can be the standby
+        if (strcmp(tag, "STANDBY") == 0)
+        {
+            int willing = (joinStatus == Joined || joinStatus == WaitForOK)
+                          && (nameServer == NULL || !contactNameIs(nameServer, myName));
+            char* reply = willing ? "OK STANDBY" : "NOK - Not fully joined, can't be standby.";
+
+            if (sendReply(reply, strlen(reply), addr, addrLen) == -1)
+                perror("Could not reply to the request to become the standby DNS");
+
+            if (willing)
+            {
+                standBy(addr);
+                logm(1, "Became the standby DNS by request of %s.\n", inet_ntoa(addr->sin_addr));
+            }
+            return;
+        }
+
+        if (offer)
+        {
+            char* okMsg = "OK OFFER";
+
+            if (sendReply(okMsg, strlen(okMsg), addr, addrLen) == -1)
+                perror("Could not send OK to the offer to become the new DNS");
+
+            logm(1, "Willing to become the DNS, as %s offered.\n", inet_ntoa(addr->sin_addr));
+            return;
+        }
+
         // From now on, we are the new DNS
         nameServer = get(contacts, otherName);
 
-        char* okMsg = "OK";
+        char* okMsg = "OK DNS";
 
-        ret = sendto(dnsSocket, okMsg, strlen(okMsg), 0, (struct sockaddr*) addr, addrLen);
+        ret = sendReply(okMsg, strlen(okMsg), addr, addrLen);
         if (ret == -1)
         {
             perror("Could not send OK to become the new DNS");
         }
 
         logm(1, "Became the DNS by request of %s.\n", inet_ntoa(addr->sin_addr));
+
+        // Our own standby, other than the DNS that is leaving
+        Contact* leaving = getByAddr(contacts, addr, addrLen);
+        designateStandby(leaving != NULL ? contactName(leaving) : NULL);
+        watchMembers();
+
+        // Only now that we took over do the members learn who the DNS is. Any other candidate was never named
+        announceTakeOver(addr, 0);
     }
     else
     {
         char* okMsg = "NOK - Not fully joined, can't be DNS.";
 
-        ret = sendto(dnsSocket, okMsg, strlen(okMsg), 0, (struct sockaddr*) addr, addrLen);
+        ret = sendReply(okMsg, strlen(okMsg), addr, addrLen);
         if (ret == -1)
         {
             perror("Could not send NOK to reject becoming DNS");
@@ -1085,38 +2102,415 @@ void becomeDNS(char* buffer, struct sockaddr_in* addr, socklen_t addrLen)
     }
 }
 
-/** \brief Handles a received message on the Talk Socket during a chat call.
+/** \brief Handles a SYN: sends a member the changes to the roster since the version it knows.
  *
- * Prints the received message in human-redable form to STDOUT.
- * Attempts to separate different messages marked by MSS.
+ * Only the DNS answers. If the change log still goes back to that version, and the changes fit
+ * in one datagram, replies 'DLT epoch;version' followed by a '+name.surname;ip;talkPort;dnsPort'
+ * line for every added or updated contact and a '-name.surname' line for every removed one.
+ * Otherwise, sends the whole roster in 'DLT epoch;version;seq' chunks, like a chunked LST.
  *
- * \param buffer char* Received message, including any MSS and name of the sender.
+ * \param msg Message* SYN message, of the format 'SYN epoch;version'.
+ * \param addr struct sockaddr_in* Address of the sender. DLT will be sent to this.
+ * \param addrLen socklen_t Length of addr.
  *
  */
-void receiveMessage(char* buffer)
+void replyToSync(Message* msg, struct sockaddr_in* addr, socklen_t addrLen)
 {
-    int nRead = read(talkSocket, buffer, 2047);
+    int ret, i;
+    unsigned int epoch, version;
 
-    if (nRead <= 0)
+    if (nameServer == NULL || !contactNameIs(nameServer, myName))
     {
-        close(talkSocket);
-        talkSocket = -1;
+        logm(1, "Got SYN, but we are not the DNS. Ignoring.\n");
+        return;
+    }
+
+    if (msg->nFields != 2 || fieldToUnsigned(&msg->fields[0], &epoch) != 0
+        || fieldToUnsigned(&msg->fields[1], &version) != 0)
+    {
+        printf("Malformed SYN message from %s.\n", inet_ntoa(addr->sin_addr));
+        return;
+    }
+
+    int maxPayload = maxPayloadTo(addr, addrLen);
+
+    const Change* changes[CHANGE_LOG_SIZE];
+    int n = (epoch == contacts->epoch) ? changesSince(contacts, version, changes, CHANGE_LOG_SIZE) : -1;
+
+    if (n >= 0)
+    {
+        char delta[LST_CHUNK_MAX + 1];
+        int len = sprintf(delta, "DLT %u;%u\n", contacts->epoch, contacts->version);
+
+        // Added contacts are sent as they are now. If they were removed since, a later change says so
+        for (i = 0; i < n && len < maxPayload; i++)
+        {
+            Contact* c = changes[i]->removed ? NULL : get(contacts, changes[i]->name);
+
+            if (changes[i]->removed)
+                len += snprintf(delta + len, sizeof(delta) - len, "-%s\n", changes[i]->name);
+            else if (c != NULL)
+                len += snprintf(delta + len, sizeof(delta) - len, "+%.*s", c->wireLen - WIRE_LST_OFFSET, c->wire + WIRE_LST_OFFSET);
+        }
+
+        if (len < maxPayload)
+        {
+            delta[len++] = '\n';
+
+            ret = sendto(dnsSocket, delta, len, 0, (struct sockaddr*) addr, addrLen);
+            if (ret == -1)
+                perror("Could not send DLT");
+
+            logm(1, "Sent %d roster changes to %s.\n", n, inet_ntoa(addr->sin_addr));
+            return;
+        }
+    }
+
+    // Changes are not known, or too many: send everything
+    int lstLen;
+    const char* lst = getListMessage(contacts, &lstLen);
+
+    char header[64];
+    sprintf(header, "DLT %u;%u;", contacts->epoch, contacts->version);
+
+    ret = sendChunks(header, strchr(lst, '\n') + 1, lst + lstLen - 1, maxPayload, addr, addrLen);
+    if (ret == -1)
+        perror("Could not send full roster for SYN");
+    else
+        logm(1, "Sent full roster to %s in %d chunks.\n", inet_ntoa(addr->sin_addr), ret);
+}
+
+/** \brief Adds or updates a contact, as the DNS or a gossip said it is now.
+ *
+ * Ourselves and the DNS are never replaced, only the DNS's talk port is taken.
+ * A contact from an earlier incarnation than the one we know is not taken either.
+ * Marks the contact as synced.
+ *
+ * \param c Contact* Contact allocated with newContact(). Added to the contacts, or freed.
+ *
+ */
+static void syncContact(Contact* c)
+{
+    Contact* known = get(contacts, contactName(c));
+
+    if (known != NULL && nameServer != NULL && sameName(known, nameServer))
+    {
+        setTalkPort(contacts, nameServer, c->talkPort);
+    }
+    else if (known != NULL && c->incarnation != 0 && incarnationNewer(known->incarnation, c->incarnation))
+    {
+        logm(1, "Contact %s is from an earlier join. Keeping the one we know.\n", contactName(c));
+    }
+    else if (known != NULL && !contactNameIs(known, myName)
+             && (known->ip.s_addr != c->ip.s_addr || known->talkPort != c->talkPort || known->dnsPort != c->dnsPort))
+    {
+        // Same name, but somewhere else: a member that left and came back
+        removeFrom(contacts, contactName(c));
+        known = NULL;
+    }
+
+    if (known != NULL)
+    {
+        if (incarnationNewer(c->incarnation, known->incarnation))
+            known->incarnation = c->incarnation;
+        known->synced = 1;
+        freeContact(c);
+        return;
+    }
+
+    add(contacts, c);
+    c->synced = 1;
+    logm(1, "Sync added contact %s.\n", contactName(c));
+}
+
+/** \brief Parses a line with a contact, as in a LST, into a new contact.
+ *
+ * \param line char* Line of the format 'name.surname;ip;talkPort;dnsPort'. Will be overwritten.
+ * \return Contact* Contact allocated with newContact(), or NULL if the line is malformed.
+ *
+ */
+static Contact* contactFromLine(char* line)
+{
+    Field fields[MAX_FIELDS];
+    int nFields = splitFields(line, fields, MAX_FIELDS);
+
+    Contact* c = newContact();
+    if (getContactFromFields(fields, nFields, c) != 0)
+    {
+        freeContact(c);
+        return NULL;
+    }
+
+    return c;
+}
+
+/** \brief Parses a line of a GSP, after its '+' or '-', into a new contact.
+ *
+ * \param line char* Line of the format 'name.surname;ip;talkPort;dnsPort;incarnation'. Will be overwritten.
+ * Older members send no incarnation, which is taken as 0.
+ * \return Contact* Contact allocated with newContact(), or NULL if the line is malformed.
+ *
+ */
+static Contact* contactFromGossip(char* line)
+{
+    Field fields[MAX_FIELDS];
+    unsigned int incarnation = 0;
+    int nFields = splitFields(line, fields, MAX_FIELDS);
+
+    if (nFields == 5)
+    {
+        if (fieldToUnsigned(&fields[4], &incarnation) != 0)
+            return NULL;
+        nFields = 4;
+    }
+
+    Contact* c = newContact();
+    if (getContactFromFields(fields, nFields, c) != 0)
+    {
+        freeContact(c);
+        return NULL;
+    }
+
+    c->incarnation = incarnation;
+    return c;
+}
+
+/** \brief Adds or updates a contact with a line of the roster received from the DNS.
+ *
+ * \param line char* Line of the format 'name.surname;ip;talkPort;dnsPort'. Will be overwritten.
+ * \return int 0 on success. -1 if the line is malformed.
+ *
+ */
+static int syncContactLine(char* line)
+{
+    Contact* c = contactFromLine(line);
+    if (c == NULL)
+        return -1;
+
+    syncContact(c);
+    return 0;
+}
+
+/** \brief Handles a DLT: applies the roster changes, or the whole roster, sent by the DNS in reply to a SYN.
+ *
+ * A full roster may come in several chunks, in any order. Once all of them have arrived,
+ * every contact that was not in it is removed.
+ *
+ * \param msg Message* DLT message, of the format 'DLT epoch;version[;seq]'.
+ * \param addr struct sockaddr_in* Address of the sender (the DNS).
+ * \param addrLen socklen_t Length of addr.
+ *
+ */
+void receiveDelta(Message* msg, struct sockaddr_in* addr, socklen_t addrLen)
+{
+    static unsigned int fullEpoch = 0, fullVersion = 0;
+
+    unsigned int epoch, version;
+    int seq = 0, i, ret, changes = 0;
+    int full = (msg->nFields == 3);
+
+    if (!syncing || joinStatus != Joined)
+    {
+        logm(1, "Received DLT without asking for one. Ignoring.\n");
+        return;
+    }
+
+    if ((msg->nFields != 2 && msg->nFields != 3)
+        || fieldToUnsigned(&msg->fields[0], &epoch) != 0 || fieldToUnsigned(&msg->fields[1], &version) != 0
+        || (full && (fieldToInt(&msg->fields[2], &seq) != 0 || seq >= LST_MAX_CHUNKS)))
+    {
+        printf("Received malformed DLT. Ignoring.\n");
+        return;
+    }
+
+    if (full)
+    {
+        // First chunk of a full roster: start marking the contacts the DNS still has
+        if (lstChunksReceived == 0 || epoch != fullEpoch || version != fullVersion)
+        {
+            Node* p;
+            resetListTransfer();
+            for (p = contacts->next; p != NULL; p = p->next)
+                p->c->synced = 0;
+
+            fullEpoch = epoch;
+            fullVersion = version;
+        }
+
+        if (lstSeen[seq])
+            return;
+
+        lstSeen[seq] = 1;
+        lstChunksReceived++;
+    }
+
+    char* caret = msg->rest;
+
+    for (i = 1; *caret != '\n' && *caret != '\0'; i++)
+    {
+        char* line = caret;
+        caret = strchr(line, '\n');
+        if (caret != NULL)
+            *caret++ = '\0';
+        else
+            caret = line + strlen(line);
+
+        // A full roster has plain LST lines. Changes start with '+' or '-'
+        if (full)
+            ret = syncContactLine(line);
+        else if (*line == '+')
+            ret = syncContactLine(line + 1);
+        else if (*line == '-')
+        {
+            // Never remove ourselves, and the DNS is only removed by its UNR
+            if (strcmp(line + 1, myName) != 0 && (nameServer == NULL || !contactNameIs(nameServer, line + 1)))
+                removeFrom(contacts, line + 1);
+            ret = 0;
+        }
+        else
+            ret = -1;
 
-        if (nRead == 0)
-            printf("Connection closed by partner.\n");
+        if (ret == 0)
+            changes++;
         else
-            printf("Connection forcefully closed by partner.\n");
+            printf("Error on DLT, line %d. Ignoring it.\n", i);
+    }
+
+    if (full)
+    {
+        if (*caret == '\n')
+            lstLastChunk = seq;
+
+        if (lstLastChunk == -1 || lstChunksReceived < lstLastChunk + 1)
+            return;
+
+        // Whole roster received. Drop whoever is not in it anymore
+        Node* p = contacts->next;
+        while (p != NULL)
+        {
+            Contact* c = p->c;
+            p = p->next;
+
+            if (!c->synced && c != nameServer && !contactNameIs(c, myName))
+                removeFrom(contacts, contactName(c));
+        }
+
+        resetListTransfer();
+    }
+
+    // The standby syncs with every heartbeat. Only the syncs the user asked for are reported
+    if (heartbeatAnswered())
+        logm(2, "Heartbeat answered. Roster at version %u.\n", version);
+    else if (full)
+        printf("Roster synced to version %u: full roster of %d contacts.\n", version, contacts->length);
+    else
+        printf("Roster synced to version %u: %d changes.\n", version, changes);
+
+    syncEpoch = epoch;
+    syncVersion = version;
+    syncing = 0;
+}
+
+/** \brief Handles a GSP: joins and leaves of members, passed on by the members that heard of them.
+ *
+ * Every change that is news to us is applied, and passed on in our own gossip rounds.
+ * A leave only removes the member if we know of no later incarnation of it. Without incarnations,
+ * only if it is still at the address it left from.
+ *
+ * \param msg Message* GSP message, with a '+name.surname;ip;talkPort;dnsPort;incarnation' line for every join
+ * and a '-name.surname;ip;talkPort;dnsPort;incarnation' line for every leave.
+ * \param addr struct sockaddr_in* Address of the sender.
+ * \param addrLen socklen_t Length of addr.
+ *
+ */
+void receiveGossip(Message* msg, struct sockaddr_in* addr, socklen_t addrLen)
+{
+    int i;
+    char* caret = msg->rest;
 
+    if (joinStatus != Joined && joinStatus != WaitForOK)
+    {
+        logm(1, "Received GSP while not joined. Ignoring.\n");
         return;
     }
 
-    // Make absolutely sure we won't print garbage
-    buffer[nRead] = '\0';
+    for (i = 1; *caret != '\n' && *caret != '\0'; i++)
+    {
+        char* line = caret;
+        caret = strchr(line, '\n');
+        if (caret != NULL)
+            *caret++ = '\0';
+        else
+            caret = line + strlen(line);
+
+        int removed = (*line == '-');
+        Contact* c = (*line == '+' || removed) ? contactFromGossip(line + 1) : NULL;
+        if (c == NULL)
+        {
+            printf("Error on GSP, line %d. Ignoring it.\n", i);
+            continue;
+        }
+
+        if (contactNameIs(c, myName) || !rumorIsNews(c, removed))
+        {
+            freeContact(c);
+            continue;
+        }
+
+        gossipStats.learned++;
+        spreadRumor(c, removed);
+
+        if (!removed)
+        {
+            logm(1, "Heard that %s joined.\n", contactName(c));
+            syncContact(c);
+            continue;
+        }
+
+        Contact* known = get(contacts, contactName(c));
+        int current = (known != NULL)
+                      && (c->incarnation != 0 ? !incarnationNewer(known->incarnation, c->incarnation)
+                                              : known->ip.s_addr == c->ip.s_addr && known->dnsPort == c->dnsPort);
+        if (current)
+        {
+            logm(1, "Heard that %s left.\n", contactName(c));
+            forgetMember(contactName(c));
+        }
+        freeContact(c);
+    }
+}
 
+/** \brief Closes the talkSocket after the partner ended the call.
+ *
+ * \param nRead int What the last read returned: 0 if the partner closed the call, -1 on error.
+ *
+ */
+static void endCall(int nRead)
+{
+    close(talkSocket);
+    talkSocket = -1;
+
+    if (nRead == 0)
+        printf("Connection closed by partner.\n");
+    else
+        printf("Connection forcefully closed by partner.\n");
+}
+
+/** \brief Prints received chat messages in human-redable form to STDOUT.
+ *
+ * Attempts to separate different messages marked by MSS.
+ *
+ * \param buffer char* Received bytes, null-terminated, including any MSS and name of the sender.
+ *
+ */
+static void printMessage(char* buffer)
+{
     char nameBuf[NAME_LEN];
-    char messageBuf[2048];
     char* mssStart = strstr(buffer, "MSS ");
 
+    // Reads of the io_uring backend can be longer than our own 2048-byte ones
+    char messageBuf[URING_BUFFER_SIZE];
+
     // Print remainder of last message
     if (mssStart != NULL)
         *mssStart = '\0';
@@ -1157,3 +2551,66 @@ void receiveMessage(char* buffer)
     // Flush even if message did not contain '\n'
     fflush(stdout);
 }
+
+/** \brief Handles a received message on the Talk Socket during a chat call. Never blocks.
+ *
+ * Prints the received message in human-redable form to STDOUT.
+ *
+ * \param buffer char* Where the message is received to.
+ * \return int Number of bytes read. 0 if there was nothing to read, or if the call ended.
+ *
+ */
+int receiveMessage(char* buffer)
+{
+    int nRead = recv(talkSocket, buffer, 2047, MSG_DONTWAIT);
+
+    if (nRead == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return 0;
+
+    if (nRead <= 0)
+    {
+        reactorRemove(reactor, talkSocket);
+        endCall(nRead);
+        return 0;
+    }
+
+    // Make absolutely sure we won't print garbage
+    buffer[nRead] = '\0';
+
+    printMessage(buffer);
+    return nRead;
+}
+
+/** \brief Reactor callback with bytes read from the talkSocket, when the reactor reads them itself.
+ *
+ * \param fd int The talkSocket.
+ * \param data char* Bytes read, null-terminated, in a buffer of the reactor.
+ * \param len int Number of bytes read. 0 if the partner closed the call, -1 on error.
+ * \param arg void* Unused.
+ *
+ */
+void talkReceived(int fd, char* data, int len, void* arg)
+{
+    if (fd != talkSocket)
+        return;
+
+    // On 0 or -1, the reactor has unregistered the socket already
+    if (len <= 0)
+        endCall(len);
+    else
+        printMessage(data);
+}
+
+/** \brief Reactor callback for the talkSocket. Reads and prints everything received.
+ *
+ * \param fd int The talkSocket.
+ * \param arg void* Unused.
+ *
+ */
+void talkReadable(int fd, void* arg)
+{
+    static char buffer[2048];
+
+    while (talkSocket == fd && receiveMessage(buffer) > 0)
+        ;
+}
@@ -1,29 +1,126 @@
 #ifndef SERVER_H_INCLUDED
 #define SERVER_H_INCLUDED
 
+/** \brief Counters of the dnsSocket receive and send paths.
+ */
+typedef struct BatchStats
+{
+    /** Receive system calls that got datagrams, and receive system calls made. */
+    long wakeups;
+    long recvCalls;
+
+    /** Datagrams received. */
+    long datagrams;
+
+    /** Replies sent with sendReply(), and send system calls made for them. */
+    long replies;
+    long sendCalls;
+} BatchStats;
+
+extern BatchStats batchStats;
+
+/** \brief Opcodes of the messages received on the dnsSocket.
+ */
+typedef enum
+{
+    OpUnknown,
+    OpQRY,
+    OpREG,
+    OpUNR,
+    OpLST,
+    OpDNS,
+    OpOK,
+    OpFW,
+    OpRPL,
+    OpNOK,
+    OpSYN,
+    OpDLT,
+    OpGSP,
+    OpPNG,
+    OpALV,
+    OpCount
+} Opcode;
+
+/** QRY flag, asked for with an 'ECHO' line after the first one: echo the name in the RPL, as a 'QRY name' line,
+ * so that an empty RPL can be told apart from the others. Old servers ignore the extra lines. */
+#define QUERY_ECHO 1
+
+/** QRY flag, asked for with an 'ALT' line: list other members of the family in the RPL, as 'ALT name;ip;dnsport' lines. */
+#define QUERY_ALT 2
+
+/** Largest number of ';'-separated fields in the first line of a message. */
+#define MAX_FIELDS 8
+
+/** \brief A slice of a received message. Null-terminated in place by parseMessage().
+ */
+typedef struct Field
+{
+    char* str;
+    int len;
+} Field;
+
+/** \brief A received message, split once by parseMessage().
+ *
+ * The first line after the opcode is split on ';' into fields.
+ * Any further lines (the contacts of a LST) are left in 'rest'.
+ */
+typedef struct Message
+{
+    Opcode opcode;
+
+    /** First word of the message, as received. */
+    char* word;
+
+    int nFields;
+    Field fields[MAX_FIELDS];
+
+    /** Lines after the first one. Never NULL, may be empty. */
+    char* rest;
+} Message;
+
 int prepareTalkServer();
 
-void parseServerCommand();
+int parseServerCommand();
+void dnsReadable(int fd, void* arg);
+void dnsDatagram(char* data, int len, struct sockaddr_in* addr, socklen_t addrLen, void* arg);
+void dnsBatchEnd(void* arg);
+void handleServerMessage(char* buffer, struct sockaddr_in* addr, socklen_t addrLen);
+int parseMessage(char* buffer, Message* out_msg);
+int splitFields(char* line, Field* out_fields, int maxFields);
+int sendReply(const char* msg, int len, struct sockaddr_in* addr, socklen_t addrLen);
+int queryFlags(const char* rest);
+int restNumber(const char* rest, const char* key, unsigned int* out_value);
 
-void replyToQuery(char* argument, struct sockaddr_in* addr, socklen_t addrLen);
-void acceptCall();
-void registerNewUser(char* newUserREG, struct sockaddr_in* addr, socklen_t addrLen);
-void unregisterUser(char* userUNR, struct sockaddr_in* addr, socklen_t addrLen);
-void receiveList();
+void replyToQuery(Message* msg, struct sockaddr_in* addr, socklen_t addrLen);
+int acceptCall();
+void talkServerReadable(int fd, void* arg);
+void registerNewUser(Message* msg, struct sockaddr_in* addr, socklen_t addrLen);
+void unregisterUser(Message* msg, struct sockaddr_in* addr, socklen_t addrLen);
+void receiveList(Message* msg, struct sockaddr_in* addr, socklen_t addrLen);
 
-void continueJoin(char* buffer);
-void continueJoinOK(struct sockaddr_in* addr, socklen_t addrLen);
+void continueJoin(Message* msg, struct sockaddr_in* addr, socklen_t addrLen);
+void continueJoinOK(Message* msg, struct sockaddr_in* addr, socklen_t addrLen);
 
-void continueLeave(char* buffer, struct sockaddr_in* addr, socklen_t addrLen);
+void continueLeave(Message* msg, struct sockaddr_in* addr, socklen_t addrLen);
+void advanceLeave();
+void handoverTimedOut(void* arg);
 
-void continueFindFW(char* buffer);
-void continueFindRPL(char* buffer);
+void continueFindFW(Message* msg, struct sockaddr_in* addr, socklen_t addrLen);
+void continueFindRPL(Message* msg, struct sockaddr_in* addr, socklen_t addrLen);
 void startChatCall(char* name, struct sockaddr_in peerAddr);
 
-void receiveMessage(char* buffer);
+int receiveMessage(char* buffer);
+void talkReadable(int fd, void* arg);
+void talkReceived(int fd, char* data, int len, void* arg);
+
+void becomeDNS(Message* msg, struct sockaddr_in* addr, socklen_t addrLen);
+
+void replyToSync(Message* msg, struct sockaddr_in* addr, socklen_t addrLen);
+void receiveDelta(Message* msg, struct sockaddr_in* addr, socklen_t addrLen);
+void receiveGossip(Message* msg, struct sockaddr_in* addr, socklen_t addrLen);
 
-void becomeDNS(char* buffer, struct sockaddr_in* addr, socklen_t addrLen);
+int forgetMember(const char* name);
 
-int getContactFromMsg(char* message, Contact* out_contact);
+int getContactFromFields(Field* fields, int nFields, Contact* out_contact);
 
 #endif // SERVER_H_INCLUDED
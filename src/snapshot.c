@@ -0,0 +1,269 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "list.h"
+#include "names.h"
+#include "debug.h"
+#include "snapshot.h"
+
+/** Largest number of threads reading snapshots at once. */
+#define MAX_READERS 64
+
+/** Smallest number of slots of a snapshot. */
+#define SNAPSHOT_MIN_SLOTS 16
+
+/** Reclamation epoch. Advanced every time a snapshot is replaced. Starts at 1, since 0 marks idle readers. */
+static unsigned long globalEpoch = 1;
+
+/** Epoch each reader pinned when it started reading, or 0 if it is not reading. */
+static unsigned long readerEpochs[MAX_READERS];
+
+/** 1 for reader slots handed out by snapshotReader(). */
+static int readerUsed[MAX_READERS];
+
+/** Replaced snapshots not freed yet, newest first. Only touched by the thread that publishes. */
+static Snapshot* retired = NULL;
+
+static long snapshotsPublished = 0;
+static long snapshotsFreed = 0;
+
+/** \brief Builds a snapshot of the current contents of a list.
+ *
+ * \param list List* List to be copied.
+ * \return Snapshot* The snapshot, in a single allocation. NULL if out of memory.
+ *
+ */
+static Snapshot* buildSnapshot(List* list)
+{
+    Node* p;
+    unsigned int nSlots = SNAPSHOT_MIN_SLOTS;
+    size_t stringsLen = 0;
+
+    while (nSlots < 2 * (unsigned int) list->length)
+        nSlots *= 2;
+
+    for (p = list->next; p != NULL; p = p->next)
+        stringsLen += p->c->rplLen;
+
+    size_t slotsBytes = nSlots * sizeof(SnapshotEntry);
+    Snapshot* s = malloc(sizeof(Snapshot) + slotsBytes + list->filter.size + stringsLen);
+    if (s == NULL)
+        return NULL;
+
+    s->version = list->version;
+    s->mask = nSlots - 1;
+    s->slots = (SnapshotEntry*) (s + 1);
+    s->filter = list->filter;
+    s->filter.counters = (unsigned char*) s->slots + slotsBytes;
+    s->strings = (char*) s->filter.counters + list->filter.size;
+    s->retired = 0;
+    s->nextRetired = NULL;
+
+    memset((void*) s->slots, (int) '\0', slotsBytes);
+    memcpy(s->filter.counters, list->filter.counters, list->filter.size);
+
+    unsigned int offset = 0;
+    for (p = list->next; p != NULL; p = p->next)
+    {
+        Contact* c = p->c;
+        unsigned int hash = hashContactName(c);
+        unsigned int i = hash & s->mask;
+
+        while (s->slots[i].rplLen != 0)
+            i = (i + 1) & s->mask;
+
+        s->slots[i].hash = hash;
+        s->slots[i].offset = offset;
+        s->slots[i].rplLen = c->rplLen;
+        s->slots[i].nameLen = strlen(c->givenName) + 1 + strlen(c->surname);
+
+        memcpy(s->strings + offset, c->wire, c->rplLen);
+        offset += c->rplLen;
+    }
+
+    return s;
+}
+
+/** \brief Frees every replaced snapshot that no reader can be holding anymore.
+ *
+ * A snapshot replaced in epoch e can only be held by readers that pinned epoch e or older.
+ * Called by the thread that publishes snapshots.
+ */
+void reclaimSnapshots()
+{
+    int i;
+    unsigned long oldest = __atomic_load_n(&globalEpoch, __ATOMIC_SEQ_CST);
+
+    for (i = 0; i < MAX_READERS; i++)
+    {
+        unsigned long pinned = __atomic_load_n(&(readerEpochs[i]), __ATOMIC_SEQ_CST);
+        if (pinned != 0 && pinned < oldest)
+            oldest = pinned;
+    }
+
+    Snapshot** link = &retired;
+    while (*link != NULL)
+    {
+        Snapshot* s = *link;
+        if (s->retired < oldest)
+        {
+            *link = s->nextRetired;
+            free(s);
+            snapshotsFreed++;
+        }
+        else
+            link = &(s->nextRetired);
+    }
+}
+
+/** \brief Publishes a snapshot of a list for snapshotQuery(), if the list changed since the last one.
+ *
+ * Called by the thread that changes the list, after a batch of changes, so that
+ * many changes in a row cost a single copy. The replaced snapshot is freed once
+ * every reader that could be holding it is done.
+ *
+ * \param list List* List to be published.
+ *
+ */
+void publishSnapshot(List* list)
+{
+    if (list->snapshot != NULL && list->snapshot->version == list->version)
+    {
+        if (retired != NULL)
+            reclaimSnapshots();
+        return;
+    }
+
+    Snapshot* s = buildSnapshot(list);
+    if (s == NULL)
+    {
+        printf("Could not allocate memory for a snapshot of the contact list.\n");
+        return;
+    }
+
+    Snapshot* old = __atomic_exchange_n(&(list->snapshot), s, __ATOMIC_SEQ_CST);
+    snapshotsPublished++;
+
+    if (old != NULL)
+    {
+        // Readers that pin the next epoch can only see the new snapshot
+        old->retired = __atomic_load_n(&globalEpoch, __ATOMIC_SEQ_CST);
+        old->nextRetired = retired;
+        retired = old;
+        __atomic_add_fetch(&globalEpoch, 1, __ATOMIC_SEQ_CST);
+    }
+
+    reclaimSnapshots();
+}
+
+/** \brief Gets a reader slot, needed by every thread that calls snapshotQuery().
+ *
+ * \return int The reader slot, or -1 if there are MAX_READERS readers already.
+ *
+ */
+int snapshotReader()
+{
+    int i;
+
+    for (i = 0; i < MAX_READERS; i++)
+    {
+        int unused = 0;
+        if (__atomic_compare_exchange_n(&(readerUsed[i]), &unused, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+            return i;
+    }
+
+    return -1;
+}
+
+/** \brief Gives back a reader slot obtained with snapshotReader().
+ *
+ * \param reader int The reader slot.
+ *
+ */
+void releaseReader(int reader)
+{
+    if (reader < 0 || reader >= MAX_READERS)
+        return;
+
+    __atomic_store_n(&(readerEpochs[reader]), 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&(readerUsed[reader]), 0, __ATOMIC_RELEASE);
+}
+
+/** \brief Answers a query from the published snapshot of a list, without taking any lock.
+ *
+ * May be called from any thread with a reader slot, while another thread changes the list.
+ * Changes made since the last publishSnapshot() are not seen. Keeps the query counters of the list.
+ *
+ * \param list List* List to be searched.
+ * \param reader int Reader slot of the calling thread, from snapshotReader().
+ * \param name const char* Name of the contact, in the format name.surname.
+ * \param out_reply char* Where the RPL will be written. Not null-terminated.
+ * \param max int Size of out_reply. Must be at least 3.
+ * \return int Length of the reply. 3 if the contact does not exist (an empty 'RPL').
+ *
+ */
+int snapshotQuery(List* list, int reader, const char* name, char* out_reply, int max)
+{
+    unsigned int hash = hashName(name);
+    int nameLen = strlen(name);
+    int len = 3;
+
+    memcpy(out_reply, "RPL", 3);
+    __atomic_add_fetch(&(list->queries), 1, __ATOMIC_RELAXED);
+
+    // Pin the current epoch before loading the snapshot, so that it is not freed under us
+    __atomic_store_n(&(readerEpochs[reader]), __atomic_load_n(&globalEpoch, __ATOMIC_SEQ_CST), __ATOMIC_SEQ_CST);
+    Snapshot* s = __atomic_load_n(&(list->snapshot), __ATOMIC_SEQ_CST);
+
+    if (s == NULL)
+    {
+        // Nothing published yet
+    }
+    else if (!bloomMayContain(&(s->filter), hash))
+    {
+        __atomic_add_fetch(&(list->filtered), 1, __ATOMIC_RELAXED);
+    }
+    else
+    {
+        unsigned int i;
+        SnapshotEntry* e = NULL;
+
+        for (i = hash & s->mask; s->slots[i].rplLen != 0; i = (i + 1) & s->mask)
+        {
+            SnapshotEntry* slot = &(s->slots[i]);
+            if (slot->hash == hash && slot->nameLen == nameLen
+                && memcmp(s->strings + slot->offset + 4, name, nameLen) == 0)
+            {
+                e = slot;
+                break;
+            }
+        }
+
+        if (e == NULL)
+            __atomic_add_fetch(&(list->falsePositives), 1, __ATOMIC_RELAXED);
+        else if (e->rplLen <= max)
+        {
+            memcpy(out_reply, s->strings + e->offset, e->rplLen);
+            len = e->rplLen;
+        }
+    }
+
+    __atomic_store_n(&(readerEpochs[reader]), 0, __ATOMIC_RELEASE);
+
+    return len;
+}
+
+/** \brief Prints the snapshot counters. Debug function.
+ */
+void printSnapshotStats()
+{
+    int waiting = 0;
+    Snapshot* s;
+
+    for (s = retired; s != NULL; s = s->nextRetired)
+        waiting++;
+
+    printf("Snapshots: %ld published, %ld freed, %d waiting for readers.\n",
+           snapshotsPublished, snapshotsFreed, waiting);
+}
@@ -0,0 +1,55 @@
+#ifndef SNAPSHOT_H_INCLUDED
+#define SNAPSHOT_H_INCLUDED
+
+#include "list.h"
+#include "bloom.h"
+
+/** \brief A slot of the hash table of a snapshot. Empty slots have rplLen 0.
+ */
+typedef struct SnapshotEntry
+{
+    unsigned int hash;
+
+    /** Offset of the RPL in the strings of the snapshot. The name starts 4 bytes later. */
+    unsigned int offset;
+
+    unsigned short rplLen;
+    unsigned short nameLen;
+} SnapshotEntry;
+
+/** \brief An immutable copy of the RPLs of a list, answering queries from other threads without locks.
+ *
+ * Built by the thread that changes the list and published with an atomic pointer swap.
+ * Readers pin the snapshot they are using, and replaced snapshots are only freed once no reader
+ * can still hold them. A snapshot is a single allocation: header, slots, filter counters and RPLs.
+ */
+typedef struct Snapshot
+{
+    /** Version of the list it was built from. */
+    unsigned int version;
+
+    /** Number of slots minus 1. Slots are never more than half full. */
+    unsigned int mask;
+    SnapshotEntry* slots;
+
+    /** Copy of the name filter of the list. */
+    Bloom filter;
+
+    /** RPLs of every contact, one after the other. */
+    char* strings;
+
+    /** Reclamation epoch in which it was replaced, and next replaced snapshot waiting to be freed. */
+    unsigned long retired;
+    struct Snapshot* nextRetired;
+} Snapshot;
+
+void publishSnapshot(List* list);
+void reclaimSnapshots();
+
+int snapshotReader();
+void releaseReader(int reader);
+int snapshotQuery(List* list, int reader, const char* name, char* out_reply, int max);
+
+void printSnapshotStats();
+
+#endif // SNAPSHOT_H_INCLUDED
@@ -0,0 +1,459 @@
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/socket.h>
+
+#include "globals.h"
+#include "debug.h"
+#include "list.h"
+#include "reliable.h"
+#include "commands.h"
+#include "standby.h"
+#include "liveness.h"
+
+StandbyStats standbyStats;
+
+/** As the standby: the DNS that asked us to be its standby. Heartbeats go to it. */
+static struct sockaddr_in watchedAddr;
+
+/** As the DNS: full name of the member asked to be the standby. Empty if none. */
+static char standbyName[NAME_LEN];
+
+/** Boolean. 1 once the member said it is the standby. */
+static int standbyConfirmed = 0;
+
+/** Members asked in a row that refused. */
+static int attempts = 0;
+
+/** As a member: boolean, 1 while we are the standby of the DNS. */
+static int standingBy = 0;
+
+/** Boolean. 1 while a heartbeat waits for its DLT. */
+static int heartbeatPending = 0;
+
+/** Heartbeats in a row the DNS left unanswered. */
+static int missed = 0;
+
+static Timer heartbeatTimer;
+static int timerReady = 0;
+
+/** \brief Gets the standby, as the DNS.
+ *
+ * \return Contact* The member that accepted to be the standby, or NULL if none did.
+ *
+ */
+Contact* getStandby()
+{
+    if (standbyName[0] == '\0' || !standbyConfirmed)
+        return NULL;
+
+    return get(contacts, standbyName);
+}
+
+/** \brief Checks if we are the standby of the DNS.
+ */
+int isStandby()
+{
+    return standingBy;
+}
+
+/** \brief Stops the heartbeats, when we are not the standby anymore.
+ */
+static void stopStandingBy()
+{
+    standingBy = 0;
+    heartbeatPending = 0;
+    missed = 0;
+
+    if (timerReady)
+        timerStop(&heartbeatTimer);
+}
+
+/** \brief Asks the member with the lowest RTT measured to be the standby.
+ *
+ * Format: 'DNS name.surname;ip;dnsPort;STANDBY'. The member answers 'OK STANDBY' if it accepts.
+ *
+ * \param exclude const char* Full name of a member not to ask, or NULL.
+ *
+ */
+static void askMember(const char* exclude)
+{
+    char skip[NAME_LEN] = "";
+    char buffer[NAME_LEN + 64];
+    Contact* best = NULL;
+    long bestRtt = LONG_MAX;
+    Node* p;
+
+    if (exclude != NULL)
+    {
+        strncpy(skip, exclude, NAME_LEN - 1);
+        skip[NAME_LEN - 1] = '\0';
+    }
+
+    for (p = contacts->next; p != NULL; p = p->next)
+    {
+        if (contactNameIs(p->c, myName) || contactNameIs(p->c, skip))
+            continue;
+
+        long rtt = measuredRtt(&(p->c->dnsAddr));
+        if (rtt < 0)
+            rtt = LONG_MAX;
+
+        if (best == NULL || rtt < bestRtt)
+        {
+            best = p->c;
+            bestRtt = rtt;
+        }
+    }
+
+    if (best == NULL)
+        return;
+
+    strncpy(standbyName, contactName(best), NAME_LEN - 1);
+    standbyName[NAME_LEN - 1] = '\0';
+    standbyConfirmed = 0;
+
+    sprintf(buffer, "DNS %s;%s;%d;STANDBY", standbyName, inet_ntoa(best->ip), best->dnsPort);
+
+    if (sendReliable(buffer, &(best->dnsAddr)) == -1)
+    {
+        perror("Could not ask a member to be the standby");
+        standbyName[0] = '\0';
+        return;
+    }
+
+    standbyStats.designated++;
+    attempts++;
+
+    logm(1, "Asked %s to be the standby DNS.\n", standbyName);
+}
+
+/** \brief As the DNS, picks a standby, if there is none yet, or one was asked and did not answer yet.
+ *
+ * The standby keeps its roster up to date with heartbeats, and takes over if we stop answering them.
+ * When we leave, it is told to take over at once.
+ *
+ * \param exclude const char* Full name of a member not to pick, such as one that is leaving, or NULL.
+ *
+ */
+void designateStandby(const char* exclude)
+{
+    if (!isServer() || joinStatus != Joined)
+        return;
+
+    // The DNS is never the standby of anyone
+    stopStandingBy();
+
+    if (standbyName[0] != '\0')
+        return;
+
+    attempts = 0;
+    askMember(exclude);
+}
+
+/** \brief Handles the answer of the member asked to be the standby, as the DNS.
+ *
+ * On a refusal, asks another member, up to STANDBY_ATTEMPTS in a row.
+ *
+ * \param msg Message* OK, NOK or anything else, from a member.
+ * \param addr struct sockaddr_in* Sender.
+ * \return int 1 if the message was the answer of the standby.
+ *
+ */
+int continueStandby(Message* msg, struct sockaddr_in* addr)
+{
+    if (standbyName[0] == '\0' || standbyConfirmed)
+        return 0;
+
+    Contact* c = get(contacts, standbyName);
+    if (c == NULL || c->dnsAddr.sin_addr.s_addr != addr->sin_addr.s_addr || c->dnsAddr.sin_port != addr->sin_port)
+        return 0;
+
+    if (msg->opcode == OpOK && msg->nFields > 0 && strcmp(msg->fields[0].str, "STANDBY") == 0)
+    {
+        standbyConfirmed = 1;
+        attempts = 0;
+        standbyStats.accepted++;
+
+        logm(1, "%s is the standby DNS.\n", standbyName);
+        return 1;
+    }
+
+    if (msg->opcode == OpOK)
+        return 0;
+
+    char refuser[NAME_LEN];
+    strcpy(refuser, standbyName);
+    standbyName[0] = '\0';
+
+    logm(1, "%s refused to be the standby DNS.\n", refuser);
+
+    if (attempts < STANDBY_ATTEMPTS)
+        askMember(refuser);
+
+    return 1;
+}
+
+/** \brief Tells every member that we are the DNS now, with 'DNS name.surname;ip;dnsPort;NEW'.
+ *
+ * \param oldAddr struct sockaddr_in* DNS address of the DNS we took over from. It is not told,
+ * unless tellOld is set, even if it is still in the roster.
+ * \param tellOld int 1 to tell the old DNS too, in case it was only slow.
+ *
+ */
+void announceTakeOver(struct sockaddr_in* oldAddr, int tellOld)
+{
+    char buffer[NAME_LEN + 64];
+    struct sockaddr_in addrs[FANOUT_BATCH];
+    int sent[FANOUT_BATCH];
+    int n = 0;
+    Node* p;
+
+    sprintf(buffer, "DNS %s;%s;%d;NEW", myName, inet_ntoa(myIP), myDnsPort);
+
+    if (tellOld)
+        addrs[n++] = *oldAddr;
+
+    for (p = contacts->next; p != NULL; p = p->next)
+    {
+        if (contactNameIs(p->c, myName)
+            || (p->c->dnsAddr.sin_addr.s_addr == oldAddr->sin_addr.s_addr && p->c->dnsAddr.sin_port == oldAddr->sin_port))
+            continue;
+
+        addrs[n++] = p->c->dnsAddr;
+        if (n == FANOUT_BATCH)
+        {
+            standbyStats.announced += sendReliableMany(buffer, addrs, n, sent);
+            n = 0;
+        }
+    }
+
+    if (n > 0)
+        standbyStats.announced += sendReliableMany(buffer, addrs, n, sent);
+}
+
+/** \brief Takes over as the DNS, after the DNS left too many heartbeats unanswered.
+ *
+ * Drops the old DNS from the roster, tells the SS, and tells every member with
+ * 'DNS name.surname;ip;dnsPort;NEW'. The old DNS is told too, in case it was only slow.
+ *
+ */
+static void promote()
+{
+    char oldName[NAME_LEN];
+    char buffer[NAME_LEN + 64];
+
+    Contact* old = getByAddr(contacts, &watchedAddr, sizeof(watchedAddr));
+    strcpy(oldName, (old != NULL) ? contactName(old) : inet_ntoa(watchedAddr.sin_addr));
+
+    printf("DNS %s stopped answering. Taking over as DNS.\n", oldName);
+
+    stopStandingBy();
+    syncing = 0;
+    standbyStats.promotions++;
+
+    nameServer = get(contacts, myName);
+    if (old != NULL)
+        forgetMember(oldName);
+
+    sprintf(buffer, "DNS %s;%s;%d", myName, inet_ntoa(myIP), myDnsPort);
+    if (sendto(dnsSocket, buffer, strlen(buffer), 0, (struct sockaddr*) &saAddr, sizeof(saAddr)) == -1)
+        perror("Could not send new DNS to Surname Server");
+
+    announceTakeOver(&watchedAddr, 1);
+
+    designateStandby(NULL);
+    watchMembers();
+}
+
+/** \brief Timer callback. Sends a heartbeat to the DNS, as a SYN, or takes over if too many went unanswered.
+ */
+static void heartbeat(void* arg)
+{
+    if (!standingBy)
+        return;
+
+    if (joinStatus == Joined && !isServer())
+    {
+        if (heartbeatPending)
+        {
+            missed++;
+            standbyStats.missed++;
+        }
+
+        if (missed >= STANDBY_MISSED_HEARTBEATS)
+        {
+            promote();
+            return;
+        }
+
+        char buffer[64];
+        sprintf(buffer, "SYN %u;%u", syncEpoch, syncVersion);
+
+        if (sendto(dnsSocket, buffer, strlen(buffer), 0, (struct sockaddr*) &watchedAddr, sizeof(watchedAddr)) == -1)
+            perror("Could not send heartbeat to DNS");
+
+        heartbeatPending = 1;
+        syncing = 1;
+        standbyStats.heartbeats++;
+    }
+
+    timerStart(&heartbeatTimer, STANDBY_HEARTBEAT_MS);
+}
+
+/** \brief Becomes the standby of the DNS, as it asked. Starts the heartbeats.
+ *
+ * \param dnsAddr struct sockaddr_in* Address of the DNS.
+ *
+ */
+void standBy(struct sockaddr_in* dnsAddr)
+{
+    int lstLen;
+
+    if (!timerReady)
+    {
+        timerInit(&heartbeatTimer, heartbeat, NULL);
+        timerReady = 1;
+    }
+
+    watchedAddr = *dnsAddr;
+    standingBy = 1;
+    heartbeatPending = 0;
+    missed = 0;
+
+    // Ready to be sent to the first member that joins, should we take over
+    getListMessage(contacts, &lstLen);
+
+    timerStart(&heartbeatTimer, STANDBY_HEARTBEAT_MS);
+}
+
+/** \brief Tells the standby that the DNS answered, with a DLT. Called once a DLT has been applied.
+ *
+ * \return int 1 if the DLT was the answer to a heartbeat, rather than to a sync asked for by the user.
+ *
+ */
+int heartbeatAnswered()
+{
+    int wasHeartbeat = heartbeatPending;
+    int lstLen;
+
+    heartbeatPending = 0;
+    missed = 0;
+
+    if (standingBy)
+        getListMessage(contacts, &lstLen);
+
+    return wasHeartbeat;
+}
+
+/** \brief Counts any datagram from the DNS we watch as a sign it is alive, even if a DLT was lost.
+ *
+ * \param addr struct sockaddr_in* Sender of a datagram received on the dnsSocket.
+ *
+ */
+void heardFrom(struct sockaddr_in* addr)
+{
+    if (standingBy && addr->sin_addr.s_addr == watchedAddr.sin_addr.s_addr && addr->sin_port == watchedAddr.sin_port)
+        missed = 0;
+}
+
+/** \brief Forgets the standby role of a member that left. Called before it is removed from the contacts.
+ *
+ * As the standby, stops watching the DNS if it is the one leaving: it hands over by itself.
+ * As the DNS, asks someone else if the standby is the one leaving.
+ *
+ * \param name const char* Full name of the member.
+ *
+ */
+void standbyMemberLeft(const char* name)
+{
+    Contact* c = get(contacts, name);
+
+    if (standingBy && c != NULL
+        && c->dnsAddr.sin_addr.s_addr == watchedAddr.sin_addr.s_addr && c->dnsAddr.sin_port == watchedAddr.sin_port)
+    {
+        logm(1, "DNS %s is leaving. Not its standby anymore.\n", name);
+        stopStandingBy();
+    }
+
+    if (standbyName[0] != '\0' && strcmp(standbyName, name) == 0)
+    {
+        standbyName[0] = '\0';
+        standbyConfirmed = 0;
+        designateStandby(name);
+    }
+}
+
+/** \brief Handles 'DNS name.surname;ip;dnsPort;NEW': a member that took over as DNS, after the DNS failed or left.
+ *
+ * Only believed if it comes from that member. If we were the DNS, we are not anymore, and
+ * register again, as the new DNS and the members dropped us. Otherwise the DNS it took over from is dropped.
+ *
+ * \param msg Message* DNS message.
+ * \param addr struct sockaddr_in* Sender. OK is sent to this.
+ * \param addrLen socklen_t Length of addr.
+ *
+ */
+void dnsTookOver(Message* msg, struct sockaddr_in* addr, socklen_t addrLen)
+{
+    Contact* c = get(contacts, msg->fields[0].str);
+
+    if (c == NULL || contactNameIs(c, myName)
+        || c->dnsAddr.sin_addr.s_addr != addr->sin_addr.s_addr || c->dnsAddr.sin_port != addr->sin_port)
+    {
+        if (sendReply("NOK", 3, addr, addrLen) == -1)
+            perror("Could not send NOK to new DNS");
+        return;
+    }
+
+    int wasServer = isServer();
+
+    if (wasServer)
+        printf("%s took over as DNS. We are not the DNS anymore.\n", contactName(c));
+    else
+        logm(1, "%s took over as DNS.\n", contactName(c));
+
+    stopStandingBy();
+    standbyName[0] = '\0';
+    standbyConfirmed = 0;
+
+    // The DNS it took over from stopped answering. It is not in the roster anymore
+    if (nameServer != NULL && nameServer != c && !contactNameIs(nameServer, myName))
+    {
+        char oldName[NAME_LEN];
+
+        strcpy(oldName, contactName(nameServer));
+        forgetMember(oldName);
+    }
+
+    nameServer = c;
+
+    if (sendReply("OK", 2, addr, addrLen) == -1)
+        perror("Could not send OK to new DNS");
+
+    // We were only slow. The new DNS, and every member, dropped us: join them again
+    if (wasServer && joinStatus == Joined)
+        announceAgain(addr);
+}
+
+/** \brief Forgets the standby, and stops being one. Called when leaving the family.
+ */
+void resetStandby()
+{
+    stopStandingBy();
+    standbyName[0] = '\0';
+    standbyConfirmed = 0;
+    attempts = 0;
+}
+
+/** \brief Prints the counters of the standby DNS.
+ */
+void printStandbyStats()
+{
+    Contact* s = getStandby();
+
+    printf("Standby:      %s; %ld asked, %ld accepted; %ld heartbeats, %ld missed; %ld take-overs, %ld members told\n",
+           (standingBy ? "we are the standby" : (s != NULL ? contactName(s) : "none")),
+           standbyStats.designated, standbyStats.accepted, standbyStats.heartbeats, standbyStats.missed,
+           standbyStats.promotions, standbyStats.announced);
+}
@@ -0,0 +1,50 @@
+#ifndef STANDBY_H_INCLUDED
+#define STANDBY_H_INCLUDED
+
+#include "server.h"
+
+/** Interval between the heartbeats of the standby to the DNS, in milliseconds. Each one is a SYN. */
+#define STANDBY_HEARTBEAT_MS 300
+
+/** Heartbeats in a row the DNS may leave unanswered before the standby takes over.
+ * Many short ones rather than a few long ones: with 15% loss each way a false take-over is rare. */
+#define STANDBY_MISSED_HEARTBEATS 10
+
+/** Members the DNS asks in a row to be the standby, after refusals, before waiting for the next join or leave. */
+#define STANDBY_ATTEMPTS 3
+
+/** \brief Counters of the standby DNS.
+ */
+typedef struct StandbyStats
+{
+    /** Members asked to be the standby, as the DNS, and how many accepted. */
+    long designated;
+    long accepted;
+
+    /** Heartbeats sent, as the standby, and those left unanswered. */
+    long heartbeats;
+    long missed;
+
+    /** Times we took over from a DNS that stopped answering, and members told about it. */
+    long promotions;
+    long announced;
+} StandbyStats;
+
+extern StandbyStats standbyStats;
+
+Contact* getStandby();
+int isStandby();
+
+void designateStandby(const char* exclude);
+int continueStandby(Message* msg, struct sockaddr_in* addr);
+void standBy(struct sockaddr_in* dnsAddr);
+int heartbeatAnswered();
+void heardFrom(struct sockaddr_in* addr);
+void standbyMemberLeft(const char* name);
+void announceTakeOver(struct sockaddr_in* oldAddr, int tellOld);
+void dnsTookOver(Message* msg, struct sockaddr_in* addr, socklen_t addrLen);
+void resetStandby();
+
+void printStandbyStats();
+
+#endif // STANDBY_H_INCLUDED
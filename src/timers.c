@@ -0,0 +1,266 @@
+#include <stdio.h>
+#include <time.h>
+
+#include "debug.h"
+#include "timers.h"
+
+/** Bits of the tick each level of the wheel is indexed by. */
+#define WHEEL_BITS 6
+
+/** Slots in each level of the wheel. */
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+
+/** Levels of the wheel. Level L holds the timers due within 64^(L+1) ticks, so 4 levels cover about 46 hours. */
+#define WHEEL_LEVELS 4
+
+/** The wheel: a list of pending timers in each slot of each level. */
+static Timer* wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+
+/** Next tick to be processed. Every tick before it has been. */
+static unsigned long long currentTick = 0;
+
+/** Number of pending timers. */
+static int nTimers = 0;
+
+/** \brief Gets a timestamp from the monotonic clock, in nanoseconds. Every timestamp of the program comes from it.
+ */
+long long nowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/** \brief Gets a monotonic timestamp, in microseconds.
+ */
+long long nowUs()
+{
+    return nowNs() / 1000;
+}
+
+/** \brief Gets a monotonic timestamp, in milliseconds.
+ */
+long long nowMs()
+{
+    return nowNs() / 1000000;
+}
+
+/** \brief Gets the current tick.
+ */
+static unsigned long long nowTick()
+{
+    return (unsigned long long) nowMs() / TIMER_TICK_MS;
+}
+
+/** \brief Puts a timer in the slot its expiry tick belongs to, relative to the current tick.
+ */
+static void enqueue(Timer* t)
+{
+    unsigned long long delta = t->expires - currentTick;
+    int level = 0;
+
+    // Each level has 64 times the span of the previous one. The last one takes anything further away.
+    while (level < WHEEL_LEVELS - 1 && delta >= (1ULL << (WHEEL_BITS * (level + 1))))
+        level++;
+
+    if (level == WHEEL_LEVELS - 1 && delta >= (1ULL << (WHEEL_BITS * WHEEL_LEVELS)))
+        t->expires = currentTick + (1ULL << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+
+    Timer** slot = &(wheel[level][(t->expires >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1)]);
+
+    t->next = *slot;
+    if (t->next != NULL)
+        t->next->pprev = &(t->next);
+    t->pprev = slot;
+    *slot = t;
+}
+
+/** \brief Takes a timer out of its slot.
+ */
+static void dequeue(Timer* t)
+{
+    *(t->pprev) = t->next;
+    if (t->next != NULL)
+        t->next->pprev = t->pprev;
+
+    t->next = NULL;
+    t->pprev = NULL;
+}
+
+/** \brief Sets up a timer. It is not pending until started.
+ *
+ * \param t Timer* The timer.
+ * \param callback TimerCallback Called with arg when the timer expires.
+ * \param arg void* Passed to callback.
+ *
+ */
+void timerInit(Timer* t, TimerCallback callback, void* arg)
+{
+    t->next = NULL;
+    t->pprev = NULL;
+    t->expires = 0;
+    t->callback = callback;
+    t->arg = arg;
+}
+
+/** \brief Starts a timer, or moves its deadline if it is pending already.
+ *
+ * \param t Timer* The timer, set up with timerInit().
+ * \param ms int Milliseconds from now until it expires.
+ *
+ */
+void timerStart(Timer* t, int ms)
+{
+    if (t->pprev != NULL)
+        timerStop(t);
+
+    // An idle wheel may not have been advanced for a while
+    unsigned long long now = nowTick();
+    if (nTimers == 0 && currentTick < now)
+        currentTick = now;
+
+    t->expires = now + (ms + TIMER_TICK_MS - 1) / TIMER_TICK_MS;
+    if (t->expires < currentTick)
+        t->expires = currentTick;
+
+    enqueue(t);
+    nTimers++;
+}
+
+/** \brief Stops a timer, so that it never expires. Does nothing if it is not pending.
+ *
+ * \param t Timer* The timer.
+ *
+ */
+void timerStop(Timer* t)
+{
+    if (t->pprev == NULL)
+        return;
+
+    dequeue(t);
+    nTimers--;
+}
+
+/** \brief Checks if a timer is pending.
+ *
+ * \return int 1 if the timer was started and has neither expired nor been stopped.
+ *
+ */
+int timerPending(Timer* t)
+{
+    return (t->pprev != NULL);
+}
+
+/** \brief Gets how long the event loop may wait before runTimers() has work to do.
+ *
+ * Timers in the higher levels are not looked at one by one: the wait ends when
+ * their slot is due to be spread over the level below, which is never later than they are.
+ *
+ * \return int Milliseconds, 0 if there are expired timers, or -1 if there are no timers.
+ *
+ */
+int timersTimeout()
+{
+    int level, i;
+    unsigned long long next = ~0ULL;
+
+    if (nTimers == 0)
+        return -1;
+
+    for (i = 0; i < WHEEL_SLOTS; i++)
+    {
+        if (wheel[0][(currentTick + i) & (WHEEL_SLOTS - 1)] != NULL)
+        {
+            next = currentTick + i;
+            break;
+        }
+    }
+
+    // A higher level may have to be spread out before the earliest timer of a lower one
+    for (level = 1; level < WHEEL_LEVELS; level++)
+    {
+        int shift = WHEEL_BITS * level;
+
+        for (i = 0; i <= WHEEL_SLOTS; i++)
+        {
+            unsigned long long block = (currentTick >> shift) + i;
+            unsigned long long start = block << shift;
+
+            if (start >= next)
+                break;
+
+            if (start >= currentTick && wheel[level][block & (WHEEL_SLOTS - 1)] != NULL)
+            {
+                next = start;
+                break;
+            }
+        }
+    }
+
+    unsigned long long now = nowTick();
+    if (next <= now)
+        return 0;
+
+    return (int) ((next - now) * TIMER_TICK_MS);
+}
+
+/** \brief Spreads the timers of a slot of a higher level over the levels below.
+ */
+static void cascade(int level, int index)
+{
+    Timer* t = wheel[level][index];
+    wheel[level][index] = NULL;
+
+    while (t != NULL)
+    {
+        Timer* next = t->next;
+        enqueue(t);
+        t = next;
+    }
+}
+
+/** \brief Calls the callbacks of every expired timer. Called by the event loop after every wait.
+ *
+ * Callbacks may start and stop any timers, including the one that expired.
+ */
+void runTimers()
+{
+    unsigned long long now = nowTick();
+
+    if (nTimers == 0)
+    {
+        if (currentTick <= now)
+            currentTick = now + 1;
+        return;
+    }
+
+    while (currentTick <= now)
+    {
+        int level = 1;
+        int index = currentTick & (WHEEL_SLOTS - 1);
+
+        // At the start of each block of a level, bring its timers down to the levels below.
+        // Highest level first, since its timers may belong in the block of the level below that starts now.
+        while (level < WHEEL_LEVELS && (currentTick & ((1ULL << (WHEEL_BITS * level)) - 1)) == 0)
+            level++;
+
+        for (level--; level >= 1; level--)
+            cascade(level, (currentTick >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1));
+
+        // One at a time, since a callback may stop the other timers of the slot
+        while (wheel[0][index] != NULL)
+        {
+            Timer* t = wheel[0][index];
+            dequeue(t);
+            nTimers--;
+
+            logm(3, "Timer %p expired.\n", (void*) t);
+            t->callback(t->arg);
+        }
+
+        currentTick++;
+
+        if (nTimers == 0 && currentTick <= now)
+            currentTick = now + 1;
+    }
+}
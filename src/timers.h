@@ -0,0 +1,42 @@
+#ifndef TIMERS_H_INCLUDED
+#define TIMERS_H_INCLUDED
+
+/** Resolution of the timers, in milliseconds. Deadlines are rounded up to it. */
+#define TIMER_TICK_MS 10
+
+/** \brief Called when a timer expires. The timer is no longer pending, and may be started again.
+ */
+typedef void (*TimerCallback)(void* arg);
+
+/** \brief A deadline, kept in the timer wheel while pending.
+ *
+ * Owned by the caller, usually as a static or a member of a bigger struct.
+ * Must be set up with timerInit() before use.
+ */
+typedef struct Timer
+{
+    struct Timer* next;
+
+    /** Link that points to this timer, or NULL if the timer is not pending. */
+    struct Timer** pprev;
+
+    /** Tick on which the timer expires. */
+    unsigned long long expires;
+
+    TimerCallback callback;
+    void* arg;
+} Timer;
+
+void timerInit(Timer* t, TimerCallback callback, void* arg);
+void timerStart(Timer* t, int ms);
+void timerStop(Timer* t);
+int timerPending(Timer* t);
+
+int timersTimeout();
+void runTimers();
+
+long long nowNs();
+long long nowUs();
+long long nowMs();
+
+#endif // TIMERS_H_INCLUDED
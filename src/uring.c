@@ -0,0 +1,727 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+
+#if defined(__linux__) && !defined(NO_IO_URING) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+
+#include "debug.h"
+#include "uring.h"
+
+/* Deferred task running, the newest feature used, needs Linux 6.1 headers. Older ones, or -DNO_IO_URING, build without the backend. */
+#ifdef IORING_SETUP_DEFER_TASKRUN
+
+/** Entries of the ring used for receives and polls. */
+#define URING_ENTRIES 256
+
+/** Entries of the ring used for sends. Sends of more messages are split. */
+#define URING_SEND_ENTRIES 64
+
+/** Number of receive buffers. Must be a power of 2. */
+#define URING_BUFFERS 256
+
+/** Buffer group the receive buffers are registered as. */
+#define URING_BUFFER_GROUP 0
+
+/** user_data of requests whose completions are not reported, like cancels. */
+#define URING_IGNORE (~0ULL)
+
+/** \brief One io_uring instance, with its rings mapped.
+ */
+typedef struct Ring
+{
+    int fd;
+
+    unsigned int* sqHead;
+    unsigned int* sqTail;
+    unsigned int* sqMask;
+    unsigned int* sqArray;
+    unsigned int sqEntries;
+    struct io_uring_sqe* sqes;
+
+    /** Tail including the entries not submitted yet. */
+    unsigned int sqLocalTail;
+
+    unsigned int* cqHead;
+    unsigned int* cqTail;
+    unsigned int* cqMask;
+    struct io_uring_cqe* cqes;
+
+    void* sqMap;
+    void* cqMap;
+    size_t sqMapSize;
+    size_t cqMapSize;
+    size_t sqesSize;
+} Ring;
+
+/** \brief The io_uring backend: a ring for receives, a ring for sends, and the receive buffers.
+ *
+ * Sends have their own ring so that waiting for them never takes receive completions out of order.
+ */
+struct Uring
+{
+    Ring main;
+    Ring send;
+
+    /** Ring the kernel takes receive buffers from, and the buffers themselves. */
+    struct io_uring_buf_ring* bufRing;
+    char* buffers;
+
+    /** Layout of every received datagram: only the sender address is asked for. */
+    struct msghdr recvmsgLayout;
+};
+
+/** \brief Creates an io_uring instance and maps its rings.
+ *
+ * \param ring Ring* Where the instance is kept.
+ * \param entries unsigned int Number of submission entries.
+ * \return int 0 on success, -1 if io_uring or a feature we need is not supported.
+ *
+ */
+static int ringOpen(Ring* ring, unsigned int entries)
+{
+    struct io_uring_params p;
+
+    memset((void*) ring, (int) '\0', sizeof(*ring));
+    memset((void*) &p, (int) '\0', sizeof(p));
+
+    // Completions are only processed when we ask for them, like a read after epoll_wait()
+    p.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+
+    ring->fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (ring->fd == -1)
+        return -1;
+
+    if (!(p.features & IORING_FEAT_EXT_ARG))
+    {
+        close(ring->fd);
+        errno = ENOTSUP;
+        return -1;
+    }
+
+    ring->sqMapSize = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    ring->cqMapSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (ring->cqMapSize > ring->sqMapSize)
+            ring->sqMapSize = ring->cqMapSize;
+        ring->cqMapSize = ring->sqMapSize;
+    }
+
+    ring->sqMap = mmap(NULL, ring->sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sqMap == MAP_FAILED)
+    {
+        close(ring->fd);
+        return -1;
+    }
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+        ring->cqMap = ring->sqMap;
+    else
+        ring->cqMap = mmap(NULL, ring->cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+
+    ring->sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+
+    if (ring->cqMap == MAP_FAILED || ring->sqes == MAP_FAILED)
+    {
+        if (ring->cqMap != MAP_FAILED && ring->cqMap != ring->sqMap)
+            munmap(ring->cqMap, ring->cqMapSize);
+        if (ring->sqes != MAP_FAILED)
+            munmap(ring->sqes, ring->sqesSize);
+        munmap(ring->sqMap, ring->sqMapSize);
+        close(ring->fd);
+        return -1;
+    }
+
+    char* sq = (char*) ring->sqMap;
+    ring->sqHead = (unsigned int*) (sq + p.sq_off.head);
+    ring->sqTail = (unsigned int*) (sq + p.sq_off.tail);
+    ring->sqMask = (unsigned int*) (sq + p.sq_off.ring_mask);
+    ring->sqArray = (unsigned int*) (sq + p.sq_off.array);
+    ring->sqEntries = p.sq_entries;
+    ring->sqLocalTail = *(ring->sqTail);
+
+    char* cq = (char*) ring->cqMap;
+    ring->cqHead = (unsigned int*) (cq + p.cq_off.head);
+    ring->cqTail = (unsigned int*) (cq + p.cq_off.tail);
+    ring->cqMask = (unsigned int*) (cq + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*) (cq + p.cq_off.cqes);
+
+    return 0;
+}
+
+/** \brief Unmaps the rings of an instance and closes it.
+ */
+static void ringClose(Ring* ring)
+{
+    if (ring->fd < 0)
+        return;
+
+    munmap(ring->sqes, ring->sqesSize);
+    if (ring->cqMap != ring->sqMap)
+        munmap(ring->cqMap, ring->cqMapSize);
+    munmap(ring->sqMap, ring->sqMapSize);
+    close(ring->fd);
+    ring->fd = -1;
+}
+
+/** \brief Submits queued entries, and optionally waits for completions.
+ *
+ * \param ring Ring* The instance.
+ * \param minComplete unsigned int Completions to wait for. 0 to only submit.
+ * \param timeoutMs int Longest wait, in milliseconds, or -1. Ignored if minComplete is 0.
+ * \return int Entries submitted, or -1 on error (errno is ETIME on timeout).
+ *
+ */
+static int ringEnter(Ring* ring, unsigned int minComplete, int timeoutMs)
+{
+    unsigned int toSubmit = ring->sqLocalTail - *(ring->sqTail);
+    unsigned int flags = IORING_ENTER_EXT_ARG;
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+
+    __atomic_store_n(ring->sqTail, ring->sqLocalTail, __ATOMIC_RELEASE);
+
+    memset((void*) &arg, (int) '\0', sizeof(arg));
+    arg.sigmask_sz = _NSIG / 8;
+
+    if (minComplete > 0)
+    {
+        flags |= IORING_ENTER_GETEVENTS;
+        if (timeoutMs >= 0)
+        {
+            ts.tv_sec = timeoutMs / 1000;
+            ts.tv_nsec = (long long) (timeoutMs % 1000) * 1000000;
+            arg.ts = (unsigned long long) (uintptr_t) &ts;
+        }
+    }
+
+    return syscall(__NR_io_uring_enter, ring->fd, toSubmit, minComplete, flags, &arg, sizeof(arg));
+}
+
+/** \brief Gets a free submission entry, cleared. Submits the queued ones first if the ring is full.
+ *
+ * \param ring Ring* The instance.
+ * \return struct io_uring_sqe* The entry, or NULL if the kernel did not take any.
+ *
+ */
+static struct io_uring_sqe* ringEntry(Ring* ring)
+{
+    unsigned int head = __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE);
+
+    if (ring->sqLocalTail - head >= ring->sqEntries)
+    {
+        ringEnter(ring, 0, -1);
+        head = __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE);
+        if (ring->sqLocalTail - head >= ring->sqEntries)
+            return NULL;
+    }
+
+    unsigned int index = ring->sqLocalTail & *(ring->sqMask);
+    struct io_uring_sqe* sqe = &(ring->sqes[index]);
+
+    memset((void*) sqe, (int) '\0', sizeof(*sqe));
+    ring->sqArray[index] = index;
+    ring->sqLocalTail++;
+
+    return sqe;
+}
+
+/** \brief Takes completions out of a ring.
+ *
+ * \param ring Ring* The instance.
+ * \param out_cqes struct io_uring_cqe* Where the completions are copied to.
+ * \param max int Size of out_cqes.
+ * \return int Number of completions taken.
+ *
+ */
+static int ringReap(Ring* ring, struct io_uring_cqe* out_cqes, int max)
+{
+    unsigned int head = *(ring->cqHead);
+    unsigned int tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+    int n = 0;
+
+    while (head != tail && n < max)
+    {
+        out_cqes[n++] = ring->cqes[head & *(ring->cqMask)];
+        head++;
+    }
+
+    __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+    return n;
+}
+
+/** \brief Gives a receive buffer to the kernel.
+ *
+ * \param u Uring* The backend.
+ * \param bufferId int Number of the buffer.
+ *
+ */
+void uringReleaseBuffer(Uring* u, int bufferId)
+{
+    if (bufferId < 0)
+        return;
+
+    unsigned short tail = u->bufRing->tail;
+    struct io_uring_buf* b = &(u->bufRing->bufs[tail & (URING_BUFFERS - 1)]);
+
+    b->addr = (unsigned long long) (uintptr_t) (u->buffers + (size_t) bufferId * URING_BUFFER_SIZE);
+
+    // One byte is kept out of the kernel's reach, for the '\0' after the data
+    b->len = URING_BUFFER_SIZE - 1;
+    b->bid = bufferId;
+
+    __atomic_store_n(&(u->bufRing->tail), (unsigned short) (tail + 1), __ATOMIC_RELEASE);
+}
+
+/** \brief Opens the io_uring backend.
+ *
+ * Needs provided buffer rings, multishot receives and deferred task running (Linux 6.1 or newer).
+ *
+ * \return Uring* The backend, or NULL if the kernel does not support it.
+ *
+ */
+Uring* uringOpen()
+{
+    int i;
+
+    Uring* u = calloc(1, sizeof(Uring));
+    if (u == NULL)
+        return NULL;
+
+    if (ringOpen(&(u->main), URING_ENTRIES) == -1)
+    {
+        free(u);
+        return NULL;
+    }
+
+    if (ringOpen(&(u->send), URING_SEND_ENTRIES) == -1)
+    {
+        ringClose(&(u->main));
+        free(u);
+        return NULL;
+    }
+
+    size_t ringSize = URING_BUFFERS * sizeof(struct io_uring_buf);
+    u->bufRing = mmap(NULL, ringSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    u->buffers = malloc((size_t) URING_BUFFERS * URING_BUFFER_SIZE);
+
+    struct io_uring_buf_reg reg;
+    memset((void*) &reg, (int) '\0', sizeof(reg));
+    reg.ring_addr = (unsigned long long) (uintptr_t) u->bufRing;
+    reg.ring_entries = URING_BUFFERS;
+    reg.bgid = URING_BUFFER_GROUP;
+
+    if (u->bufRing == MAP_FAILED || u->buffers == NULL
+        || syscall(__NR_io_uring_register, u->main.fd, IORING_REGISTER_PBUF_RING, &reg, 1) == -1)
+    {
+        if (u->bufRing != MAP_FAILED)
+            munmap(u->bufRing, ringSize);
+        free(u->buffers);
+        ringClose(&(u->send));
+        ringClose(&(u->main));
+        free(u);
+        return NULL;
+    }
+
+    u->bufRing->tail = 0;
+    for (i = 0; i < URING_BUFFERS; i++)
+        uringReleaseBuffer(u, i);
+
+    u->recvmsgLayout.msg_namelen = sizeof(struct sockaddr_in);
+
+    return u;
+}
+
+/** \brief Closes the io_uring backend. Requests still armed are dropped.
+ */
+void uringClose(Uring* u)
+{
+    if (u == NULL)
+        return;
+
+    ringClose(&(u->send));
+    ringClose(&(u->main));
+    munmap(u->bufRing, URING_BUFFERS * sizeof(struct io_uring_buf));
+    free(u->buffers);
+    free(u);
+}
+
+/** \brief Arms a poll for input on a descriptor.
+ *
+ * Edge-triggered polls are multishot. The kernel does not allow level-triggered ones to be,
+ * so those complete once, and must be armed again while the input is wanted.
+ *
+ * \param u Uring* The backend.
+ * \param fd int Descriptor.
+ * \param level int 1 to be reported for as long as there is input, 0 only when new input arrives.
+ * \param userData unsigned long long Reported with every completion.
+ * \return int 0 on success, -1 if the ring is full.
+ *
+ */
+int uringPoll(Uring* u, int fd, int level, unsigned long long userData)
+{
+    struct io_uring_sqe* sqe = ringEntry(&(u->main));
+    if (sqe == NULL)
+        return -1;
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->len = level ? 0 : IORING_POLL_ADD_MULTI;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = userData;
+
+    return 0;
+}
+
+/** \brief Arms a multishot receive of datagrams, each into a buffer of the kernel's choice.
+ *
+ * \param u Uring* The backend.
+ * \param fd int UDP socket.
+ * \param userData unsigned long long Reported with every completion.
+ * \return int 0 on success, -1 if the ring is full.
+ *
+ */
+int uringRecvmsg(Uring* u, int fd, unsigned long long userData)
+{
+    struct io_uring_sqe* sqe = ringEntry(&(u->main));
+    if (sqe == NULL)
+        return -1;
+
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long long) (uintptr_t) &(u->recvmsgLayout);
+    sqe->len = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUFFER_GROUP;
+    sqe->user_data = userData;
+
+    return 0;
+}
+
+/** \brief Arms a multishot receive on a stream socket, each read into a buffer of the kernel's choice.
+ *
+ * \param u Uring* The backend.
+ * \param fd int TCP socket.
+ * \param userData unsigned long long Reported with every completion.
+ * \return int 0 on success, -1 if the ring is full.
+ *
+ */
+int uringRecv(Uring* u, int fd, unsigned long long userData)
+{
+    struct io_uring_sqe* sqe = ringEntry(&(u->main));
+    if (sqe == NULL)
+        return -1;
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUFFER_GROUP;
+    sqe->user_data = userData;
+
+    return 0;
+}
+
+/** \brief Cancels every request armed on a descriptor, right away.
+ *
+ * Their last completions may still be reported, with -ECANCELED.
+ *
+ * \param u Uring* The backend.
+ * \param fd int Descriptor.
+ * \return int 0 on success, -1 on error.
+ *
+ */
+int uringCancel(Uring* u, int fd)
+{
+    struct io_uring_sqe* sqe = ringEntry(&(u->main));
+    if (sqe == NULL)
+        return -1;
+
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = fd;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+    sqe->user_data = URING_IGNORE;
+
+    return (ringEnter(&(u->main), 0, -1) == -1) ? -1 : 0;
+}
+
+/** \brief Takes completions out of the main ring, leaving out the ones not reported.
+ *
+ * \return int Number of events written to out_events.
+ *
+ */
+static int reapEvents(Uring* u, UringEvent* out_events, int max)
+{
+    struct io_uring_cqe cqes[64];
+    int i, n = 0;
+
+    int nCqes = ringReap(&(u->main), cqes, max);
+    for (i = 0; i < nCqes; i++)
+    {
+        if (cqes[i].user_data == URING_IGNORE)
+            continue;
+
+        UringEvent* ev = &(out_events[n++]);
+        ev->userData = cqes[i].user_data;
+        ev->res = cqes[i].res;
+        ev->more = (cqes[i].flags & IORING_CQE_F_MORE) != 0;
+
+        if (cqes[i].flags & IORING_CQE_F_BUFFER)
+        {
+            ev->bufferId = cqes[i].flags >> IORING_CQE_BUFFER_SHIFT;
+            ev->buffer = u->buffers + (size_t) ev->bufferId * URING_BUFFER_SIZE;
+        }
+        else
+        {
+            ev->bufferId = -1;
+            ev->buffer = NULL;
+        }
+    }
+
+    return n;
+}
+
+/** \brief Submits the armed requests and waits for completions.
+ *
+ * \param u Uring* The backend.
+ * \param timeoutMs int Longest wait, in milliseconds. -1 to wait forever.
+ * \param out_events UringEvent* Where the completions are written.
+ * \param max int Size of out_events.
+ * \return int Number of completions. 0 on timeout, -1 on error (errno is set, EINTR included).
+ *
+ */
+int uringWait(Uring* u, int timeoutMs, UringEvent* out_events, int max)
+{
+    int n = 0;
+
+    if (max > 64)
+        max = 64;
+
+    // Completions of cancels are not reported, so wait again if those were all we got
+    while (n == 0)
+    {
+        // Nothing to wait for if completions are there already
+        if (__atomic_load_n(u->main.cqTail, __ATOMIC_ACQUIRE) == *(u->main.cqHead))
+        {
+            if (ringEnter(&(u->main), 1, timeoutMs) == -1)
+            {
+                if (errno == ETIME)
+                    return 0;
+                return -1;
+            }
+        }
+        else if (u->main.sqLocalTail != *(u->main.sqTail))
+        {
+            ringEnter(&(u->main), 0, -1);
+        }
+
+        n = reapEvents(u, out_events, max);
+    }
+
+    return n;
+}
+
+/** \brief Finds the datagram and sender address in a buffer filled by a multishot receive.
+ *
+ * \param ev UringEvent* Completion of uringRecvmsg(), with a buffer.
+ * \param out_len int* Out parameter. Length of the datagram, truncated to what fit in the buffer.
+ * \param out_addr struct sockaddr_in* Out parameter. Address of the sender.
+ * \param out_addrLen socklen_t* Out parameter. Length of out_addr.
+ * \return char* The datagram, null-terminated, inside the buffer. NULL if the completion has none.
+ *
+ */
+char* uringDatagram(UringEvent* ev, int* out_len, struct sockaddr_in* out_addr, socklen_t* out_addrLen)
+{
+    if (ev->buffer == NULL || ev->res < (int) (sizeof(struct io_uring_recvmsg_out) + sizeof(struct sockaddr_in)))
+        return NULL;
+
+    struct io_uring_recvmsg_out* out = (struct io_uring_recvmsg_out*) ev->buffer;
+    char* name = ev->buffer + sizeof(*out);
+    char* payload = name + sizeof(struct sockaddr_in);
+
+    memset((void*) out_addr, (int) '\0', sizeof(*out_addr));
+    memcpy(out_addr, name, out->namelen < sizeof(*out_addr) ? out->namelen : sizeof(*out_addr));
+    *out_addrLen = out->namelen < sizeof(*out_addr) ? out->namelen : sizeof(*out_addr);
+
+    // What was copied, which is less than payloadlen if the datagram was truncated
+    *out_len = ev->res - (int) (payload - ev->buffer);
+    payload[*out_len] = '\0';
+
+    return payload;
+}
+
+/** \brief Sends datagrams, like sendmmsg(), with one system call.
+ *
+ * The sends are linked, so that they stop at the first failure, as sendmmsg() does.
+ *
+ * \param u Uring* The backend.
+ * \param fd int UDP socket.
+ * \param msgs struct mmsghdr* Messages. Their msg_len is set to the bytes sent.
+ * \param n int Number of messages.
+ * \return int Number of messages sent, or -1 if the first one failed (errno is set), or the ring had no room (EBUSY).
+ *
+ */
+int uringSendmmsg(Uring* u, int fd, struct mmsghdr* msgs, int n)
+{
+    struct io_uring_cqe cqes[URING_SEND_ENTRIES];
+    int i, sent = 0;
+
+    while (sent < n)
+    {
+        int count = n - sent;
+        if (count > URING_SEND_ENTRIES)
+            count = URING_SEND_ENTRIES;
+
+        struct io_uring_sqe* last = NULL;
+
+        for (i = 0; i < count; i++)
+        {
+            struct io_uring_sqe* sqe = ringEntry(&(u->send));
+            if (sqe == NULL)
+            {
+                // The kernel took none of the entries: send the ones we got, and end the chain with the last of them
+                if (last != NULL)
+                    last->flags = 0;
+                count = i;
+                break;
+            }
+            last = sqe;
+
+            sqe->opcode = IORING_OP_SENDMSG;
+            sqe->fd = fd;
+            sqe->addr = (unsigned long long) (uintptr_t) &(msgs[sent + i].msg_hdr);
+            sqe->len = 1;
+            sqe->flags = (i < count - 1) ? IOSQE_IO_LINK : 0;
+            sqe->user_data = sent + i;
+        }
+
+        if (count == 0)
+        {
+            if (sent > 0)
+                return sent;
+            errno = EBUSY;
+            return -1;
+        }
+
+        if (ringEnter(&(u->send), count, -1) == -1)
+            return (sent > 0) ? sent : -1;
+
+        int reaped = 0;
+        int firstError = 0;
+        int failedAt = sent + count;
+
+        while (reaped < count)
+        {
+            int got = ringReap(&(u->send), cqes, count - reaped);
+            if (got == 0)
+            {
+                ringEnter(&(u->send), count - reaped, -1);
+                continue;
+            }
+
+            for (i = 0; i < got; i++)
+            {
+                int index = (int) cqes[i].user_data;
+                if (cqes[i].res >= 0)
+                    msgs[index].msg_len = cqes[i].res;
+                else if (index < failedAt)
+                {
+                    failedAt = index;
+                    firstError = -cqes[i].res;
+                }
+            }
+            reaped += got;
+        }
+
+        if (failedAt < sent + count)
+        {
+            if (failedAt == 0)
+            {
+                errno = firstError;
+                return -1;
+            }
+            return failedAt;
+        }
+
+        sent += count;
+    }
+
+    return sent;
+}
+
+/** \brief Sends bytes on a stream socket, waiting for all of them to be sent.
+ *
+ * \param u Uring* The backend.
+ * \param fd int TCP socket.
+ * \param data const void* Bytes to send.
+ * \param len int Number of bytes.
+ * \return int Bytes sent, or -1 on error (errno is set, to EBUSY if the ring had no room).
+ *
+ */
+int uringSend(Uring* u, int fd, const void* data, int len)
+{
+    struct io_uring_cqe cqe;
+
+    struct io_uring_sqe* sqe = ringEntry(&(u->send));
+    if (sqe == NULL)
+    {
+        errno = EBUSY;
+        return -1;
+    }
+
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long long) (uintptr_t) data;
+    sqe->len = len;
+    sqe->msg_flags = MSG_WAITALL;
+    sqe->user_data = 0;
+
+    if (ringEnter(&(u->send), 1, -1) == -1)
+        return -1;
+
+    while (ringReap(&(u->send), &cqe, 1) == 0)
+        ringEnter(&(u->send), 1, -1);
+
+    if (cqe.res < 0)
+    {
+        errno = -cqe.res;
+        return -1;
+    }
+
+    return cqe.res;
+}
+
+#else
+
+/* Built without io_uring: the backend is never available, and the reactor stays on epoll. */
+
+Uring* uringOpen() { return NULL; }
+void uringClose(Uring* u) { }
+int uringPoll(Uring* u, int fd, int level, unsigned long long userData) { return -1; }
+int uringRecvmsg(Uring* u, int fd, unsigned long long userData) { return -1; }
+int uringRecv(Uring* u, int fd, unsigned long long userData) { return -1; }
+int uringCancel(Uring* u, int fd) { return -1; }
+int uringWait(Uring* u, int timeoutMs, UringEvent* out_events, int max) { errno = ENOSYS; return -1; }
+char* uringDatagram(UringEvent* ev, int* out_len, struct sockaddr_in* out_addr, socklen_t* out_addrLen) { return NULL; }
+void uringReleaseBuffer(Uring* u, int bufferId) { }
+int uringSendmmsg(Uring* u, int fd, struct mmsghdr* msgs, int n) { errno = ENOSYS; return -1; }
+int uringSend(Uring* u, int fd, const void* data, int len) { errno = ENOSYS; return -1; }
+
+#endif // IORING_SETUP_DEFER_TASKRUN
@@ -0,0 +1,46 @@
+#ifndef URING_H_INCLUDED
+#define URING_H_INCLUDED
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+struct mmsghdr;
+
+/** Size of each buffer the kernel receives into. Big enough for any datagram we accept, its header and address. */
+#define URING_BUFFER_SIZE 2560
+
+/** \brief A completion taken from the ring.
+ */
+typedef struct UringEvent
+{
+    unsigned long long userData;
+
+    /** Result of the operation: bytes, poll mask, or -errno. */
+    int res;
+
+    /** 1 if the request is still armed and will complete again. */
+    int more;
+
+    /** Buffer the kernel received into, or -1. Must be given back with uringReleaseBuffer(). */
+    int bufferId;
+    char* buffer;
+} UringEvent;
+
+typedef struct Uring Uring;
+
+Uring* uringOpen();
+void uringClose(Uring* u);
+
+int uringPoll(Uring* u, int fd, int level, unsigned long long userData);
+int uringRecvmsg(Uring* u, int fd, unsigned long long userData);
+int uringRecv(Uring* u, int fd, unsigned long long userData);
+int uringCancel(Uring* u, int fd);
+
+int uringWait(Uring* u, int timeoutMs, UringEvent* out_events, int max);
+char* uringDatagram(UringEvent* ev, int* out_len, struct sockaddr_in* out_addr, socklen_t* out_addrLen);
+void uringReleaseBuffer(Uring* u, int bufferId);
+
+int uringSendmmsg(Uring* u, int fd, struct mmsghdr* msgs, int n);
+int uringSend(Uring* u, int fd, const void* data, int len);
+
+#endif // URING_H_INCLUDED
@@ -0,0 +1,444 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <linux/filter.h>
+
+#include "globals.h"
+#include "list.h"
+#include "server.h"
+#include "debug.h"
+#include "snapshot.h"
+#include "workers.h"
+#include "reactor.h"
+
+/** Largest number of query workers. */
+#define MAX_WORKERS 16
+
+/** Largest number of datagrams a worker receives, and of replies it sends, in one system call. */
+#define WORKER_BATCH 32
+
+/** Largest RPL a worker sends, with the name of the QRY echoed. */
+#define WORKER_REPLY_MAX (256 + NAME_LEN + 8)
+
+/** Datagrams that can wait for the main thread at once. More are dropped. */
+#define FORWARD_QUEUE_SIZE 64
+
+/** \brief A thread answering QRYs on its own socket, bound to the same port as the dnsSocket.
+ */
+typedef struct Worker
+{
+    pthread_t thread;
+    int socket;
+    int stop;
+
+    /** Reader slot used to pin snapshots of the contact list. */
+    int reader;
+
+    /** QRYs answered, and datagrams handed to the main thread. Updated atomically. */
+    long queries;
+    long forwarded;
+} Worker;
+
+/** \brief A datagram received by a worker that only the main thread may handle.
+ */
+typedef struct Forwarded
+{
+    char data[2048];
+    int len;
+    struct sockaddr_in addr;
+    socklen_t addrLen;
+} Forwarded;
+
+static Worker workers[MAX_WORKERS];
+static int nWorkers = 0;
+
+/** Datagrams waiting for the main thread, and a pipe that wakes it up. */
+static Forwarded forwardQueue[FORWARD_QUEUE_SIZE];
+static int forwardFirst = 0;
+static int forwardCount = 0;
+static long forwardDropped = 0;
+static pthread_mutex_t forwardLock = PTHREAD_MUTEX_INITIALIZER;
+static int forwardPipe[2] = {-1, -1};
+
+/** \brief Steers QRYs to the workers, and every other message to the dnsSocket.
+ *
+ * Attaches a classic BPF program to the SO_REUSEPORT group of the dnsSocket.
+ * The program returns the index of the socket in the group: 0 is the dnsSocket,
+ * which was bound first, and 1 to n are the workers. Datagrams too short to be
+ * a QRY make the load fail, which also returns 0.
+ *
+ * \param n int Number of workers.
+ * \return int 0 on success, -1 if the kernel does not support it.
+ *
+ */
+static int steerQueries(int n)
+{
+    struct sock_filter code[] =
+    {
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 0),                              // First 4 bytes of the payload
+        BPF_STMT(BPF_ALU | BPF_AND | BPF_K, 0xFFFFFF00),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ('Q' << 24) | ('R' << 16) | ('Y' << 8), 0, 4),
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_RANDOM),
+        BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, n),
+        BPF_STMT(BPF_ALU | BPF_ADD | BPF_K, 1),
+        BPF_STMT(BPF_RET | BPF_A, 0),                                       // QRY: a random worker
+        BPF_STMT(BPF_RET | BPF_K, 0)                                        // Anything else: the dnsSocket
+    };
+
+    struct sock_fprog prog;
+    prog.len = sizeof(code) / sizeof(code[0]);
+    prog.filter = code;
+
+    return setsockopt(dnsSocket, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog));
+}
+
+/** \brief Hands a datagram to the main thread, and wakes it up.
+ *
+ * \param data const char* Datagram received.
+ * \param len int Length of the datagram.
+ * \param addr struct sockaddr_in* Address of the sender.
+ * \param addrLen socklen_t Length of addr.
+ *
+ */
+static void forwardToMain(const char* data, int len, struct sockaddr_in* addr, socklen_t addrLen)
+{
+    pthread_mutex_lock(&forwardLock);
+
+    if (forwardCount == FORWARD_QUEUE_SIZE)
+    {
+        forwardDropped++;
+        pthread_mutex_unlock(&forwardLock);
+        return;
+    }
+
+    Forwarded* f = &(forwardQueue[(forwardFirst + forwardCount) % FORWARD_QUEUE_SIZE]);
+    memcpy(f->data, data, len + 1);
+    f->len = len;
+    memcpy(&(f->addr), addr, sizeof(f->addr));
+    f->addrLen = addrLen;
+    forwardCount++;
+
+    pthread_mutex_unlock(&forwardLock);
+
+    // The pipe is non-blocking: if it is full, the main thread has plenty of wakeups pending already
+    char wake = 'F';
+    if (write(forwardPipe[1], &wake, 1) == -1 && errno != EAGAIN)
+        perror("Could not wake up main thread");
+}
+
+/** \brief Main loop of a query worker.
+ *
+ * Receives batches of datagrams on the worker's socket. Answers QRYs from the last snapshot
+ * of the contact list, without locks, and sends all the replies with one sendmmsg().
+ * Anything else is forwarded to the main thread, which owns the contact list.
+ *
+ * \param arg void* The Worker.
+ * \return void* NULL.
+ *
+ */
+static void* queryWorker(void* arg)
+{
+    Worker* w = (Worker*) arg;
+    int i;
+
+    char buffers[WORKER_BATCH][2048];
+    char replies[WORKER_BATCH][WORKER_REPLY_MAX];
+    struct sockaddr_in addrs[WORKER_BATCH];
+    struct mmsghdr msgs[WORKER_BATCH];
+    struct iovec iovs[WORKER_BATCH];
+    struct mmsghdr out[WORKER_BATCH];
+    struct iovec outIovs[WORKER_BATCH];
+
+    while (!__atomic_load_n(&(w->stop), __ATOMIC_ACQUIRE))
+    {
+        memset((void*) msgs, (int) '\0', sizeof(msgs));
+        for (i = 0; i < WORKER_BATCH; i++)
+        {
+            iovs[i].iov_base = buffers[i];
+            iovs[i].iov_len = 2047;
+
+            msgs[i].msg_hdr.msg_iov = &(iovs[i]);
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_name = &(addrs[i]);
+            msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+        }
+
+        // Blocks for the first datagram, then takes whatever else is already there
+        int ret = recvmmsg(w->socket, msgs, WORKER_BATCH, MSG_WAITFORONE, NULL);
+        if (ret == -1 && errno == EINTR)
+            continue;
+        if (ret <= 0)
+            break;    // Socket was shut down
+
+        int nReplies = 0;
+        memset((void*) out, (int) '\0', sizeof(out[0]) * ret);
+
+        for (i = 0; i < ret; i++)
+        {
+            Message msg;
+            char* buffer = buffers[i];
+            int len = msgs[i].msg_len;
+
+            buffer[len] = '\0';
+
+            // parseMessage() overwrites the buffer, keep it intact in case it must be forwarded
+            // Listing other members walks the contact list, which only the main thread may do
+            if (strncmp(buffer, "QRY ", 4) != 0 || strstr(buffer, "\nALT") != NULL)
+            {
+                forwardToMain(buffer, len, &addrs[i], msgs[i].msg_hdr.msg_namelen);
+                __atomic_add_fetch(&(w->forwarded), 1, __ATOMIC_RELAXED);
+                continue;
+            }
+
+            parseMessage(buffer, &msg);
+            if (msg.nFields != 1 || msg.fields[0].len >= NAME_LEN)
+                continue;
+
+            int replyLen = snapshotQuery(contacts, w->reader, msg.fields[0].str, replies[nReplies], 256);
+
+            if (queryFlags(msg.rest) & QUERY_ECHO)
+                replyLen += sprintf(replies[nReplies] + replyLen, "\nQRY %s", msg.fields[0].str);
+
+            outIovs[nReplies].iov_base = replies[nReplies];
+            outIovs[nReplies].iov_len = replyLen;
+
+            out[nReplies].msg_hdr.msg_iov = &(outIovs[nReplies]);
+            out[nReplies].msg_hdr.msg_iovlen = 1;
+            out[nReplies].msg_hdr.msg_name = &(addrs[i]);
+            out[nReplies].msg_hdr.msg_namelen = msgs[i].msg_hdr.msg_namelen;
+            nReplies++;
+        }
+
+        int sent = 0;
+        while (sent < nReplies)
+        {
+            ret = sendmmsg(w->socket, out + sent, nReplies - sent, 0);
+            if (ret == -1)
+            {
+                // Skip the reply that failed and go on with the rest
+                perror("Query worker could not send RPL");
+                sent++;
+                continue;
+            }
+            sent += ret;
+        }
+
+        __atomic_add_fetch(&(w->queries), nReplies, __ATOMIC_RELAXED);
+    }
+
+    return NULL;
+}
+
+/** \brief Handles every datagram forwarded by the workers. Reactor callback for the pipe, on the main thread.
+ *
+ * \param fd int Read end of the pipe.
+ * \param arg void* Unused.
+ *
+ */
+static void handleForwarded(int fd, void* arg)
+{
+    char drain[64];
+    Forwarded f;
+
+    while (read(fd, drain, sizeof(drain)) > 0)
+        ;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&forwardLock);
+        if (forwardCount == 0)
+        {
+            pthread_mutex_unlock(&forwardLock);
+            break;
+        }
+
+        memcpy(&f, &(forwardQueue[forwardFirst]), sizeof(f));
+        forwardFirst = (forwardFirst + 1) % FORWARD_QUEUE_SIZE;
+        forwardCount--;
+        pthread_mutex_unlock(&forwardLock);
+
+        // Handlers may close the dnsSocket (eg. at the end of a leave)
+        if (dnsSocket != -1)
+            handleServerMessage(f.data, &(f.addr), f.addrLen);
+    }
+}
+
+/** \brief Opens a socket on the DNS port, sharing it with the dnsSocket through SO_REUSEPORT.
+ *
+ * \return int The socket, or -1 on error.
+ *
+ */
+static int openWorkerSocket()
+{
+    int one = 1;
+    struct sockaddr_in addr;
+
+    int s = socket(AF_INET, SOCK_DGRAM, 0);
+    if (s == -1)
+        return -1;
+
+    memset((void*) &addr, (int) '\0', sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(myDnsPort);
+
+    if (setsockopt(s, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) == -1
+        || bind(s, (struct sockaddr*) &addr, sizeof(addr)) == -1)
+    {
+        close(s);
+        return -1;
+    }
+
+    return s;
+}
+
+/** \brief Starts n query workers. Called right after the dnsSocket is bound, with SO_REUSEPORT set.
+ *
+ * If anything fails, every worker already started is stopped, and QRYs stay on the main thread.
+ *
+ * \param n int Number of workers.
+ * \return int Number of workers started.
+ *
+ */
+int startWorkers(int n)
+{
+    int i;
+
+    if (n <= 0 || nWorkers > 0)
+        return nWorkers;
+
+    if (n > MAX_WORKERS)
+        n = MAX_WORKERS;
+
+    if (steerQueries(n) == -1)
+    {
+        perror("Could not steer QRYs to the query workers");
+        return 0;
+    }
+
+    if (forwardPipe[0] == -1)
+    {
+        if (pipe(forwardPipe) == -1)
+        {
+            perror("Could not open pipe for the query workers");
+            return 0;
+        }
+        fcntl(forwardPipe[0], F_SETFL, O_NONBLOCK);
+        fcntl(forwardPipe[1], F_SETFL, O_NONBLOCK);
+
+        reactorAdd(reactor, forwardPipe[0], REACTOR_EDGE, handleForwarded, NULL);
+    }
+
+    // Workers answer from snapshots only, so there must be one before the first QRY
+    publishSnapshot(contacts);
+
+    for (i = 0; i < n; i++)
+    {
+        Worker* w = &(workers[i]);
+        memset((void*) w, (int) '\0', sizeof(*w));
+
+        w->reader = snapshotReader();
+        if (w->reader == -1)
+        {
+            printf("Too many snapshot readers for another query worker.\n");
+            break;
+        }
+
+        w->socket = openWorkerSocket();
+        if (w->socket == -1)
+        {
+            perror("Could not open query worker socket");
+            releaseReader(w->reader);
+            break;
+        }
+
+        if (pthread_create(&(w->thread), NULL, queryWorker, w) != 0)
+        {
+            printf("Could not start query worker.\n");
+            close(w->socket);
+            releaseReader(w->reader);
+            break;
+        }
+
+        nWorkers++;
+    }
+
+    if (nWorkers < n)
+    {
+        stopWorkers();
+        return 0;
+    }
+
+    logm(1, "Started %d query workers on port %d.\n", nWorkers, myDnsPort);
+    return nWorkers;
+}
+
+/** \brief Stops every query worker and closes its socket.
+ */
+void stopWorkers()
+{
+    int i;
+
+    for (i = 0; i < nWorkers; i++)
+    {
+        __atomic_store_n(&(workers[i].stop), 1, __ATOMIC_RELEASE);
+
+        // Wakes up the worker if it is blocked in recvmmsg()
+        shutdown(workers[i].socket, SHUT_RDWR);
+    }
+
+    for (i = 0; i < nWorkers; i++)
+    {
+        pthread_join(workers[i].thread, NULL);
+        close(workers[i].socket);
+        releaseReader(workers[i].reader);
+    }
+
+    // With no readers left, every replaced snapshot can go
+    reclaimSnapshots();
+
+    if (nWorkers > 0)
+        logm(1, "Stopped %d query workers.\n", nWorkers);
+
+    nWorkers = 0;
+}
+
+/** \brief Checks if there are query workers running.
+ *
+ * \return int Number of running workers.
+ *
+ */
+int workersRunning()
+{
+    return nWorkers;
+}
+
+/** \brief Prints the counters of every query worker. Debug function.
+ */
+void printWorkerStats()
+{
+    int i;
+
+    if (nWorkers == 0)
+    {
+        printf("Query workers: none, QRYs are answered by the main thread.\n");
+        return;
+    }
+
+    printf("Query workers: %d\n", nWorkers);
+    for (i = 0; i < nWorkers; i++)
+        printf("  worker %d: %ld QRYs answered, %ld datagrams forwarded\n", i,
+               __atomic_load_n(&(workers[i].queries), __ATOMIC_RELAXED), __atomic_load_n(&(workers[i].forwarded), __ATOMIC_RELAXED));
+
+    if (forwardDropped > 0)
+        printf("  %ld forwarded datagrams dropped, main thread too busy\n", forwardDropped);
+
+    printSnapshotStats();
+}
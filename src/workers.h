@@ -0,0 +1,10 @@
+#ifndef WORKERS_H_INCLUDED
+#define WORKERS_H_INCLUDED
+
+int startWorkers(int n);
+void stopWorkers();
+int workersRunning();
+
+void printWorkerStats();
+
+#endif // WORKERS_H_INCLUDED